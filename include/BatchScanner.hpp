@@ -0,0 +1,159 @@
+#ifndef BATCHSCANNER_HPP_
+#define BATCHSCANNER_HPP_
+
+#include "DirectoryWalker.hpp"
+#include "ThreadPool.hpp"
+#include "WavData.hpp"
+#include <atomic>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Output formats of the scanner
+enum ScanFormat {
+  SCAN_CSV,  // Header line, then one line per file
+  SCAN_JSON  // One JSON object per line
+};
+
+class BatchScanner {
+public:
+  /**
+   * @brief Constructor. Fields are given as "chunk.field", such as
+   * "bext.Description". Chunk IDs shorter than 4 characters are padded with
+   * spaces ("fmt.Channels").
+   * @param std::vector<std::string> fields to extract
+   * @param unsigned int number of threads, 0 for one per hardware thread
+   */
+  BatchScanner(const std::vector<std::string> &fields,
+               unsigned int nThreads = 0);
+
+  /**
+   * @brief Destructor
+   */
+  ~BatchScanner(void);
+
+  /**
+   * @brief Scans files and directory trees in parallel. Directories are
+   * walked recursively and every .wav file in them is scanned. Only the
+   * chunk headers and the requested chunks are read. One record per file is
+   * written as soon as it is scanned, so records are not in path order.
+   * Files that cannot be parsed get a record with an error.
+   * @param std::vector<std::string> files and directories
+   * @param std::ostream output stream
+   * @param ScanFormat
+   * @return size_t number of files scanned
+   */
+  size_t scan(const std::vector<std::string> &paths, std::ostream &os,
+              const ScanFormat format = SCAN_CSV);
+
+  /**
+   * @brief Get the number of files that could not be parsed by the last scan
+   * @return size_t
+   */
+  size_t getErrorCount(void) const;
+
+  /**
+   * @brief Formats the value of a field as text, following its type. Strings
+   * stop at the first null byte and byte arrays are printed in hexadecimal.
+   * @param Chunk::Field
+   * @return std::string
+   */
+  static std::string formatField(const Chunk::Field &field);
+
+  /**
+   * @brief Field given as "chunk.field"
+   * @member std::string name as given
+   * @member std::string chunk ID, padded with spaces
+   * @member FourCC key of the chunk, only meaningful for IDs of 4 characters
+   * @member std::string field name
+   */
+  struct FieldSpec {
+    std::string name;
+    std::string chunk;
+    FourCC key;
+    std::string field;
+  };
+
+  /**
+   * @brief Parses a field given as "chunk.field"
+   * @param std::string
+   * @return FieldSpec
+   */
+  static FieldSpec parseField(const std::string &name);
+
+  /**
+   * @brief Finds a field of a file that was read. Chunks that are only
+   * defined by default, not in the file, have no field.
+   * @param WavData
+   * @param std::vector<WavData::ChunkEntry> chunk directory of the file
+   * @param FieldSpec
+   * @return Chunk::FieldRef null if the file does not have the field
+   */
+  static Chunk::FieldRef
+  findField(WavData &wav, const std::vector<WavData::ChunkEntry> &directory,
+            const FieldSpec &spec);
+
+  /**
+   * @brief Checks if a filename has the .wav extension, in any case
+   * @param std::string
+   * @return bool
+   */
+  static bool isWavFile(const std::string &fn);
+
+  /**
+   * @brief Value of a field of a file
+   * @member std::string text, formatted by @ref formatField
+   * @member bool whether the file has that field
+   * @member bool whether it is a number, not quoted in JSON
+   * @member bool whether it is a NaN or infinite float, null in JSON
+   */
+  struct Value {
+    Value() : found(false), number(false), null(false) {}
+
+    std::string text;
+    bool found;
+    bool number;
+    bool null;
+  };
+
+  /**
+   * @brief Reads the fields of a file. Only the chunk headers are read, then
+   * the bodies of the chunks of the fields. A file that cannot be parsed has
+   * no directory and no field.
+   * @param WavData parser, reused from file to file
+   * @param std::string filename
+   * @param std::vector<FieldSpec> fields to extract
+   * @param std::vector<WavData::ChunkEntry> chunk directory of the file
+   * @param std::vector<Value> one value per field
+   * @return std::string error, empty if the file was parsed
+   */
+  static std::string
+  extractFields(WavData &wav, const std::string &fn,
+                const std::vector<FieldSpec> &fields,
+                std::vector<WavData::ChunkEntry> &directory,
+                std::vector<Value> &values);
+
+private:
+  BatchScanner(const BatchScanner &);
+  BatchScanner &operator=(const BatchScanner &);
+
+  void onDirectoryError(const std::string &dir);
+  void scanFile(const std::string &fn, const unsigned int worker);
+  std::string record(const std::string &fn, const std::vector<Value> &values,
+                     const std::string &error) const;
+  std::string header(void) const;
+
+  std::vector<FieldSpec> fields_;
+  ThreadPool pool_;
+  // One parser per worker, reused from file to file
+  std::vector<std::unique_ptr<WavData>> parsers_;
+  DirectoryWalker walker_;
+
+  std::ostream *os_;
+  ScanFormat format_;
+  std::mutex outMutex_;
+  std::atomic<size_t> count_, errors_;
+};
+
+#endif // BATCHSCANNER_HPP_
@@ -0,0 +1,92 @@
+#ifndef CHANNELMAPPER_HPP_
+#define CHANNELMAPPER_HPP_
+
+#include "SampleConverter.hpp"
+#include <string>
+#include <vector>
+
+/**
+ * @brief Converts between interleaved frames of a sample type and one float
+ * array per channel. Frames are processed block by block through scratch
+ * buffers that stay in the cache, with shuffle kernels specialized for
+ * common channel counts (@ref getDeinterleaveKernel). Extraction and mixdown
+ * only decode the channels they use.
+ */
+class ChannelMapper {
+public:
+  /**
+   * @brief Mapper of frames of a sample type
+   * @param SampleType
+   * @param unsigned int channels of a frame
+   * @param SimdLevel
+   */
+  ChannelMapper(const SampleType type, const unsigned int channels,
+                const SimdLevel level = detectSimdLevel());
+
+  /**
+   * @brief Mapper of the frames described by the fmt chunk of a WavData
+   * object. An error is raised if they cannot be converted or are padded.
+   * @param WavData
+   * @param SimdLevel
+   */
+  ChannelMapper(WavData &wav, const SimdLevel level = detectSimdLevel());
+
+  /**
+   * @brief Decodes frames to one array per channel
+   * @param const char * nFrames encoded frames
+   * @param float * const * one array of nFrames floats per channel
+   * @param size_t number of frames
+   */
+  void deinterleave(const char *src, float *const *dst, const size_t nFrames);
+
+  /**
+   * @brief Encodes one array per channel to frames
+   * @param const float * const * one array of nFrames floats per channel
+   * @param char * nFrames encoded frames
+   * @param size_t number of frames
+   */
+  void interleave(const float *const *src, char *dst, const size_t nFrames);
+
+  /**
+   * @brief Decodes some channels of frames, the others are not converted
+   * @param const char * nFrames encoded frames
+   * @param std::vector<unsigned int> channels, in any order
+   * @param float * const * one array of nFrames floats per extracted channel
+   * @param size_t number of frames
+   */
+  void extract(const char *src, const std::vector<unsigned int> &channels,
+               float *const *dst, const size_t nFrames);
+
+  /**
+   * @brief Mixes the channels of frames down to other channels, such as 5.1
+   * to stereo. Channels with no gain in any output are not converted.
+   * @param const char * nFrames encoded frames
+   * @param std::vector<float> gains, one row of getChannels() gains per
+   * output channel
+   * @param float * const * one array of nFrames floats per output channel
+   * @param size_t number of frames
+   */
+  void mixdown(const char *src, const std::vector<float> &matrix,
+               float *const *dst, const size_t nFrames);
+
+  unsigned int getChannels(void) const;
+  SampleType getSampleType(void) const;
+
+private:
+  void init(void);
+  size_t blockFrames(const unsigned int channels) const;
+  void gather(const char *src, const unsigned int *channels,
+              const unsigned int n, char *dst, const size_t nFrames) const;
+
+  SampleConverter converter_;
+  unsigned int channels_;
+  SimdLevel level_;
+  DeinterleaveKernel deinterleave_;
+  InterleaveKernel interleave_;
+  MixKernel mix_;
+  // Scratch of one block
+  std::vector<char> raw_;
+  std::vector<float> floats_, planar_;
+};
+
+#endif // CHANNELMAPPER_HPP_
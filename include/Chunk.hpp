@@ -1,14 +1,19 @@
 #ifndef CHUNK_HPP_
 #define CHUNK_HPP_
 
+#include "FourCC.hpp"
+#include <assert.h>
+#include <cstdint>
+#include <cstring>
 #include <iostream>
-#include <map>
 #include <memory>
 #include <string>
 #include <vector>
 
 #define ID_SIZE 4
 #define CK_SIZE_BYTES 4
+// Largest size a RIFF chunk header can hold, bigger ones need RF64
+#define MAX_CHUNK_SIZE 0xffffffff
 
 // Field types
 typedef int F_TYPE;
@@ -23,6 +28,163 @@ enum FieldType {
   F_NDEF
 };
 
+class MappedFile;
+
+/**
+ * @brief Byte array value of a field. A field of a chunk keeps its bytes in a
+ * slot of the chunk's arena (@ref Chunk), a field that is not in a chunk owns
+ * a string. A value can also be a non-owning view into a mapped file
+ * (@ref WavData::read) which is copied the first time it is modified.
+ */
+class FieldValue {
+  friend class Chunk;
+
+public:
+  FieldValue(void);
+  FieldValue(const std::string &s);
+  FieldValue(const char *s);
+
+  /**
+   * @brief Copies own their bytes, they never share the arena of a chunk
+   */
+  FieldValue(const FieldValue &v);
+
+  /**
+   * @brief Moves keep the slot, they only happen within a chunk
+   */
+  FieldValue(FieldValue &&v) noexcept;
+
+  /**
+   * @brief Assigning a value always drops the view
+   */
+  FieldValue &operator=(const FieldValue &v);
+  FieldValue &operator=(const std::string &s);
+  FieldValue &operator=(const char *s);
+
+  /**
+   * @brief Copies nBytes bytes from data, which must not point into the
+   * value's own chunk
+   * @param const char * first byte
+   * @param size_t number of bytes
+   */
+  void assign(const char *data, size_t nBytes);
+
+  /**
+   * @brief Makes the value a view of nBytes bytes starting at data
+   * @param const char * first byte of the view
+   * @param size_t number of bytes
+   */
+  void setView(const char *data, size_t nBytes);
+
+  /**
+   * @brief Checks if the value is still a non-owning view
+   * @return bool
+   */
+  bool isView(void) const;
+
+  /**
+   * @brief Checks if the value was modified since it was read from a file.
+   * Copying a view does not modify the value.
+   * @return bool
+   */
+  bool isDirty(void) const;
+
+  /**
+   * @brief Read-only access to the bytes, never copies
+   * @return const char *
+   */
+  const char *data(void) const;
+  size_t size(void) const;
+  bool empty(void) const;
+  const char &operator[](const size_t i) const;
+
+  /**
+   * @brief Mutable access, copies the view first if there is one
+   */
+  char &operator[](const size_t i);
+  void push_back(const char c);
+  void resize(const size_t n);
+  void materialize(void);
+
+  /**
+   * @brief Mutable string of the bytes. The value leaves the arena of its
+   * chunk for a string of its own.
+   * @return std::string &
+   */
+  std::string &str(void);
+
+  /**
+   * @brief Copies the bytes into a new string
+   * @return std::string
+   */
+  operator std::string(void) const;
+
+  friend std::ostream &operator<<(std::ostream &os, const FieldValue &v);
+
+private:
+  void store(const char *data, size_t nBytes);
+  void attach(std::string *arena, const size_t capacity);
+  void clear(void);
+  void reserve(const size_t n);
+
+  // Bytes of a value that is not in a chunk
+  std::string str_;
+  // Slot of the value in the arena of its chunk
+  std::string *arena_;
+  size_t offset_, capacity_;
+  const char *view_;
+  // Size of a slot or of a view
+  size_t size_;
+  bool dirty_;
+};
+
+/**
+ * @brief Conversions between the bytes of a field and a typed value
+ * (@ref Chunk::get). Numerical values are little endian.
+ */
+template <typename T> struct FieldCodec {
+  static constexpr bool fits(const uint64_t nBytes) {
+    return sizeof(T) == nBytes;
+  }
+
+  static T decode(const FieldValue &v, const F_TYPE) {
+    // Missing bytes of a short value are 0
+    uint64_t bits = 0;
+    for (size_t i = 0; i < v.size() && i < sizeof(T); i++)
+      bits |= (uint64_t)(unsigned char)v[i] << (8 * i);
+    T out;
+    std::memcpy(&out, &bits, sizeof(T));
+    return out;
+  }
+
+  static void encode(const T &value, FieldValue &v, const uint64_t) {
+    uint64_t bits = 0;
+    std::memcpy(&bits, &value, sizeof(T));
+    char bytes[sizeof(T)];
+    for (size_t i = 0; i < sizeof(T); i++)
+      bytes[i] = bits >> (8 * i);
+    v.assign(bytes, sizeof(T));
+  }
+};
+
+template <> struct FieldCodec<std::string> {
+  static constexpr bool fits(const uint64_t) { return true; }
+
+  static std::string decode(const FieldValue &v, const F_TYPE type) {
+    // Text is padded with null bytes
+    std::string s = v;
+    return type == F_STRING ? s.substr(0, s.find('\0')) : s;
+  }
+
+  static void encode(const std::string &value, FieldValue &v,
+                     const uint64_t nBytes) {
+    if (nBytes && value.size() > nBytes)
+      throw std::string(
+          "Size of the field\'s value is greater than the defined size\n");
+    v = value;
+  }
+};
+
 class Chunk {
   friend class WavData;
 
@@ -30,18 +192,61 @@ public:
   /**
    * @brief Field of a chunk.
    * @member F_TYPE type of the field for printing purposes
-   * @member unsigned int number of bytes to read and write
+   * @member uint64_t number of bytes to read and write
    * @member std::string name to access that field at runtime
-   * @member std::string value in a byte array
+   * @member FieldValue value in a byte array (or a view of one)
    */
   struct Field {
     // Defaults
     Field() : type(F_NDEF), nBytes(0), name("\0") {}
 
     F_TYPE type;
-    unsigned int nBytes;
+    uint64_t nBytes;
     std::string name;
-    std::string val;
+    FieldValue val;
+  };
+
+  class ConstFieldRef;
+
+  /**
+   * @brief Handle to a field of a chunk. It stays valid when fields are added
+   * and it is null if the field does not exist.
+   */
+  class FieldRef {
+    friend class ConstFieldRef;
+
+  public:
+    FieldRef(void);
+    FieldRef(std::nullptr_t);
+    FieldRef(Chunk *chunk, const size_t index);
+
+    Field *operator->(void) const;
+    Field &operator*(void) const;
+    explicit operator bool(void) const;
+
+  private:
+    Chunk *chunk_;
+    size_t index_;
+  };
+
+  /**
+   * @brief Read-only handle to a field of a const chunk, such as a chunk of a
+   * WavSnapshot
+   */
+  class ConstFieldRef {
+  public:
+    ConstFieldRef(void);
+    ConstFieldRef(std::nullptr_t);
+    ConstFieldRef(const Chunk *chunk, const size_t index);
+    ConstFieldRef(const FieldRef &ref);
+
+    const Field *operator->(void) const;
+    const Field &operator*(void) const;
+    explicit operator bool(void) const;
+
+  private:
+    const Chunk *chunk_;
+    size_t index_;
   };
 
   /**
@@ -57,6 +262,12 @@ public:
    */
   Chunk(const std::string &name, const std::vector<Field> &fields);
 
+  /**
+   * @brief Copy constructor and assignment. The copy gets its own arena.
+   */
+  Chunk(const Chunk &ck);
+  Chunk &operator=(const Chunk &ck);
+
   /**
    * @brief Destructor
    */
@@ -69,17 +280,65 @@ public:
   void addField(const Field f);
 
   /**
-   * @brief Get a pointer to a field by its name
+   * @brief Get a handle to a field by its name
    * @param std::string
-   * @return std::shared_ptr<Chunk::Field>
+   * @return Chunk::FieldRef null if there is no such field
    */
-  std::shared_ptr<Field> getField(const std::string &fieldName);
+  FieldRef getField(const std::string &fieldName);
+  ConstFieldRef getField(const std::string &fieldName) const;
 
   /**
-   * @brief Get a vector of all fields (order matters)
-   * @return std::vector<std::shared_ptr<Chunk::Field>>
+   * @brief Get a handle to a field by its position
+   * @param size_t
+   * @return Chunk::FieldRef null if there is no such field
    */
-  std::vector<std::shared_ptr<Field>> getAllFields(void) const;
+  FieldRef getField(const size_t index);
+  ConstFieldRef getField(const size_t index) const;
+
+  /**
+   * @brief Get a field by its name without a handle, for read-only chunks
+   * @param std::string
+   * @return const Chunk::Field * null if there is no such field
+   */
+  const Field *findField(const std::string &fieldName) const;
+
+  /**
+   * @brief Get the number of fields
+   * @return size_t
+   */
+  size_t getFieldCount(void) const;
+
+  /**
+   * @brief Get handles to all fields (order matters), read-only ones for a
+   * const chunk
+   * @return std::vector<Chunk::FieldRef>
+   */
+  std::vector<FieldRef> getAllFields(void);
+  std::vector<ConstFieldRef> getAllFields(void) const;
+
+  /**
+   * @brief Get the value of a schema field (@ref ChunkSchema.hpp), such as
+   * bext.get<BextSchema::LoudnessValue>(). The field is found by its index,
+   * not by its name.
+   * @tparam F SchemaField
+   * @return F::type
+   */
+  template <typename F> typename F::type get(void) const {
+    assert(name_ == F::schema::id() && F::index < fields_.size());
+    const Field &f = fields_[F::index];
+    return FieldCodec<typename F::type>::decode(f.val, f.type);
+  }
+
+  /**
+   * @brief Set the value of a schema field (@ref ChunkSchema.hpp)
+   * @tparam F SchemaField
+   * @param F::type
+   */
+  template <typename F> void set(const typename F::type &value) {
+    assert(name_ == F::schema::id() && F::index < fields_.size());
+    Field &f = fields_[F::index];
+    FieldCodec<typename F::type>::encode(value, f.val, f.nBytes);
+  }
 
   /**
    * @brief Get the name of the current chunk
@@ -87,6 +346,12 @@ public:
    */
   std::string getChunkName(void) const;
 
+  /**
+   * @brief Get the packed ID of the current chunk
+   * @return FourCC
+   */
+  FourCC getFourCC(void) const;
+
   /**
    * @brief Prints the current chunk to std::cout output stream
    */
@@ -101,16 +366,16 @@ public:
   /**
    * @brief Gets the expected size of a chunk as it is defined
    * It is the sum of the sizes of all fields
-   * @return unsigned int
+   * @return uint64_t
    */
-  unsigned int getSize(void) const;
+  uint64_t getSize(void) const;
 
   /**
    * @brief Gets the actual size of the chunk. Useful only after
    * WavData::write() because it is set to 0 when initiliazed
-   * @return unsigned int
+   * @return uint64_t
    */
-  unsigned int getActualSize(void) const;
+  uint64_t getActualSize(void) const;
 
   /**
    * @brief Checks if the current Chunk is undefined. To define a
@@ -119,6 +384,12 @@ public:
    */
   bool isUndefined(void) const;
 
+  /**
+   * @brief Checks if a field was modified since the chunk was read
+   * @return bool
+   */
+  bool isDirty(void) const;
+
   /**
    * @brief If a Chunk has a variable size field, call this function.
    * The variable field is always the last field in the vector so make
@@ -132,18 +403,29 @@ public:
   void resetChunk(void);
 
 protected:
-  bool checkSize(const unsigned int size) const;
+  bool checkSize(const uint64_t size) const;
   bool isVariable(void) const;
   void makeUndefined(void);
-  void addToActualSize(const unsigned int size);
+  void setActualSize(const uint64_t size);
+  void markClean(void);
+  void layout(void);
+  static uint32_t fieldKey(const std::string &name);
+  size_t indexOf(const std::string &fieldName) const;
 
 private:
   // Expected chunk size and actual size with variable fields if they exist
-  unsigned int size_, actualSize_;
+  uint64_t size_, actualSize_;
   std::string name_;
-  std::vector<std::shared_ptr<Field>> fields_;
-  std::map<std::string, std::shared_ptr<Field>> fieldMap_;
+  FourCC key_;
+  // Descriptors in order. Values are slots of the arena, the fixed size
+  // fields first in order and the variable one last, like in the file.
+  std::vector<Field> fields_;
+  std::string arena_;
+  // Hashes of the field names, in the order of the fields
+  std::vector<uint32_t> fieldKeys_;
   bool undefined_, variableSize_;
+  // Keeps the mapping alive while fields of this chunk are views into it
+  std::shared_ptr<const MappedFile> mapping_;
 };
 
 #endif // CHUNK_HPP_
\ No newline at end of file
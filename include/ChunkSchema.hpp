@@ -0,0 +1,194 @@
+#ifndef CHUNKSCHEMA_HPP_
+#define CHUNKSCHEMA_HPP_
+
+#include "Chunk.hpp"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+/**
+ * @brief Field of a chunk schema
+ * @member const char * name to access that field at runtime
+ * @member uint64_t number of bytes, 0 for a variable field (last one only)
+ * @member F_TYPE type of the field for printing purposes
+ */
+struct FieldSchema {
+  const char *name;
+  uint64_t nBytes;
+  F_TYPE type;
+};
+
+/**
+ * @brief Offset of a field in the body of its chunk
+ * @param FieldSchema[] fields of the schema
+ * @param size_t index of the field
+ * @return uint64_t
+ */
+template <size_t N>
+constexpr uint64_t schemaOffset(const FieldSchema (&fields)[N],
+                                const size_t index) {
+  return index == 0 ? 0
+                    : fields[index - 1].nBytes + schemaOffset(fields, index - 1);
+}
+
+/**
+ * @brief Typed field of a schema, to use with Chunk::get() and Chunk::set().
+ * Numerical types must have the size of the field, std::string fits any size.
+ * @tparam Schema schema of the chunk
+ * @tparam size_t index of the field in the schema
+ * @tparam T type of the value
+ */
+template <typename Schema, size_t Index, typename T> struct SchemaField {
+  typedef Schema schema;
+  typedef T type;
+  static constexpr size_t index = Index;
+  static constexpr uint64_t nBytes = Schema::fields[Index].nBytes;
+  static constexpr uint64_t offset = schemaOffset(Schema::fields, Index);
+  static constexpr F_TYPE fieldType = Schema::fields[Index].type;
+  static_assert(FieldCodec<T>::fits(Schema::fields[Index].nBytes),
+                "The type does not have the size of the field");
+};
+
+/**
+ * @brief Builds a chunk from its schema. A schema is a struct with a
+ * constexpr id() and a constexpr FieldSchema fields[] array, which must also
+ * be defined out of the struct (see ChunkSchema.cpp).
+ * @tparam Schema
+ * @return Chunk
+ */
+template <typename Schema> Chunk makeChunk(void) {
+  Chunk ck(Schema::id());
+  for (size_t i = 0; i < sizeof(Schema::fields) / sizeof(FieldSchema); i++) {
+    Chunk::Field f;
+    f.name = Schema::fields[i].name;
+    f.nBytes = Schema::fields[i].nBytes;
+    f.type = Schema::fields[i].type;
+    ck.addField(f);
+  }
+  return ck;
+}
+
+// fmt, only the first fields are read from files that are not extensible
+struct FmtSchema {
+  static constexpr const char *id(void) { return "fmt "; }
+  static constexpr FieldSchema fields[] = {
+      {"FormatTag", 2, F_UINT},     {"Channels", 2, F_UINT},
+      {"SamplesPerSec", 4, F_UINT}, {"AvgBytesPerSec", 4, F_UINT},
+      {"BlockAlign", 2, F_UINT},    {"BitsPerSample", 2, F_UINT},
+      {"Size", 2, F_UINT},          {"ValidBitsPerSample", 2, F_UINT},
+      {"ChannelMask", 4, F_UINT},   {"SubFormat[16]", 16, F_BYTE_ARRAY}};
+
+  typedef SchemaField<FmtSchema, 0, uint16_t> FormatTag;
+  typedef SchemaField<FmtSchema, 1, uint16_t> Channels;
+  typedef SchemaField<FmtSchema, 2, uint32_t> SamplesPerSec;
+  typedef SchemaField<FmtSchema, 3, uint32_t> AvgBytesPerSec;
+  typedef SchemaField<FmtSchema, 4, uint16_t> BlockAlign;
+  typedef SchemaField<FmtSchema, 5, uint16_t> BitsPerSample;
+  typedef SchemaField<FmtSchema, 6, uint16_t> Size;
+  typedef SchemaField<FmtSchema, 7, uint16_t> ValidBitsPerSample;
+  typedef SchemaField<FmtSchema, 8, uint32_t> ChannelMask;
+  typedef SchemaField<FmtSchema, 9, std::string> SubFormat;
+};
+
+// bext (EBU Tech 3285)
+struct BextSchema {
+  static constexpr const char *id(void) { return "bext"; }
+  static constexpr FieldSchema fields[] = {
+      {"Description", 256, F_STRING},
+      {"Originator", 32, F_STRING},
+      {"OriginatorReference", 32, F_STRING},
+      {"OriginationDate", 10, F_STRING},
+      {"OriginationTime", 8, F_STRING},
+      {"TimeReferenceLow", 4, F_UINT},
+      {"TimeReferenceHigh", 4, F_UINT},
+      {"Version", 2, F_INT},
+      {"UMID[64]", 64, F_BYTE_ARRAY},
+      {"LoudnessValue", 2, F_SHORT},
+      {"LoudnessRange", 2, F_SHORT},
+      {"MaxTruePeakLevel", 2, F_SHORT},
+      {"MaxMomentaryLoudness", 2, F_SHORT},
+      {"MaxShortTermLoudness", 2, F_SHORT},
+      {"Reserved", 180, F_NDEF},
+      {"CodingHistory", 0, F_NDEF}};
+
+  typedef SchemaField<BextSchema, 0, std::string> Description;
+  typedef SchemaField<BextSchema, 1, std::string> Originator;
+  typedef SchemaField<BextSchema, 2, std::string> OriginatorReference;
+  typedef SchemaField<BextSchema, 3, std::string> OriginationDate;
+  typedef SchemaField<BextSchema, 4, std::string> OriginationTime;
+  typedef SchemaField<BextSchema, 5, uint32_t> TimeReferenceLow;
+  typedef SchemaField<BextSchema, 6, uint32_t> TimeReferenceHigh;
+  typedef SchemaField<BextSchema, 7, uint16_t> Version;
+  typedef SchemaField<BextSchema, 8, std::string> UMID;
+  // Loudness values are in hundredths of LU, LUFS or dBTP
+  typedef SchemaField<BextSchema, 9, int16_t> LoudnessValue;
+  typedef SchemaField<BextSchema, 10, int16_t> LoudnessRange;
+  typedef SchemaField<BextSchema, 11, int16_t> MaxTruePeakLevel;
+  typedef SchemaField<BextSchema, 12, int16_t> MaxMomentaryLoudness;
+  typedef SchemaField<BextSchema, 13, int16_t> MaxShortTermLoudness;
+  typedef SchemaField<BextSchema, 14, std::string> Reserved;
+  typedef SchemaField<BextSchema, 15, std::string> CodingHistory;
+};
+
+// fact
+struct FactSchema {
+  static constexpr const char *id(void) { return "fact"; }
+  static constexpr FieldSchema fields[] = {{"SampleLength", 4, F_UINT}};
+
+  typedef SchemaField<FactSchema, 0, uint32_t> SampleLength;
+};
+
+// cart (AES46)
+struct CartSchema {
+  static constexpr const char *id(void) { return "cart"; }
+  static constexpr FieldSchema fields[] = {
+      {"Version", 4, F_STRING},
+      {"Title", 64, F_STRING},
+      {"Artist", 64, F_STRING},
+      {"CutID", 64, F_STRING},
+      {"ClientID", 64, F_STRING},
+      {"Category", 64, F_STRING},
+      {"Classification", 64, F_STRING},
+      {"OutCue", 64, F_STRING},
+      {"StartDate", 10, F_STRING},
+      {"StartTime", 8, F_STRING},
+      {"EndDate", 10, F_STRING},
+      {"EndTime", 8, F_STRING},
+      {"ProducerAppID", 64, F_STRING},
+      {"ProducerAppVersion", 64, F_STRING},
+      {"UserDef", 64, F_STRING},
+      {"LevelReference", 4, F_INT},
+      {"PostTimer", 64, F_BYTE_ARRAY}, // 8 timers of 8 bytes
+      {"Reserved", 276, F_STRING},
+      {"URL", 1024, F_STRING},
+      {"TagText", 0, F_STRING}};
+
+  typedef SchemaField<CartSchema, 0, std::string> Version;
+  typedef SchemaField<CartSchema, 1, std::string> Title;
+  typedef SchemaField<CartSchema, 2, std::string> Artist;
+  typedef SchemaField<CartSchema, 3, std::string> CutID;
+  typedef SchemaField<CartSchema, 4, std::string> ClientID;
+  typedef SchemaField<CartSchema, 5, std::string> Category;
+  typedef SchemaField<CartSchema, 6, std::string> Classification;
+  typedef SchemaField<CartSchema, 7, std::string> OutCue;
+  typedef SchemaField<CartSchema, 8, std::string> StartDate;
+  typedef SchemaField<CartSchema, 9, std::string> StartTime;
+  typedef SchemaField<CartSchema, 10, std::string> EndDate;
+  typedef SchemaField<CartSchema, 11, std::string> EndTime;
+  typedef SchemaField<CartSchema, 12, std::string> ProducerAppID;
+  typedef SchemaField<CartSchema, 13, std::string> ProducerAppVersion;
+  typedef SchemaField<CartSchema, 14, std::string> UserDef;
+  typedef SchemaField<CartSchema, 15, int32_t> LevelReference;
+  typedef SchemaField<CartSchema, 16, std::string> PostTimer;
+  typedef SchemaField<CartSchema, 17, std::string> Reserved;
+  typedef SchemaField<CartSchema, 18, std::string> URL;
+  typedef SchemaField<CartSchema, 19, std::string> TagText;
+};
+
+// data, a single variable field
+struct DataSchema {
+  static constexpr const char *id(void) { return "data"; }
+  static constexpr FieldSchema fields[] = {{"data", 0, F_NDEF}};
+};
+
+#endif // CHUNKSCHEMA_HPP_
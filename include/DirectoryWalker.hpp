@@ -0,0 +1,78 @@
+#ifndef DIRECTORYWALKER_HPP_
+#define DIRECTORYWALKER_HPP_
+
+#include "ThreadPool.hpp"
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <set>
+#include <string>
+#include <sys/types.h>
+#include <utility>
+
+/**
+ * @brief Walks directory trees on a thread pool, each subdirectory by
+ * whichever worker is free. Symbolic links are followed, but every directory
+ * is walked once, so a link back to an ancestor does not loop.
+ */
+class DirectoryWalker {
+public:
+  /**
+   * @brief Called by a worker for each regular file
+   * @param std::string path
+   * @param std::string name in its directory
+   */
+  typedef std::function<void(const std::string &, const std::string &)>
+      FileCallback;
+
+  /**
+   * @brief Called by a worker for each directory that cannot be opened
+   * @param std::string path
+   */
+  typedef std::function<void(const std::string &)> ErrorCallback;
+
+  /**
+   * @brief Constructor
+   * @param ThreadPool that runs the walks
+   * @param DirectoryWalker::FileCallback
+   * @param DirectoryWalker::ErrorCallback nothing is called if empty
+   */
+  DirectoryWalker(ThreadPool &pool, const FileCallback &onFile,
+                  const ErrorCallback &onError = ErrorCallback());
+
+  /**
+   * @brief Queues the walk of a directory tree. Walks are done when the
+   * pool's wait() returns.
+   * @param std::string directory
+   */
+  void walk(const std::string &dir);
+
+  /**
+   * @brief Rethrows the first exception thrown while walking, by a callback
+   * or by an allocation, since the last reset(). Other directories are still
+   * walked after one throws.
+   */
+  void rethrow(void);
+
+  /**
+   * @brief Forgets the directories walked and the exception, so that they
+   * are walked again
+   */
+  void reset(void);
+
+private:
+  DirectoryWalker(const DirectoryWalker &);
+  DirectoryWalker &operator=(const DirectoryWalker &);
+
+  void walkDir(const std::string &dir);
+
+  ThreadPool &pool_;
+  FileCallback onFile_;
+  ErrorCallback onError_;
+  // Guards the devices and inodes of the directories walked and the error
+  std::mutex m_;
+  std::set<std::pair<dev_t, ino_t>> visited_;
+  std::exception_ptr error_;
+};
+
+#endif // DIRECTORYWALKER_HPP_
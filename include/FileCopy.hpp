@@ -0,0 +1,63 @@
+#ifndef FILECOPY_HPP_
+#define FILECOPY_HPP_
+
+#include <cstdint>
+#include <memory>
+#include <string>
+
+#define BUFFERED_IO false
+#define DIRECT_IO true
+
+// Alignment of the offsets, sizes and buffers of O_DIRECT transfers: the
+// page size, a multiple of the logical block size of common devices
+#define DIRECT_ALIGNMENT 4096
+
+/**
+ * @brief Copies nBytes bytes of a file into another one without going
+ * through user space where the system allows it: copy_file_range (which
+ * shares extents on filesystems with reflinks), then sendfile, then
+ * pread/pwrite as a last resort. The destination must exist.
+ * @param std::string source file
+ * @param uint64_t offset in the source
+ * @param std::string destination file
+ * @param uint64_t offset in the destination
+ * @param uint64_t number of bytes
+ */
+void copyFileRange(const std::string &src, const uint64_t srcOffset,
+                   const std::string &dst, const uint64_t dstOffset,
+                   const uint64_t nBytes);
+
+/**
+ * @brief Checks if two paths name the same file
+ * @param std::string
+ * @param std::string
+ * @return bool false if either one does not exist
+ */
+bool isSameFile(const std::string &a, const std::string &b);
+
+/**
+ * @brief Get the size of a file
+ * @param std::string
+ * @return uint64_t 0 if it does not exist
+ */
+uint64_t fileSize(const std::string &fn);
+
+/**
+ * @brief Opens a file with O_DIRECT, so that its reads and writes bypass the
+ * page cache. Offsets, sizes and buffers must then be multiples of
+ * DIRECT_ALIGNMENT.
+ * @param std::string filename
+ * @param int open flags, such as O_RDONLY
+ * @return int file descriptor, -1 if the file cannot be opened that way (the
+ * filesystem may not support it)
+ */
+int openDirect(const std::string &fn, const int flags);
+
+/**
+ * @brief Allocates a buffer for O_DIRECT transfers
+ * @param size_t size in bytes
+ * @return std::unique_ptr<char, void (*)(void *)> aligned to DIRECT_ALIGNMENT
+ */
+std::unique_ptr<char, void (*)(void *)> allocDirect(const size_t size);
+
+#endif // FILECOPY_HPP_
@@ -0,0 +1,199 @@
+#ifndef FOURCC_HPP_
+#define FOURCC_HPP_
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Chunk ID packed in an integer, first character in the high byte so
+ * that integers sort like the IDs
+ */
+typedef uint32_t FourCC;
+
+/**
+ * @brief Packs the first 4 characters of an ID
+ * @param const char * ID of at least 4 characters
+ * @return FourCC
+ */
+constexpr FourCC toFourCC(const char *id) {
+  return (FourCC)(unsigned char)id[0] << 24 |
+         (FourCC)(unsigned char)id[1] << 16 |
+         (FourCC)(unsigned char)id[2] << 8 | (FourCC)(unsigned char)id[3];
+}
+
+/**
+ * @brief Unpacks an ID
+ * @param FourCC
+ * @return std::string
+ */
+inline std::string fourCCString(const FourCC key) {
+  char id[4] = {(char)(key >> 24), (char)(key >> 16), (char)(key >> 8),
+                (char)key};
+  return std::string(id, 4);
+}
+
+/**
+ * @brief Small hash table keyed by FourCC with open addressing (linear
+ * probing) in one flat array. Erased slots are reused and clear() keeps the
+ * array, so a table that is filled file after file stops allocating.
+ * @tparam V value type, default constructible
+ */
+template <typename V> class FlatTable {
+public:
+  struct Slot {
+    FourCC key;
+    V value;
+  };
+
+  FlatTable(void) : size_(0), used_(0) {}
+
+  /**
+   * @brief Get a pointer to the value of a key
+   * @param FourCC
+   * @return V * null if the key is not in the table
+   */
+  V *find(const FourCC key) {
+    if (slots_.empty())
+      return nullptr;
+    size_t i = probe(key);
+    return states_[i] == FULL ? &slots_[i].value : nullptr;
+  }
+
+  const V *find(const FourCC key) const {
+    return const_cast<FlatTable *>(this)->find(key);
+  }
+
+  /**
+   * @brief Get the value of a key, it is inserted if it is not in the table
+   * @param FourCC
+   * @return V &
+   */
+  V &operator[](const FourCC key) {
+    if ((used_ + 1) * 2 > slots_.size())
+      rehash();
+    size_t i = probe(key);
+    if (states_[i] != FULL) {
+      if (states_[i] == EMPTY)
+        used_++;
+      states_[i] = FULL;
+      slots_[i].key = key;
+      size_++;
+    }
+    return slots_[i].value;
+  }
+
+  /**
+   * @brief Removes a key
+   * @param FourCC
+   * @return bool false if the key was not in the table
+   */
+  bool erase(const FourCC key) {
+    if (slots_.empty())
+      return false;
+    size_t i = probe(key);
+    if (states_[i] != FULL)
+      return false;
+    states_[i] = ERASED;
+    slots_[i].value = V();
+    size_--;
+    return true;
+  }
+
+  /**
+   * @brief Removes every key for which pred(key, value) is true
+   * @param Predicate
+   */
+  template <typename Predicate> void eraseIf(Predicate pred) {
+    for (size_t i = 0; i < slots_.size(); i++) {
+      if (states_[i] == FULL && pred(slots_[i].key, slots_[i].value)) {
+        states_[i] = ERASED;
+        slots_[i].value = V();
+        size_--;
+      }
+    }
+  }
+
+  /**
+   * @brief Removes every key, the array is kept
+   */
+  void clear(void) {
+    for (size_t i = 0; i < slots_.size(); i++) {
+      if (states_[i] == FULL)
+        slots_[i].value = V();
+      states_[i] = EMPTY;
+    }
+    size_ = used_ = 0;
+  }
+
+  /**
+   * @brief Calls f(key, value) for every key, in no particular order
+   * @param Function
+   */
+  template <typename Function> void forEach(Function f) {
+    for (size_t i = 0; i < slots_.size(); i++) {
+      if (states_[i] == FULL)
+        f(slots_[i].key, slots_[i].value);
+    }
+  }
+
+  size_t size(void) const { return size_; }
+
+  /**
+   * @brief Get the keys in ascending order, which is the order of the IDs
+   * @return std::vector<FourCC>
+   */
+  std::vector<FourCC> keys(void) const {
+    std::vector<FourCC> k;
+    k.reserve(size_);
+    for (size_t i = 0; i < slots_.size(); i++) {
+      if (states_[i] == FULL)
+        k.push_back(slots_[i].key);
+    }
+    std::sort(k.begin(), k.end());
+    return k;
+  }
+
+private:
+  enum State : unsigned char { EMPTY, FULL, ERASED };
+
+  // Index of the key, or of the slot where it would be inserted
+  size_t probe(const FourCC key) const {
+    size_t mask = slots_.size() - 1;
+    size_t i = (key * 0x9e3779b1u) & mask;
+    size_t reuse = slots_.size();
+    while (states_[i] != EMPTY) {
+      if (states_[i] == FULL && slots_[i].key == key)
+        return i;
+      if (states_[i] == ERASED && reuse == slots_.size())
+        reuse = i;
+      i = (i + 1) & mask;
+    }
+    return reuse != slots_.size() ? reuse : i;
+  }
+
+  // Grows the array when it is half used, erased slots are dropped
+  void rehash(void) {
+    size_t capacity = 16;
+    while (capacity < (size_ + 1) * 4)
+      capacity *= 2;
+    std::vector<Slot> slots(capacity);
+    std::vector<unsigned char> states(capacity, EMPTY);
+    slots.swap(slots_);
+    states.swap(states_);
+    size_ = used_ = 0;
+    for (size_t i = 0; i < slots.size(); i++) {
+      if (states[i] == FULL)
+        (*this)[slots[i].key] = std::move(slots[i].value);
+    }
+  }
+
+  std::vector<Slot> slots_;
+  std::vector<unsigned char> states_;
+  // Keys in the table, and keys plus erased slots
+  size_t size_, used_;
+};
+
+#endif // FOURCC_HPP_
@@ -0,0 +1,113 @@
+#ifndef FRAMEREADER_HPP_
+#define FRAMEREADER_HPP_
+
+#include "FileCopy.hpp"
+#include "SampleConverter.hpp"
+#include "WavData.hpp"
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+
+/**
+ * @brief Random access to the frames of the data chunk of a file. Only the
+ * chunk headers and fmt are read when it is opened, then every read is a
+ * positioned read of the requested frames, so the reader can be shared by
+ * threads without locks.
+ */
+class FrameReader {
+public:
+  /**
+   * @brief Opens a file and locates its data chunk. With DIRECT_IO, frames
+   * are read with O_DIRECT, bypassing the page cache: reads of whole aligned
+   * blocks into aligned buffers (@ref allocDirect) go straight to the
+   * destination, which needs a data chunk aligned like the streaming layout
+   * (@ref WavData::setLayout). Other reads go through an aligned buffer.
+   * Filesystems without O_DIRECT are read normally.
+   * @param std::string filename
+   * @param bool BUFFERED_IO or DIRECT_IO
+   */
+  FrameReader(const std::string &fn, const bool direct = BUFFERED_IO);
+
+  /**
+   * @brief Opens a file that was already read, so that it is not parsed
+   * again. READ_LAZY is enough, only the directory and fmt are used.
+   * @param std::string filename
+   * @param WavData the file read
+   * @param bool BUFFERED_IO or DIRECT_IO
+   */
+  FrameReader(const std::string &fn, WavData &wav,
+              const bool direct = BUFFERED_IO);
+
+  /**
+   * @brief Destructor. Closes the file.
+   */
+  ~FrameReader(void);
+
+  /**
+   * @brief Reads frames as they are stored. Frames past the end of the data
+   * chunk are not read.
+   * @param uint64_t first frame
+   * @param size_t number of frames
+   * @param char * destination of nFrames * getBlockAlign() bytes
+   * @return size_t number of frames read
+   */
+  size_t readRaw(const uint64_t frame, const size_t nFrames, char *dst) const;
+
+  /**
+   * @brief Reads frames decoded to float (@ref SampleConverter), interleaved
+   * @param uint64_t first frame
+   * @param size_t number of frames
+   * @param float * destination of nFrames * getSamplesPerFrame() samples
+   * @return size_t number of frames read
+   */
+  size_t read(const uint64_t frame, const size_t nFrames, float *dst) const;
+
+  /**
+   * @brief Reads frames decoded to full scale int32 (@ref SampleConverter)
+   * @param uint64_t first frame
+   * @param size_t number of frames
+   * @param int32_t * destination of nFrames * getSamplesPerFrame() samples
+   * @return size_t number of frames read
+   */
+  size_t read(const uint64_t frame, const size_t nFrames, int32_t *dst) const;
+
+  /**
+   * @brief Get the frame at a time, rounded down
+   * @param double seconds from the start
+   * @return uint64_t
+   */
+  uint64_t frameAt(const double seconds) const;
+
+  uint64_t getFrameCount(void) const;
+  unsigned int getSampleRate(void) const;
+  unsigned int getBlockAlign(void) const;
+  unsigned int getSamplesPerFrame(void) const;
+  // S_NDEF if the samples cannot be decoded
+  SampleType getSampleType(void) const;
+  uint64_t getDataOffset(void) const;
+  bool isDirect(void) const;
+
+private:
+  FrameReader(const FrameReader &);
+  FrameReader &operator=(const FrameReader &);
+
+  void open(const std::string &fn, WavData &wav, const bool direct);
+  template <typename T>
+  size_t decode(const uint64_t frame, const size_t nFrames, T *dst) const;
+  void readDirect(uint64_t offset, size_t nBytes, char *dst) const;
+
+  int fd_;
+  bool direct_;
+  // Offset of the first frame in the file
+  uint64_t offset_;
+  uint64_t frameCount_;
+  unsigned int sampleRate_, blockAlign_, samplesPerFrame_;
+  // Null if the samples cannot be decoded, raw reads still work
+  std::unique_ptr<SampleConverter> converter_;
+  // Aligned buffer of the O_DIRECT reads that are not read in place
+  mutable std::mutex bounceMutex_;
+  mutable std::unique_ptr<char, void (*)(void *)> bounce_;
+};
+
+#endif // FRAMEREADER_HPP_
@@ -0,0 +1,135 @@
+#ifndef LOUDNESSMETER_HPP_
+#define LOUDNESSMETER_HPP_
+
+#include "FrameReader.hpp"
+#include "SampleKernels.hpp"
+#include "ThreadPool.hpp"
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <vector>
+
+/**
+ * @brief Loudness of a programme (EBU R128, ITU-R BS.1770). Values that
+ * cannot be measured, such as the integrated loudness of silence, are -inf.
+ * @member double integrated loudness in LUFS
+ * @member double loudness range in LU (EBU Tech 3342)
+ * @member double maximum momentary loudness (400 ms) in LUFS
+ * @member double maximum short-term loudness (3 s) in LUFS
+ * @member double true peak in dBTP
+ */
+struct Loudness {
+  double integrated;
+  double range;
+  double maxMomentary;
+  double maxShortTerm;
+  double truePeak;
+};
+
+/**
+ * @brief Streaming loudness and true-peak meter. Samples are K-weighted and
+ * summed in 100 ms blocks, the gated measurements are kept in histograms of
+ * 0.01 LU bins, so memory does not grow with the length of the programme.
+ * Channels are filtered independently, by several threads if asked to.
+ */
+class LoudnessMeter {
+public:
+  /**
+   * @brief Meter of a stream. With 6 channels, the 5.1 layout of WAVE files
+   * is assumed (L R C LFE Ls Rs): LFE is ignored and the surround channels
+   * are weighted by 1.41, other channels have a weight of 1.
+   * @param unsigned int sample rate
+   * @param unsigned int channels
+   * @param unsigned int threads that filter the channels, 0 for one per
+   * hardware thread
+   */
+  LoudnessMeter(const unsigned int sampleRate, const unsigned int channels,
+                const unsigned int nThreads = 1);
+
+  ~LoudnessMeter(void);
+
+  /**
+   * @brief Set the weight of a channel in the sum of the channels
+   * @param unsigned int channel
+   * @param double weight, 0 to ignore it
+   */
+  void setChannelWeight(const unsigned int channel, const double weight);
+
+  /**
+   * @brief Adds interleaved float frames to the measurement
+   * @param const float * nFrames * channels samples
+   * @param size_t number of frames
+   */
+  void process(const float *frames, const size_t nFrames);
+
+  /**
+   * @brief Get the loudness of the frames added so far. A last block
+   * shorter than 100 ms is not counted.
+   * @return Loudness
+   */
+  Loudness getLoudness(void) const;
+
+  /**
+   * @brief Measures the data chunk of a file in one pass, block by block
+   * @param FrameReader reader of a file with decodable samples
+   * @param unsigned int threads, 0 for one per hardware thread
+   * @return Loudness
+   */
+  static Loudness measure(const FrameReader &reader,
+                          const unsigned int nThreads = 1);
+
+  /**
+   * @brief Sets the loudness fields of the bext chunk, in hundredths, and
+   * its Version to 2 if it is older. Values that cannot be measured or do
+   * not fit are written as 0x7fff (not available).
+   * @param Loudness
+   * @param WavData
+   */
+  static void writeBext(const Loudness &loudness, WavData &wav);
+
+private:
+  LoudnessMeter(const LoudnessMeter &);
+  LoudnessMeter &operator=(const LoudnessMeter &);
+
+  // Filter states, true-peak history and peak of a channel
+  struct Channel {
+    double pre[2], rlb[2];
+    std::vector<float> buffer;
+    float peak;
+  };
+
+  // Count and sum of the energies of the measurements of each bin
+  struct Histogram {
+    std::vector<uint64_t> count;
+    std::vector<double> energy;
+  };
+
+  void filter(const unsigned int c, const float *frames, const size_t nFrames,
+              const std::vector<size_t> &ends, double *energy);
+  void endBlock(void);
+  static void add(Histogram &h, const double energy);
+  static double gatedMean(const Histogram &h, const double relativeGate,
+                          uint64_t &count, size_t &first);
+
+  unsigned int sampleRate_, channels_;
+  std::vector<double> weights_;
+  std::vector<Channel> channelState_;
+  std::unique_ptr<ThreadPool> pool_;
+
+  // K-weighting biquads, b0 b1 b2 a1 a2
+  double pre_[5], rlb_[5];
+  // Polyphase true-peak filter, taps of each phase
+  unsigned int oversampling_, nTaps_;
+  std::vector<float> taps_;
+  FirPeakKernel firPeak_;
+
+  // Frames of a 100 ms block, frames and weighted energy of the current one
+  size_t blockFrames_, blockFill_;
+  double blockEnergy_;
+  // Mean squares of the last 30 blocks, the short-term window
+  std::deque<double> blocks_;
+  Histogram momentary_, shortTerm_;
+  double maxMomentary_, maxShortTerm_;
+};
+
+#endif // LOUDNESSMETER_HPP_
@@ -0,0 +1,49 @@
+#ifndef MAPPEDFILE_HPP_
+#define MAPPEDFILE_HPP_
+
+#include <cstddef>
+#include <string>
+
+class MappedFile {
+public:
+  /**
+   * @brief Maps a whole file read-only into memory
+   * @param std::string filename
+   */
+  MappedFile(const std::string &fn);
+
+  /**
+   * @brief Wraps a buffer of the caller, which is neither copied nor unmapped
+   * and must outlive every view into it
+   * @param const char * first byte
+   * @param size_t number of bytes
+   */
+  MappedFile(const char *data, const size_t size);
+
+  /**
+   * @brief Destructor. Unmaps the file so every view into it is invalid.
+   */
+  ~MappedFile(void);
+
+  /**
+   * @brief Get a pointer to the first byte of the mapping
+   * @return const char *
+   */
+  const char *data(void) const;
+
+  /**
+   * @brief Get the size of the mapped file in bytes
+   * @return size_t
+   */
+  size_t size(void) const;
+
+private:
+  MappedFile(const MappedFile &);
+  MappedFile &operator=(const MappedFile &);
+
+  void *addr_;
+  size_t size_;
+  bool owned_;
+};
+
+#endif // MAPPEDFILE_HPP_
@@ -0,0 +1,212 @@
+#ifndef METADATAINDEX_HPP_
+#define METADATAINDEX_HPP_
+
+#include "BatchScanner.hpp"
+#include "DirectoryWalker.hpp"
+#include "MappedFile.hpp"
+#include "ThreadPool.hpp"
+#include "WavData.hpp"
+#include <cstdint>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * @brief Identity of a file when it was indexed, a file whose identity
+ * changed is parsed again
+ * @member uint64_t device
+ * @member uint64_t inode
+ * @member uint64_t size in bytes
+ * @member int64_t modification time in nanoseconds since the epoch
+ */
+struct FileIdentity {
+  uint64_t device;
+  uint64_t inode;
+  uint64_t size;
+  int64_t mtime;
+};
+
+/**
+ * @brief Entry of a MetadataIndex, copied out of the index
+ * @member std::string path of the file
+ * @member FileIdentity
+ * @member std::vector<WavData::ChunkEntry> chunk directory (nothing loaded)
+ * @member std::vector<std::string> values of the fields, formatted like
+ * @ref BatchScanner::formatField
+ * @member std::vector<bool> whether the file has each field
+ * @member std::string error if the file could not be parsed
+ */
+struct IndexEntry {
+  std::string path;
+  FileIdentity identity;
+  std::vector<WavData::ChunkEntry> directory;
+  std::vector<std::string> values;
+  std::vector<bool> found;
+  std::string error;
+};
+
+/**
+ * @brief Persistent index of the chunk directories and some fields of a
+ * library of files. The index file is mapped and read in place, so opening
+ * it parses nothing and lookups never touch the indexed files. Entries are
+ * sorted by path: a file is found by binary search and the files of a
+ * directory are a contiguous range. An update only parses the files whose
+ * identity (device, inode, size and modification time) changed.
+ *
+ * The index file is in native byte order. An index of other fields, of
+ * another version or from another architecture is rebuilt by the next update.
+ */
+class MetadataIndex {
+public:
+  /**
+   * @brief Empty index. Fields are given as "chunk.field", like @ref
+   * BatchScanner.
+   * @param std::vector<std::string> fields to index
+   * @param unsigned int number of threads that parse files, 0 for one per
+   * hardware thread
+   */
+  MetadataIndex(const std::vector<std::string> &fields,
+                unsigned int nThreads = 0);
+
+  /**
+   * @brief Destructor
+   */
+  ~MetadataIndex(void);
+
+  /**
+   * @brief Maps an index file. It replaces the entries of this object,
+   * unless it does not exist or holds other fields.
+   * @param std::string filename
+   * @return bool whether the file was mapped
+   */
+  bool load(const std::string &fn);
+
+  /**
+   * @brief Brings the index up to date with files and directory trees, every
+   * .wav file of which is indexed. Unchanged files keep their entry, the
+   * others are parsed in parallel (only the chunk headers and the chunks of
+   * the fields are read), and files that are gone are dropped. If walking or
+   * parsing runs out of memory, the index is left as it was and the exception
+   * is rethrown.
+   * @param std::vector<std::string> files and directories of the library
+   * @return size_t number of files parsed
+   */
+  size_t update(const std::vector<std::string> &paths);
+
+  /**
+   * @brief Writes the index to a unique temporary file, synced to disk, then
+   * renamed over the previous one, so mappings of the previous one stay valid
+   * and a crash leaves either index whole
+   * @param std::string filename
+   */
+  void save(const std::string &fn) const;
+
+  /**
+   * @brief Get the number of entries
+   * @return size_t
+   */
+  size_t size(void) const;
+
+  /**
+   * @brief Get an entry
+   * @param size_t position in path order
+   * @return IndexEntry
+   */
+  IndexEntry getEntry(const size_t i) const;
+
+  /**
+   * @brief Finds the entry of a path
+   * @param std::string path as it was indexed
+   * @param IndexEntry
+   * @return bool false if the path is not indexed
+   */
+  bool find(const std::string &path, IndexEntry &entry) const;
+
+  /**
+   * @brief Finds the entries whose path starts with a prefix, such as the
+   * files of a directory tree
+   * @param std::string
+   * @return std::pair<size_t, size_t> positions of the first entry and past
+   * the last one
+   */
+  std::pair<size_t, size_t> findPrefix(const std::string &prefix) const;
+
+  /**
+   * @brief Get the value of a field of an entry without copying the others
+   * @param size_t position of the entry
+   * @param std::string field, as given to the constructor
+   * @param std::string value
+   * @return bool false if the file does not have the field
+   */
+  bool getField(const size_t i, const std::string &field,
+                std::string &value) const;
+
+  /**
+   * @brief Finds the entries whose path starts with a prefix and whose field
+   * has a value
+   * @param std::string field, as given to the constructor
+   * @param std::string value
+   * @param std::string path prefix
+   * @return std::vector<size_t> positions, in path order
+   */
+  std::vector<size_t> filter(const std::string &field,
+                             const std::string &value,
+                             const std::string &prefix = "") const;
+
+  /**
+   * @brief Gets the identity of a file
+   * @param std::string filename
+   * @param FileIdentity
+   * @return bool false if the file cannot be stat'ed
+   */
+  static bool identify(const std::string &fn, FileIdentity &identity);
+
+private:
+  MetadataIndex(const MetadataIndex &);
+  MetadataIndex &operator=(const MetadataIndex &);
+
+  struct Header;
+  struct StrRef;
+  struct Record;
+  struct ChunkRecord;
+  struct Parsed;
+  class Builder;
+
+  void attach(const char *data, const size_t size);
+  void addFile(const std::string &path, const std::string &name);
+  void parse(Parsed &parsed, const unsigned int worker);
+  size_t lowerBound(const std::string &path) const;
+  size_t fieldIndex(const std::string &field) const;
+  const char *bytes(const StrRef &ref) const;
+  std::string str(const StrRef &ref) const;
+  int compare(const StrRef &ref, const std::string &s,
+              const size_t n = SIZE_MAX) const;
+  const StrRef *values(const size_t i) const;
+
+  std::vector<BatchScanner::FieldSpec> fields_;
+  ThreadPool pool_;
+  // Parsers given to BatchScanner::extractFields, indexed by worker
+  std::vector<std::unique_ptr<WavData>> parsers_;
+  DirectoryWalker walker_;
+  // Files found by the walk of an update, and the first exception of a
+  // parsing task
+  std::mutex walkMutex_;
+  std::vector<std::pair<std::string, FileIdentity>> found_;
+  std::exception_ptr error_;
+
+  // The index is either a mapped file or an image built by an update
+  std::unique_ptr<MappedFile> file_;
+  std::string image_;
+  const char *data_;
+  size_t size_;
+  const Record *records_;
+  const StrRef *values_;
+  const ChunkRecord *chunks_;
+  const char *strings_;
+  uint64_t nEntries_, nChunks_, stringsSize_;
+};
+
+#endif // METADATAINDEX_HPP_
@@ -0,0 +1,139 @@
+#ifndef PEAKPYRAMID_HPP_
+#define PEAKPYRAMID_HPP_
+
+#include "ChunkSchema.hpp"
+#include "FrameReader.hpp"
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <vector>
+
+// Frames per bin of the finest level
+#define PEAK_BIN_FRAMES 256
+// Levels built by default, 256 to 65536 frames per bin
+#define PEAK_LEVELS 9
+#define PEAK_MAX_LEVELS 32
+
+/**
+ * @brief Minimum, maximum and RMS of the float samples of one channel over a
+ * range of frames
+ */
+struct Peak {
+  float min, max, rms;
+};
+
+// Overview chunk written by PeakPyramid. The peaks are little endian floats,
+// level after level, bin after bin, channel after channel.
+struct PeakSchema {
+  static constexpr const char *id(void) { return "ovrw"; }
+  static constexpr FieldSchema fields[] = {
+      {"Version", 2, F_INT},   {"Channels", 2, F_INT},
+      {"BinFrames", 4, F_INT}, {"Levels", 4, F_INT},
+      {"FrameCountLow", 4, F_INT}, {"FrameCountHigh", 4, F_INT},
+      {"Peaks", 0, F_NDEF}};
+
+  typedef SchemaField<PeakSchema, 0, uint16_t> Version;
+  typedef SchemaField<PeakSchema, 1, uint16_t> Channels;
+  typedef SchemaField<PeakSchema, 2, uint32_t> BinFrames;
+  typedef SchemaField<PeakSchema, 3, uint32_t> Levels;
+  typedef SchemaField<PeakSchema, 4, uint32_t> FrameCountLow;
+  typedef SchemaField<PeakSchema, 5, uint32_t> FrameCountHigh;
+  typedef SchemaField<PeakSchema, 6, std::string> Peaks;
+};
+
+/**
+ * @brief Min/max/RMS overview of the data chunk at several zoom levels. Level
+ * 0 has one bin per getBinFrames(0) frames and each level merges pairs of
+ * bins of the level below. It is built in one pass over the samples, stored
+ * in an ovrw chunk or in a sidecar file that is mapped when it is loaded, and
+ * copies share the peaks.
+ */
+class PeakPyramid {
+public:
+  /**
+   * @brief Empty pyramid, without levels
+   */
+  PeakPyramid(void);
+
+  /**
+   * @brief Decodes the data chunk once, block by block, and builds every
+   * level
+   * @param FrameReader reader of a file with decodable samples
+   * @param unsigned int frames per bin of level 0
+   * @param unsigned int number of levels
+   * @return PeakPyramid
+   */
+  static PeakPyramid build(const FrameReader &reader,
+                           const unsigned int binFrames = PEAK_BIN_FRAMES,
+                           const unsigned int levels = PEAK_LEVELS);
+
+  /**
+   * @brief Reads a pyramid from an ovrw chunk, which may be undefined (read
+   * without its schema). The peaks are copied.
+   * @param Chunk
+   * @return PeakPyramid
+   */
+  static PeakPyramid fromChunk(const Chunk &ck);
+
+  /**
+   * @brief Builds an ovrw chunk to add to a WavData
+   * @return Chunk
+   */
+  Chunk toChunk(void) const;
+
+  /**
+   * @brief Maps a sidecar file written by save(). The peaks are not copied.
+   * @param std::string filename
+   * @return PeakPyramid
+   */
+  static PeakPyramid load(const std::string &fn);
+
+  /**
+   * @brief Writes a sidecar file, the body of the ovrw chunk after a magic
+   * number
+   * @param std::string filename
+   */
+  void save(const std::string &fn) const;
+
+  /**
+   * @brief Gets the peaks of nBins bins that split a range of frames, from
+   * the coarsest level whose bins are not wider than the requested ones. Bins
+   * are widened to whole bins of that level, so each one merges 1 to 3 of
+   * them, unless it is wider than two bins of the last level: it then merges
+   * about nFrames / nBins / getBinFrames(getLevelCount() - 1) of them.
+   * @param uint64_t first frame
+   * @param uint64_t number of frames, clamped to the end of the data
+   * @param size_t number of bins, at most one per frame
+   * @param Peak * destination of nBins * getChannels() peaks
+   * @return size_t number of bins written
+   */
+  size_t query(const uint64_t frame, uint64_t nFrames, size_t nBins,
+               Peak *dst) const;
+
+  /**
+   * @brief Get the bins of a level
+   * @param unsigned int level
+   * @return const Peak * getBinCount(level) * getChannels() peaks
+   */
+  const Peak *getLevel(const unsigned int level) const;
+
+  uint64_t getBinCount(const unsigned int level) const;
+  uint64_t getBinFrames(const unsigned int level) const;
+  unsigned int getLevelCount(void) const;
+  unsigned int getChannels(void) const;
+  uint64_t getFrameCount(void) const;
+
+private:
+  static PeakPyramid parse(const char *body, const size_t size);
+  bool layout(const uint64_t maxPeaks);
+
+  // Vector or mapping that holds the peaks
+  std::shared_ptr<const void> storage_;
+  const Peak *peaks_;
+  // First peak of each level, then the number of peaks
+  std::vector<uint64_t> offsets_;
+  unsigned int channels_, binFrames_, levels_;
+  uint64_t frameCount_;
+};
+
+#endif // PEAKPYRAMID_HPP_
@@ -0,0 +1,84 @@
+#ifndef SAMPLECONVERTER_HPP_
+#define SAMPLECONVERTER_HPP_
+
+#include "SampleKernels.hpp"
+#include "WavData.hpp"
+
+class SampleConverter {
+public:
+  /**
+   * @brief Converter of one sample type. The kernels are chosen once for the
+   * instruction set (@ref detectSimdLevel).
+   * @param SampleType
+   * @param SimdLevel
+   */
+  SampleConverter(const SampleType type,
+                  const SimdLevel level = detectSimdLevel());
+
+  /**
+   * @brief Converter of the samples described by the fmt chunk of a WavData
+   * object. An error is raised if they cannot be converted.
+   * @param WavData
+   * @param SimdLevel
+   */
+  SampleConverter(WavData &wav, const SimdLevel level = detectSimdLevel());
+
+  /**
+   * @brief Decodes samples to float in [-1, 1)
+   * @param const char * encoded samples
+   * @param float * nSamples floats
+   * @param size_t number of samples (not frames)
+   */
+  void decode(const char *src, float *dst, const size_t nSamples) const;
+
+  /**
+   * @brief Decodes samples to full scale int32_t
+   * @param const char * encoded samples
+   * @param int32_t * nSamples ints
+   * @param size_t number of samples (not frames)
+   */
+  void decode(const char *src, int32_t *dst, const size_t nSamples) const;
+
+  /**
+   * @brief Encodes float samples, rounding and saturating them. NaN is
+   * encoded as silence.
+   * @param const float * nSamples floats
+   * @param char * nSamples * getSampleSize() bytes
+   * @param size_t number of samples (not frames)
+   */
+  void encode(const float *src, char *dst, const size_t nSamples) const;
+
+  /**
+   * @brief Encodes full scale int32_t samples, dropping their low bits
+   * @param const int32_t * nSamples ints
+   * @param char * nSamples * getSampleSize() bytes
+   * @param size_t number of samples (not frames)
+   */
+  void encode(const int32_t *src, char *dst, const size_t nSamples) const;
+
+  /**
+   * @brief Get the sample type of the converter
+   * @return SampleType
+   */
+  SampleType getSampleType(void) const;
+
+  /**
+   * @brief Get the size in bytes of one encoded sample
+   * @return unsigned int
+   */
+  unsigned int getSampleSize(void) const;
+
+  /**
+   * @brief Get the sample type from the FormatTag (or the SubFormat of
+   * WAVE_FORMAT_EXTENSIBLE) and BitsPerSample of the fmt chunk
+   * @param WavData
+   * @return SampleType S_NDEF if it is not supported
+   */
+  static SampleType getSampleType(WavData &wav);
+
+private:
+  SampleType type_;
+  SampleKernels kernels_;
+};
+
+#endif // SAMPLECONVERTER_HPP_
@@ -0,0 +1,169 @@
+#ifndef SAMPLEKERNELS_HPP_
+#define SAMPLEKERNELS_HPP_
+
+#include <cstddef>
+#include <cstdint>
+
+// Sample encodings of the data chunk
+enum SampleType {
+  S_PCM_U8,   // 8-bit PCM is unsigned
+  S_PCM_16,
+  S_PCM_24,
+  S_PCM_32,
+  S_FLOAT_32, // IEEE float
+  S_FLOAT_64,
+  S_ALAW,     // G.711, 8-bit companded 16-bit samples
+  S_MULAW,
+  S_NDEF
+};
+
+// Instruction sets the kernels can use, selected at runtime
+enum SimdLevel { SIMD_SCALAR, SIMD_SSE41, SIMD_AVX2 };
+
+/**
+ * @brief Float samples are in [-1, 1). Int samples are full scale 32-bit
+ * (left aligned), so 16-bit PCM is shifted by 16 bits. Conversions to smaller
+ * types are rounded to the nearest value and saturated. A-law and mu-law
+ * samples are converted through their 16-bit linear values. Every instruction
+ * set encodes NaN as silence: 0, 0x80 in 8-bit PCM, 0xd5 in A-law and 0xff in
+ * mu-law.
+ */
+typedef void (*DecodeFloatKernel)(const char *src, float *dst, size_t n);
+typedef void (*DecodeIntKernel)(const char *src, int32_t *dst, size_t n);
+typedef void (*EncodeFloatKernel)(const float *src, char *dst, size_t n);
+typedef void (*EncodeIntKernel)(const int32_t *src, char *dst, size_t n);
+
+/**
+ * @brief Minimum, maximum and sum of squares of each channel of nFrames
+ * (at least 1) interleaved float frames, written to arrays of channels values
+ */
+typedef void (*PeakKernel)(const float *src, size_t nFrames,
+                           unsigned int channels, float *min, float *max,
+                           float *sumSq);
+
+/**
+ * @brief Largest absolute value of n outputs of a FIR filter, output i being
+ * the sum of taps[k] * src[i + k] over nTaps taps. src holds n + nTaps - 1
+ * samples.
+ */
+typedef float (*FirPeakKernel)(const float *src, size_t n, const float *taps,
+                               unsigned int nTaps);
+
+/**
+ * @brief Adds TPDF dither of +-1 lsb to float samples. The noise of sample i
+ * only depends on counter + i, so consecutive blocks continue the sequence.
+ */
+typedef void (*DitherKernel)(float *samples, size_t n, float lsb,
+                             uint32_t counter);
+
+/**
+ * @brief Splits nFrames interleaved float frames into one array per channel
+ * (dst holds channels arrays of nFrames samples)
+ */
+typedef void (*DeinterleaveKernel)(const float *src, size_t nFrames,
+                                   unsigned int channels, float *const *dst);
+
+/**
+ * @brief Joins one array per channel into nFrames interleaved float frames
+ */
+typedef void (*InterleaveKernel)(const float *const *src, size_t nFrames,
+                                 unsigned int channels, float *dst);
+
+/**
+ * @brief Weighted sum of arrays, dst[i] being the sum of gains[c] * src[c][i]
+ * over nSrc arrays, added in order so that every instruction set gives the
+ * same result
+ */
+typedef void (*MixKernel)(const float *const *src, unsigned int nSrc,
+                          const float *gains, size_t n, float *dst);
+
+/**
+ * @brief Conversion kernels of one sample type
+ * @member DecodeFloatKernel bytes to float
+ * @member DecodeIntKernel bytes to int32_t
+ * @member EncodeFloatKernel float to bytes
+ * @member EncodeIntKernel int32_t to bytes
+ */
+struct SampleKernels {
+  DecodeFloatKernel toFloat;
+  DecodeIntKernel toInt;
+  EncodeFloatKernel fromFloat;
+  EncodeIntKernel fromInt;
+};
+
+/**
+ * @brief Gets the best instruction set of the CPU. It can be lowered with the
+ * WAV_RIFF_SIMD environment variable (scalar, sse4.1 or avx2).
+ * @return SimdLevel
+ */
+SimdLevel detectSimdLevel(void);
+
+/**
+ * @brief Gets the kernels of a sample type for an instruction set. Kernels
+ * that have no vectorized version fall back to the scalar ones.
+ * @param SampleType
+ * @param SimdLevel
+ * @return SampleKernels
+ */
+SampleKernels getSampleKernels(const SampleType type, const SimdLevel level);
+
+/**
+ * @brief Gets the peak kernel for a number of channels. The vectorized kernels
+ * handle channel counts that divide the vector width (1, 2, 4 and 8 with
+ * AVX2), other counts use the scalar kernel.
+ * @param unsigned int channels
+ * @param SimdLevel
+ * @return PeakKernel
+ */
+PeakKernel getPeakKernel(const unsigned int channels, const SimdLevel level);
+
+/**
+ * @brief Gets the FIR peak kernel for an instruction set
+ * @param SimdLevel
+ * @return FirPeakKernel
+ */
+FirPeakKernel getFirPeakKernel(const SimdLevel level);
+
+/**
+ * @brief Gets the TPDF dither kernel for an instruction set
+ * @param SimdLevel
+ * @return DitherKernel
+ */
+DitherKernel getDitherKernel(const SimdLevel level);
+
+/**
+ * @brief Gets the deinterleave kernel for a number of channels. The
+ * vectorized kernels are specialized for 2, 4, 6, 8 and 16 channels, other
+ * counts use the scalar kernel.
+ * @param unsigned int channels
+ * @param SimdLevel
+ * @return DeinterleaveKernel
+ */
+DeinterleaveKernel getDeinterleaveKernel(const unsigned int channels,
+                                         const SimdLevel level);
+
+/**
+ * @brief Gets the interleave kernel for a number of channels, specialized
+ * like the deinterleave kernels
+ * @param unsigned int channels
+ * @param SimdLevel
+ * @return InterleaveKernel
+ */
+InterleaveKernel getInterleaveKernel(const unsigned int channels,
+                                     const SimdLevel level);
+
+/**
+ * @brief Gets the mix kernel for an instruction set
+ * @param SimdLevel
+ * @return MixKernel
+ */
+MixKernel getMixKernel(const SimdLevel level);
+
+/**
+ * @brief Gets the size in bytes of one sample
+ * @param SampleType
+ * @return unsigned int 0 if the type is not defined
+ */
+unsigned int getSampleSize(const SampleType type);
+
+#endif // SAMPLEKERNELS_HPP_
@@ -0,0 +1,120 @@
+#ifndef STREAMREADER_HPP_
+#define STREAMREADER_HPP_
+
+#include "FrameReader.hpp"
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Frames of a block and blocks read ahead by default
+#define STREAM_BLOCK_FRAMES (1 << 16)
+#define STREAM_DEPTH 4
+
+/**
+ * @brief Block of frames handed out by a StreamReader
+ * @member uint64_t first frame of the block
+ * @member size_t number of frames
+ * @member const char * frames as they are stored
+ * @member const float * interleaved decoded samples, null if the reader
+ * does not decode
+ */
+struct StreamBlock {
+  uint64_t frame;
+  size_t nFrames;
+  const char *raw;
+  const float *samples;
+};
+
+/**
+ * @brief Sequential reader of the data chunk of a file. A background thread
+ * reads blocks ahead (and decodes them) into a ring of fixed-size buffers
+ * while the caller processes the previous ones, so disk latency, decoding
+ * and processing overlap. The ring is a single-producer single-consumer
+ * queue: blocks are handed over through two atomic counters, and a thread
+ * only sleeps when the ring is full or empty.
+ */
+class StreamReader {
+public:
+  /**
+   * @brief Opens a file and starts reading ahead from a frame
+   * @param std::string filename
+   * @param size_t frames of a block
+   * @param unsigned int number of blocks of the ring (at least 2)
+   * @param bool whether blocks are decoded to float (@ref SampleConverter)
+   * by the background thread
+   * @param bool BUFFERED_IO or DIRECT_IO (@ref FrameReader), with DIRECT_IO
+   * blocks of whole pages are read straight into the ring if the data chunk
+   * starts on a page (@ref WavData::setLayout), otherwise through one aligned
+   * buffer and copied
+   * @param uint64_t first frame
+   */
+  StreamReader(const std::string &fn,
+               const size_t blockFrames = STREAM_BLOCK_FRAMES,
+               const unsigned int depth = STREAM_DEPTH,
+               const bool decode = true, const bool direct = BUFFERED_IO,
+               const uint64_t first = 0);
+
+  /**
+   * @brief Destructor. Stops the background thread.
+   */
+  ~StreamReader(void);
+
+  /**
+   * @brief Waits for the next block. The previous block goes back to the
+   * ring, so its buffers must not be used anymore. Errors of the background
+   * thread are thrown here as std::string, standard exceptions by their
+   * what().
+   * @param StreamBlock block, valid until the next call
+   * @return bool false at the end of the data chunk
+   */
+  bool next(StreamBlock &block);
+
+  /**
+   * @brief Get the reader of the file, for its format
+   * @return const FrameReader &
+   */
+  const FrameReader &getFrameReader(void) const;
+
+private:
+  StreamReader(const StreamReader &);
+  StreamReader &operator=(const StreamReader &);
+
+  struct Slot {
+    std::unique_ptr<char, void (*)(void *)> raw;
+    std::vector<float> samples;
+    uint64_t frame;
+    size_t nFrames;
+  };
+
+  void run(uint64_t frame);
+  template <typename Ready>
+  void wait(std::atomic<bool> &waiting, const Ready &ready);
+  void wake(const std::atomic<bool> &waiting);
+
+  FrameReader reader_;
+  // Null if blocks are not decoded
+  std::unique_ptr<SampleConverter> converter_;
+  size_t blockFrames_;
+  std::vector<Slot> slots_;
+
+  // Blocks written by the thread and blocks released by the caller, the
+  // ring holds head_ - tail_ blocks
+  std::atomic<uint64_t> head_, tail_;
+  std::atomic<bool> done_, stop_;
+  bool holding_;
+  // Error of the thread, read once done_ is set
+  std::string error_;
+
+  // Only used to sleep and wake up when the ring is full or empty
+  std::mutex m_;
+  std::condition_variable cv_;
+  std::atomic<bool> producerWaiting_, consumerWaiting_;
+  std::thread thread_;
+};
+
+#endif // STREAMREADER_HPP_
@@ -0,0 +1,79 @@
+#ifndef THREADPOOL_HPP_
+#define THREADPOOL_HPP_
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+public:
+  /**
+   * @brief A task gets the index of the worker that runs it so that it can
+   * use per-worker state. An exception it throws is kept and thrown by the
+   * next wait().
+   */
+  typedef std::function<void(unsigned int)> Task;
+
+  /**
+   * @brief Starts the workers. Each one has its own task queue and steals from
+   * the others when it is empty.
+   * @param unsigned int number of workers, 0 for one per hardware thread
+   */
+  ThreadPool(unsigned int nThreads = 0);
+
+  /**
+   * @brief Destructor. Waits for all tasks, then stops the workers.
+   */
+  ~ThreadPool(void);
+
+  /**
+   * @brief Queues a task. Tasks submitted by a worker go to its own queue,
+   * others are spread over the queues. If the task cannot be queued, the
+   * exception is rethrown and wait() does not wait for it.
+   * @param ThreadPool::Task
+   */
+  void submit(const Task &task);
+
+  /**
+   * @brief Waits until every task is done, including the ones that were
+   * submitted by tasks, then throws the first exception a task threw since
+   * the previous wait(), if any
+   */
+  void wait(void);
+
+  /**
+   * @brief Get the number of workers
+   * @return unsigned int
+   */
+  unsigned int size(void) const;
+
+private:
+  ThreadPool(const ThreadPool &);
+  ThreadPool &operator=(const ThreadPool &);
+
+  struct Queue {
+    std::mutex m;
+    std::deque<Task> tasks;
+  };
+
+  bool pop(const unsigned int worker, Task &task);
+  void run(const unsigned int worker);
+
+  std::vector<std::unique_ptr<Queue>> queues_;
+  std::vector<std::thread> threads_;
+
+  // Guards the counters, workers sleep on cv_ and wait() on done_
+  std::mutex m_;
+  std::condition_variable cv_, done_;
+  size_t queued_, pending_, next_;
+  bool stop_;
+  // First exception thrown by a task since the last wait()
+  std::exception_ptr error_;
+};
+
+#endif // THREADPOOL_HPP_
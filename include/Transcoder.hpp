@@ -0,0 +1,78 @@
+#ifndef TRANSCODER_HPP_
+#define TRANSCODER_HPP_
+
+#include "SampleConverter.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Noise added before samples lose resolution
+enum Dither {
+  DITHER_NONE,
+  DITHER_TPDF // Triangular, +-1 lsb of the destination
+};
+
+class Transcoder {
+public:
+  /**
+   * @brief Transcoder to a sample type. Dither is only added when samples
+   * lose resolution on their way to 8, 16 or 24-bit PCM, such as 24-bit to
+   * 16-bit or float to 24-bit.
+   * @param SampleType destination sample type
+   * @param Dither
+   * @param uint32_t seed of the dither noise
+   * @param SimdLevel
+   */
+  Transcoder(const SampleType type, const Dither dither = DITHER_TPDF,
+             const uint32_t seed = 0,
+             const SimdLevel level = detectSimdLevel());
+
+  /**
+   * @brief Writes a file with the chunks of a WavData object and its samples
+   * converted block by block, so memory does not grow with the file. The
+   * samples come from the file the object was read from, or from its data
+   * chunk if that chunk is loaded (not READ_LAZY, or set in memory). fmt and
+   * fact are updated in the output only.
+   * @param WavData source
+   * @param std::string filename
+   * @param bool to drop or not drop undefined chunks when writing
+   * @return uint64_t number of frames written
+   */
+  uint64_t transcode(WavData &src, const std::string &fn,
+                     bool writeUndefinedChunks = true);
+
+  /**
+   * @brief Converts a block of samples. Consecutive calls continue the dither
+   * noise of each other.
+   * @param SampleConverter converter of the source samples
+   * @param const char * nSamples source samples
+   * @param char * nSamples destination samples
+   * @param size_t number of samples (not frames)
+   */
+  void convert(const SampleConverter &from, const char *src, char *dst,
+               const size_t nSamples);
+
+  /**
+   * @brief Sets the fmt fields that describe the destination samples:
+   * FormatTag (or the SubFormat of WAVE_FORMAT_EXTENSIBLE), BitsPerSample,
+   * ValidBitsPerSample, BlockAlign and AvgBytesPerSec
+   * @param WavData
+   */
+  void setFormat(WavData &wav) const;
+
+  SampleType getSampleType(void) const;
+
+private:
+  bool dithers(const SampleType from) const;
+
+  SampleConverter to_;
+  SimdLevel level_;
+  Dither dither_;
+  uint32_t counter_;
+  DitherKernel ditherKernel_;
+  // Samples of one block, decoded
+  std::vector<float> floats_;
+  std::vector<int32_t> ints_;
+};
+
+#endif // TRANSCODER_HPP_
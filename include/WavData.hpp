@@ -2,6 +2,9 @@
 #define WAVDATA_HPP_
 
 #include "Chunk.hpp"
+#include "ChunkSchema.hpp"
+#include "FourCC.hpp"
+#include "MappedFile.hpp"
 #include <assert.h>
 #include <fstream>
 #include <map>
@@ -12,8 +15,46 @@
 #define DROP_UNDEFINED_CHUNKS false
 #define HOLD_UNDEFINED_CHUNKS true
 
+// FormatTag values of the fmt chunk
+#define WAVE_FORMAT_PCM 0x0001
+#define WAVE_FORMAT_IEEE_FLOAT 0x0003
+#define WAVE_FORMAT_ALAW 0x0006
+#define WAVE_FORMAT_MULAW 0x0007
+#define WAVE_FORMAT_EXTENSIBLE 0xfffe
+
+// Alignment of the samples in files that are streamed from their start, the
+// page size (@ref WavData::setLayout)
+#define STREAMING_ALIGNMENT 4096
+
+// Read flags (@ref WavData::read)
+enum ReadFlags {
+  READ_COPY = 0,       // Fields own a copy of their bytes
+  READ_MAPPED = 1 << 0, // Fields are views into a read-only mapping
+  READ_LAZY = 1 << 1    // Chunk bodies are only read when accessed
+};
+
+class WavSnapshot;
+
 class WavData {
+  friend class WavWriter;
+  friend class Transcoder;
+  friend class WavSplicer;
+
 public:
+  /**
+   * @brief Location of a chunk in the last file that was read
+   * @member std::string chunk ID
+   * @member uint64_t offset of the chunk body in the file
+   * @member uint64_t size of the chunk body (from ds64 in RF64 files)
+   * @member bool whether the body was read into its Chunk
+   */
+  struct ChunkEntry {
+    std::string id;
+    uint64_t offset;
+    uint64_t size;
+    bool loaded;
+  };
+
   /**
    * @brief Default constructor. RIFF, fmt+fact, bext and cart chunks
    * defined by default.
@@ -26,26 +67,70 @@ public:
    */
   WavData(std::vector<Chunk> chunks);
 
+  /**
+   * @brief Builder constructor, the chunks of a snapshot are copied to be
+   * edited and written
+   * @param WavSnapshot
+   */
+  WavData(const WavSnapshot &snapshot);
+
   /**
    * @brief Destructor
    */
   ~WavData(void);
 
   /**
-   * @brief Get a pointer to a Chunk object
+   * @brief Get a pointer to a Chunk object. If the file was read with
+   * READ_LAZY, the body of that chunk is read first.
    * @param std::string name of the chunk
    * @return std::shared_ptr<Chunk>
    */
   std::shared_ptr<Chunk> getChunk(const std::string &name);
 
   /**
-   * @brief Get a hash table of all the Chunk objects
+   * @brief Get a pointer to a Chunk object by its packed ID, such as
+   * getChunk(toFourCC("bext"))
+   * @param FourCC
+   * @return std::shared_ptr<Chunk> null if the chunk is not defined
+   */
+  std::shared_ptr<Chunk> getChunk(const FourCC key);
+
+  /**
+   * @brief Get the value of a schema field (@ref Chunk::get), such as
+   * get<FmtSchema::SamplesPerSec>()
+   * @tparam F SchemaField
+   * @return F::type
+   */
+  template <typename F> typename F::type get(void) {
+    return getChunk(toFourCC(F::schema::id()))->template get<F>();
+  }
+
+  /**
+   * @brief Set the value of a schema field (@ref Chunk::set)
+   * @tparam F SchemaField
+   * @param F::type
+   */
+  template <typename F> void set(const typename F::type &value) {
+    getChunk(toFourCC(F::schema::id()))->template set<F>(value);
+  }
+
+  /**
+   * @brief Get a hash table of all the Chunk objects. Every chunk that was
+   * not read yet (READ_LAZY) is read first.
    * @return std::map<std::string,std::shared_ptr<Chunk>>
    */
-  std::map<std::string, std::shared_ptr<Chunk>> getAllChunks(void) const;
+  std::map<std::string, std::shared_ptr<Chunk>> getAllChunks(void);
+
+  /**
+   * @brief Get the IDs, offsets and sizes of all chunks of the last file that
+   * was read, in file order. JUNK chunks are listed too.
+   * @return std::vector<WavData::ChunkEntry>
+   */
+  std::vector<ChunkEntry> getChunkDirectory(void) const;
 
   /**
-   * @brief Add a chunk to the defined chunks
+   * @brief Add a chunk to the defined chunks, unless the file has one with
+   * that ID, loaded or not
    * @param Chunk
    */
   void addChunk(const Chunk &chunk);
@@ -59,10 +144,35 @@ public:
   /**
    * @brief Reads all defined chunks from a binary file and prints them out
    * Chunks that are read but not defined are stored as undefined chunks.
+   * With READ_MAPPED, the file is mapped and the fields (data included) are
+   * views into the mapping. The mapping lives as long as a chunk that was read
+   * from it and a field is only copied when it is modified.
+   * Only chunk headers are read at first. With READ_LAZY, a chunk body is read
+   * when the chunk is accessed and the file stays open until the next read.
    * @param std::string filename
-   * @param bool print or not
+   * @param int ReadFlags
+   */
+  void read(const std::string &fn, int flags = READ_COPY);
+
+  /**
+   * @brief Reads a file held in memory. With READ_MAPPED, fields are views
+   * into the buffer, which must then outlive the chunks. With READ_LAZY, it
+   * must also outlive the next read.
+   * @param const char * first byte of the file
+   * @param size_t size of the file
+   * @param int ReadFlags
    */
-  void read(const std::string &fn);
+  void readBuffer(const char *data, const size_t nBytes,
+                  int flags = READ_MAPPED);
+
+  /**
+   * @brief Reads a file from a stream. READ_MAPPED is ignored and, with
+   * READ_LAZY, the stream must outlive the next read. A stream that cannot
+   * seek (like a pipe) is read to its end first.
+   * @param std::istream binary stream that starts with the file
+   * @param int ReadFlags
+   */
+  void read(std::istream &is, int flags = READ_COPY);
 
   /**
    * @brief Writes all defined and undefined chunks to a binary file
@@ -71,6 +181,82 @@ public:
    */
   void write(const std::string &fn, bool writeUndefinedChunks = true);
 
+  /**
+   * @brief Writes all defined and undefined chunks to a stream
+   * @param std::ostream binary sink
+   * @param bool to drop or not drop undefined trunks when writing
+   */
+  void write(std::ostream &os, bool writeUndefinedChunks = true);
+
+  /**
+   * @brief Writes all defined and undefined chunks to a buffer of the caller
+   * @param char * first byte of the buffer
+   * @param size_t size of the buffer, an error is raised if the file does
+   * not fit
+   * @param bool to drop or not drop undefined trunks when writing
+   * @return size_t size of the file
+   */
+  size_t writeBuffer(char *buffer, const size_t capacity,
+                     bool writeUndefinedChunks = true);
+
+  /**
+   * @brief Sets the layout of the files that are written (write(),
+   * writeBuffer() and WavWriter). Every other chunk is written before the
+   * data chunk, then a JUNK chunk reserves room for metadata that grows
+   * later (@ref patch) and pads the file so that the samples start on a
+   * multiple of the alignment. By default, nothing is reserved or aligned.
+   * @param uint32_t bytes of JUNK reserved before the data chunk
+   * @param uint32_t alignment of the first sample in the file, a power of 2
+   * (1 for none)
+   */
+  void setLayout(const uint32_t junkReserve,
+                 const uint32_t dataAlignment = STREAMING_ALIGNMENT);
+
+  /**
+   * @brief Writes the modified chunks back into the file that was last read
+   * without rewriting the other ones (audio included). A chunk is modified if
+   * one of its fields was set since it was read. A chunk that still fits
+   * (using the JUNK chunks that directly follow it if it grew) is overwritten
+   * in place. Otherwise, its old place becomes JUNK and it is moved into a
+   * JUNK chunk that is large enough (such as the reserve of setLayout()) or
+   * to the end of the file. Removed chunks become JUNK and new chunks are
+   * placed the same way.
+   */
+  void patch(void);
+
+  /**
+   * @brief Takes an immutable snapshot of the chunks that threads can share
+   * (@ref WavSnapshot). Every chunk is loaded and copied, views of a
+   * READ_MAPPED read are copied as views so that taking a snapshot of a large
+   * file is cheap.
+   * @return WavSnapshot
+   */
+  WavSnapshot snapshot(void);
+
+  /**
+   * @brief Decodes all samples of the data chunk (@ref SampleConverter)
+   * @param std::vector<float> interleaved samples in [-1, 1)
+   */
+  void getSamples(std::vector<float> &samples);
+
+  /**
+   * @brief Decodes all samples of the data chunk (@ref SampleConverter)
+   * @param std::vector<int32_t> interleaved full scale samples
+   */
+  void getSamples(std::vector<int32_t> &samples);
+
+  /**
+   * @brief Encodes samples into the data chunk in the format of fmt
+   * @param std::vector<float> interleaved samples in [-1, 1)
+   */
+  void setSamples(const std::vector<float> &samples);
+
+  /**
+   * @brief Encodes samples into the data chunk in the format of fmt
+   * @param std::vector<int32_t> interleaved full scale samples
+   */
+  void setSamples(const std::vector<int32_t> &samples);
+
   /**
    * @brief Converts a numerical type to a string (byte array, up to 8 bytes
    * long)
@@ -107,7 +293,7 @@ public:
     data.in = 0;
     for (unsigned int i = 0; i < s.size(); i++) {
       unsigned char c = s[i];
-      data.in |= c << 8 * i;
+      data.in |= (long int)c << 8 * i;
     }
     return data.out;
   }
@@ -118,6 +304,13 @@ public:
    * @return bool
    */
   bool exists(const std::string &name);
+  bool exists(const FourCC key) const;
+
+  /**
+   * @brief Checks if the last file that was read is an RF64 (or BW64) file
+   * @return bool
+   */
+  bool isRF64(void) const;
 
   /**
    * @brief Resets values of all fields of all Chunks except RIFF.
@@ -127,19 +320,83 @@ public:
   void resetData(void);
 
 private:
-  void readBytes(const unsigned int nBytes, std::string &data);
-  void readChunk(std::string& readData);
+  size_t readBytes(const uint64_t nBytes, std::string &data);
+  size_t readBytes(const uint64_t nBytes, char *data);
+  void seek(const uint64_t offset);
+  uint64_t tell(void);
+  void readChunk(const FourCC key, const uint64_t ckSize);
+  void scanChunks(void);
+  void readDs64(const uint64_t ckSize);
+  void loadEntry(const size_t index);
+  void loadChunk(const FourCC key);
+  void loadAllChunks(void);
+  void loadMetadata(void);
+  void copyMetadata(WavData &dst, const std::vector<FourCC> &drop);
+  void closeSource(void);
+  void beginRead(void);
+  void parse(int flags);
+  uint64_t writeTo(std::ostream &os, bool writeUndefinedChunks,
+                   const ChunkEntry *source);
+  std::vector<FourCC> writeOrder(bool writeUndefinedChunks) const;
+  std::string serializeChunk(const Chunk &ck) const;
+  bool unmodifiedData(ChunkEntry &source) const;
+  uint64_t junkFootprint(const uint64_t offset,
+                         const uint32_t alignment) const;
+  static void writeJunk(std::ostream &os, const uint64_t footprint);
+  static uint64_t footprint(const uint64_t size);
+  static std::string ds64Body(const uint64_t riffSize, const uint64_t dataSize,
+                              const uint64_t sampleCount,
+                              const std::map<std::string, uint64_t> &table);
+  static void writeHeader(std::fstream &f, const uint64_t offset,
+                          const std::string &id, const unsigned int size);
+  static void appendChunk(std::fstream &f, uint64_t &end, ChunkEntry &entry,
+                          const std::string &body);
+  size_t placeInJunk(std::fstream &f, ChunkEntry &entry,
+                     const std::string &body);
+  void patchRiffSize(std::fstream &f, const uint64_t riffSize);
+  void shiftEntries(const size_t index, const long delta);
+  void findCopies(void);
+  void copyEntry(const ChunkEntry &entry);
+  uint64_t sourceSize(void);
   void writeBytes(const std::string &data);
-  void writeChunk(const std::string &name);
-  void saveUndefinedChunk(const std::string &chunkId);
+  void writeBytes(const char *data, const size_t nBytes);
+  void writeChunk(const FourCC key);
+  void writeFields(const Chunk &ck);
+  void saveUndefinedChunk(const std::string &chunkId, const uint64_t ckSize);
 
-  std::map<std::string, std::shared_ptr<Chunk>> chunks_;
+  // Chunks by packed ID, the string API converts IDs first
+  FlatTable<std::shared_ptr<Chunk>> chunks_;
 
-  int riffSize_;
+  uint64_t riffSize_;
   std::string data_;
 
+  // Last file that was read, its chunk directory and the directory entry
+  // that each chunk was read from
+  std::string fn_;
+  std::vector<ChunkEntry> directory_;
+  FlatTable<size_t> entryOf_;
+  // Chunks removed since the file was read, patch() turns them into junk
+  FlatTable<bool> removed_;
+  // RF64 files give 64-bit sizes in ds64 for chunks whose header says
+  // MAX_CHUNK_SIZE
+  bool rf64_;
+  FlatTable<uint64_t> ds64Sizes_;
+  // Directory entries of the chunks that write() copies from the source
+  FlatTable<size_t> copies_;
+  // Layout of written files (@ref setLayout)
+  uint32_t junkReserve_, dataAlignment_;
+
+  // Source of the current read, a stream (the file or one of the caller) or
+  // memory (the mapped file or a buffer of the caller). It is only set while
+  // reading, until the next read if lazy.
   std::ifstream r_;
+  std::istream *in_;
+  std::shared_ptr<const MappedFile> map_;
+  uint64_t pos_;
+  // Fields are views into map_
+  bool views_;
   std::ofstream w_;
+  std::ostream *out_;
 };
 
 #endif // WAVDATA_HPP_
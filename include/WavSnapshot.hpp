@@ -0,0 +1,91 @@
+#ifndef WAVSNAPSHOT_HPP_
+#define WAVSNAPSHOT_HPP_
+
+#include "WavData.hpp"
+#include <memory>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Immutable copy of a parsed file (@ref WavData::snapshot). Copies
+ * share the same chunks and every method is const, fields included (@ref
+ * Chunk::ConstFieldRef), so a snapshot can be queried by many threads at once
+ * without locks. To edit it, build a WavData
+ * from it, modify that and take a new snapshot.
+ */
+class WavSnapshot {
+  friend class WavData;
+
+public:
+  /**
+   * @brief Empty snapshot
+   */
+  WavSnapshot(void);
+
+  /**
+   * @brief Get a chunk by its ID
+   * @param std::string
+   * @return std::shared_ptr<const Chunk> null if the chunk is not defined
+   */
+  std::shared_ptr<const Chunk> getChunk(const std::string &name) const;
+
+  /**
+   * @brief Get a chunk by its packed ID
+   * @param FourCC
+   * @return std::shared_ptr<const Chunk> null if the chunk is not defined
+   */
+  std::shared_ptr<const Chunk> getChunk(const FourCC key) const;
+
+  /**
+   * @brief Get the value of a schema field (@ref ChunkSchema.hpp), such as
+   * snapshot.get<FmtSchema::SamplesPerSec>(). The chunk must exist.
+   * @tparam F SchemaField
+   * @return F::type
+   */
+  template <typename F> typename F::type get(void) const {
+    auto ck = getChunk(toFourCC(F::schema::id()));
+    assert(ck);
+    return ck->template get<F>();
+  }
+
+  /**
+   * @brief Checks if a chunk is defined
+   * @param std::string
+   * @return bool
+   */
+  bool exists(const std::string &name) const;
+  bool exists(const FourCC key) const;
+
+  /**
+   * @brief Get the IDs of all chunks in ascending order
+   * @return std::vector<FourCC>
+   */
+  std::vector<FourCC> getChunkIds(void) const;
+
+  /**
+   * @brief Get the chunk directory of the file the snapshot was taken from
+   * @return std::vector<WavData::ChunkEntry>
+   */
+  std::vector<WavData::ChunkEntry> getChunkDirectory(void) const;
+
+  /**
+   * @brief Checks if the file was RF64 or BW64
+   * @return bool
+   */
+  bool isRF64(void) const;
+
+private:
+  struct State {
+    State(void) : rf64(false) {}
+
+    FlatTable<std::shared_ptr<const Chunk>> chunks;
+    std::vector<WavData::ChunkEntry> directory;
+    bool rf64;
+  };
+
+  WavSnapshot(const std::shared_ptr<const State> &state);
+
+  std::shared_ptr<const State> state_;
+};
+
+#endif // WAVSNAPSHOT_HPP_
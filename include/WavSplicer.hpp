@@ -0,0 +1,76 @@
+#ifndef WAVSPLICER_HPP_
+#define WAVSPLICER_HPP_
+
+#include "WavData.hpp"
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/**
+ * @brief Cuts and joins files without decoding their samples. Frame-aligned
+ * byte ranges of the data chunks are copied by the kernel (@ref
+ * copyFileRange), so memory and CPU time do not grow with the files. The
+ * other chunks of a source are written to each output, except the dropped
+ * ones.
+ */
+class WavSplicer {
+public:
+  /**
+   * @brief Splicer that keeps every chunk
+   * @param bool to drop or not drop undefined chunks when writing
+   */
+  WavSplicer(bool writeUndefinedChunks = true);
+
+  /**
+   * @brief Drops a chunk from the outputs, such as one that describes the
+   * samples of the whole source
+   * @param std::string chunk ID, not RIFF, fmt, fact or data, which throw
+   */
+  void dropChunk(const std::string &id);
+
+  /**
+   * @brief Writes frames of a file to another one. The TimeReference of
+   * bext is moved to the first frame.
+   * @param std::string source file
+   * @param uint64_t first frame
+   * @param uint64_t number of frames, less past the end of the source
+   * @param std::string output file
+   * @return uint64_t number of frames written
+   */
+  uint64_t extract(const std::string &src, const uint64_t first,
+                   const uint64_t nFrames, const std::string &fn);
+
+  /**
+   * @brief Cuts a file into segments, every cut starts a new one
+   * @param std::string source file
+   * @param std::vector<uint64_t> frames of the cuts, in increasing order
+   * @param std::vector<std::string> output files, one more than the cuts
+   */
+  void split(const std::string &src, const std::vector<uint64_t> &cuts,
+             const std::vector<std::string> &fns);
+
+  /**
+   * @brief Joins files that have the same format, with the chunks of the
+   * first one
+   * @param std::vector<std::string> source files, in order
+   * @param std::string output file
+   * @return uint64_t number of frames written
+   */
+  uint64_t concat(const std::vector<std::string> &srcs, const std::string &fn);
+
+  /**
+   * @brief Checks if the samples of two files can be joined: same format
+   * tag (or SubFormat), channels, sample rate, BlockAlign and bits per sample
+   * (and valid bits and channel mask for WAVE_FORMAT_EXTENSIBLE)
+   * @param WavData
+   * @param WavData
+   * @return bool
+   */
+  static bool isCompatible(WavData &a, WavData &b);
+
+private:
+  bool writeUndefinedChunks_;
+  std::vector<FourCC> drop_;
+};
+
+#endif // WAVSPLICER_HPP_
@@ -0,0 +1,92 @@
+#ifndef WAVWRITER_HPP_
+#define WAVWRITER_HPP_
+
+#include "FileCopy.hpp"
+#include "WavData.hpp"
+#include <fstream>
+#include <string>
+
+class WavWriter {
+public:
+  /**
+   * @brief Opens a file and writes the chunks of a WavData object (except
+   * data) followed by the header of an empty data chunk. Samples are then
+   * appended with append() and the sizes are fixed by finalize(). The file
+   * follows the layout of the object (@ref WavData::setLayout).
+   * With DIRECT_IO, samples are written with O_DIRECT in aligned blocks that
+   * bypass the page cache, and the data chunk is aligned to at least
+   * DIRECT_ALIGNMENT. Filesystems without O_DIRECT are written normally.
+   * @param WavData chunks to write before the data chunk
+   * @param std::string filename
+   * @param bool to drop or not drop undefined chunks when writing
+   * @param bool BUFFERED_IO or DIRECT_IO
+   */
+  WavWriter(WavData &wav, const std::string &fn,
+            bool writeUndefinedChunks = true, const bool direct = BUFFERED_IO);
+
+  /**
+   * @brief Destructor. Finalizes the file if it was not done yet.
+   */
+  ~WavWriter(void);
+
+  /**
+   * @brief Appends raw sample bytes to the data chunk. Nothing is kept in
+   * memory besides the stream buffer (or the block of DIRECT_IO).
+   * @param const char * bytes to append
+   * @param size_t number of bytes
+   */
+  void append(const char *data, const size_t nBytes);
+
+  /**
+   * @brief Appends raw sample bytes to the data chunk
+   * @param std::string bytes to append
+   */
+  void append(const std::string &data);
+
+  /**
+   * @brief Appends a range of bytes of another file to the data chunk. The
+   * kernel copies them (@ref copyFileRange) without going through user
+   * space, or through the block of DIRECT_IO.
+   * @param std::string source file
+   * @param uint64_t offset in the source
+   * @param uint64_t number of bytes
+   */
+  void appendRange(const std::string &src, const uint64_t offset,
+                   const uint64_t nBytes);
+
+  /**
+   * @brief Pads the data chunk, then seeks back to write the RIFF and data
+   * sizes (and fact's SampleLength if it was written). A file that outgrows
+   * 32-bit sizes is promoted to RF64, using the JUNK chunk reserved after the
+   * RIFF header for ds64. Nothing can be appended afterwards.
+   */
+  void finalize(void);
+
+  /**
+   * @brief Get the number of data bytes appended so far
+   * @return uint64_t
+   */
+  uint64_t getDataSize(void) const;
+
+private:
+  WavWriter(const WavWriter &);
+  WavWriter &operator=(const WavWriter &);
+
+  void writeChunk(const std::string &id, const std::string &body);
+  void flushDirect(void);
+
+  std::string fn_;
+  std::ofstream w_;
+  // Samples of DIRECT_IO, written through fd_ once a block is full. fd_ is
+  // -1 for buffered writes.
+  int fd_;
+  std::unique_ptr<char, void (*)(void *)> block_;
+  size_t blockFill_;
+  // Offsets of the data chunk body and of fact's SampleLength (0 if none)
+  uint64_t dataOffset_, factOffset_;
+  uint64_t dataSize_;
+  unsigned int blockAlign_;
+  bool finalized_;
+};
+
+#endif // WAVWRITER_HPP_
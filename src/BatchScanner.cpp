@@ -0,0 +1,247 @@
+#include "BatchScanner.hpp"
+#include <cmath>
+#include <cstdio>
+#include <sys/stat.h>
+
+// Quotes a CSV value if it holds a separator, a quote or a line break
+static std::string csvEscape(const std::string &s) {
+  if (s.find_first_of(",\"\r\n") == std::string::npos)
+    return s;
+  std::string out = "\"";
+  for (auto it = s.begin(); it != s.end(); it++) {
+    if (*it == '"')
+      out.push_back('"');
+    out.push_back(*it);
+  }
+  return out + '"';
+}
+
+// Bytes past ASCII are taken as Latin-1 so the output is always valid JSON
+static std::string jsonEscape(const std::string &s) {
+  std::string out = "\"";
+  for (auto it = s.begin(); it != s.end(); it++) {
+    unsigned char c = *it;
+    if (c == '"' || c == '\\') {
+      out.push_back('\\');
+      out.push_back(c);
+    } else if (c < 0x20 || c >= 0x7f) {
+      char buf[8];
+      snprintf(buf, sizeof(buf), "\\u%04x", c);
+      out += buf;
+    } else {
+      out.push_back(c);
+    }
+  }
+  return out + '"';
+}
+
+// Widens a little-endian integer of its field's size, extending its sign
+static std::string signExtend(std::string s, const size_t size) {
+  const bool negative = !s.empty() && s.size() < size && (s.back() & 0x80);
+  s.resize(size, negative ? '\xff' : '\0');
+  return s;
+}
+
+BatchScanner::BatchScanner(const std::vector<std::string> &fields,
+                           unsigned int nThreads)
+    : pool_(nThreads),
+      walker_(pool_,
+              [this](const std::string &path, const std::string &name) {
+                // Files are scanned by whichever worker is free
+                if (isWavFile(name))
+                  pool_.submit([this, path](unsigned int worker) {
+                    scanFile(path, worker);
+                  });
+              },
+              [this](const std::string &dir) { onDirectoryError(dir); }),
+      os_(nullptr), format_(SCAN_CSV), count_(0), errors_(0) {
+  for (auto it = fields.begin(); it != fields.end(); it++)
+    fields_.push_back(parseField(*it));
+  for (unsigned int i = 0; i < pool_.size(); i++)
+    parsers_.push_back(std::unique_ptr<WavData>(new WavData()));
+}
+
+BatchScanner::~BatchScanner(void) {}
+
+size_t BatchScanner::scan(const std::vector<std::string> &paths,
+                          std::ostream &os, const ScanFormat format) {
+  os_ = &os;
+  format_ = format;
+  count_ = 0;
+  errors_ = 0;
+  walker_.reset();
+  if (format_ == SCAN_CSV)
+    os << header();
+
+  for (auto it = paths.begin(); it != paths.end(); it++) {
+    const std::string path = *it;
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+      walker_.walk(path);
+    } else {
+      // Files given explicitly are scanned whatever their extension
+      pool_.submit(
+          [this, path](unsigned int worker) { scanFile(path, worker); });
+    }
+  }
+  pool_.wait();
+  os.flush();
+  walker_.rethrow();
+  return count_;
+}
+
+size_t BatchScanner::getErrorCount(void) const { return errors_; }
+
+std::string BatchScanner::formatField(const Chunk::Field &field) {
+  std::string s = field.val;
+  switch (field.type) {
+  case F_INT:
+    return std::to_string(WavData::toType<int>(signExtend(s, sizeof(int))));
+  case F_UINT:
+    s.resize(sizeof(unsigned int));
+    return std::to_string(WavData::toType<unsigned int>(s));
+  case F_SHORT:
+    return std::to_string(
+        WavData::toType<short>(signExtend(s, sizeof(short))));
+  case F_FLOAT:
+    s.resize(sizeof(float));
+    return std::to_string(WavData::toType<float>(s));
+  case F_STRING:
+    return s.substr(0, s.find('\0'));
+  default: {
+    std::string hex;
+    char buf[4];
+    for (auto it = s.begin(); it != s.end(); it++) {
+      snprintf(buf, sizeof(buf), "%02x", (unsigned char)*it);
+      hex += buf;
+    }
+    return hex;
+  }
+  }
+}
+
+BatchScanner::FieldSpec BatchScanner::parseField(const std::string &name) {
+  size_t dot = name.find('.');
+  if (dot == std::string::npos || dot == 0 || dot > ID_SIZE)
+    throw std::string("Field " + name + " is not chunk.field\n");
+  FieldSpec spec;
+  spec.name = name;
+  spec.chunk = name.substr(0, dot);
+  spec.chunk.resize(ID_SIZE, ' ');
+  spec.key = toFourCC(spec.chunk.data());
+  spec.field = name.substr(dot + 1);
+  return spec;
+}
+
+Chunk::FieldRef
+BatchScanner::findField(WavData &wav,
+                        const std::vector<WavData::ChunkEntry> &directory,
+                        const FieldSpec &spec) {
+  bool found = false;
+  for (auto it = directory.begin(); it != directory.end() && !found; it++)
+    found = it->id == spec.chunk;
+  if (!found)
+    return nullptr;
+  auto ck = wav.getChunk(spec.key);
+  return ck ? ck->getField(spec.field) : nullptr;
+}
+
+bool BatchScanner::isWavFile(const std::string &fn) {
+  if (fn.size() < 4)
+    return false;
+  std::string ext = fn.substr(fn.size() - 4);
+  for (auto it = ext.begin(); it != ext.end(); it++)
+    *it = tolower(*it);
+  return ext == ".wav";
+}
+
+void BatchScanner::onDirectoryError(const std::string &dir) {
+  errors_++;
+  std::string line = record(dir, std::vector<Value>(fields_.size()),
+                            "Could not open " + dir);
+  std::lock_guard<std::mutex> lock(outMutex_);
+  *os_ << line;
+}
+
+std::string
+BatchScanner::extractFields(WavData &wav, const std::string &fn,
+                            const std::vector<FieldSpec> &fields,
+                            std::vector<WavData::ChunkEntry> &directory,
+                            std::vector<Value> &values) {
+  directory.clear();
+  values.assign(fields.size(), Value());
+  std::string error;
+  try {
+    wav.read(fn, READ_MAPPED | READ_LAZY);
+    directory = wav.getChunkDirectory();
+    for (size_t i = 0; i < fields.size(); i++) {
+      Chunk::FieldRef field = findField(wav, directory, fields[i]);
+      if (!field)
+        continue;
+      values[i].text = formatField(*field);
+      values[i].found = true;
+      values[i].number = field->type == F_INT || field->type == F_UINT ||
+                         field->type == F_SHORT || field->type == F_FLOAT;
+      if (field->type == F_FLOAT) {
+        std::string val = field->val;
+        val.resize(sizeof(float));
+        values[i].null = !std::isfinite(WavData::toType<float>(val));
+      }
+    }
+  } catch (const std::string &e) {
+    error = e.substr(0, e.find('\n'));
+  } catch (const std::exception &e) {
+    error = e.what();
+  }
+  if (!error.empty()) {
+    directory.clear();
+    values.assign(fields.size(), Value());
+  }
+  return error;
+}
+
+void BatchScanner::scanFile(const std::string &fn, const unsigned int worker) {
+  std::vector<WavData::ChunkEntry> directory;
+  std::vector<Value> values;
+  std::string error =
+      extractFields(*parsers_[worker], fn, fields_, directory, values);
+  if (!error.empty())
+    errors_++;
+  count_++;
+
+  std::string line = record(fn, values, error);
+  std::lock_guard<std::mutex> lock(outMutex_);
+  *os_ << line;
+}
+
+std::string BatchScanner::header(void) const {
+  std::string line = "path";
+  for (auto it = fields_.begin(); it != fields_.end(); it++)
+    line += ',' + csvEscape(it->name);
+  return line + ",error\n";
+}
+
+std::string BatchScanner::record(const std::string &fn,
+                                 const std::vector<Value> &values,
+                                 const std::string &error) const {
+  std::string line;
+  if (format_ == SCAN_CSV) {
+    line = csvEscape(fn);
+    for (auto it = values.begin(); it != values.end(); it++)
+      line += ',' + csvEscape(it->text);
+    return line + ',' + csvEscape(error) + '\n';
+  }
+
+  // Missing fields and floats that are not JSON numbers are null
+  line = "{\"path\":" + jsonEscape(fn);
+  for (size_t i = 0; i < values.size(); i++) {
+    line += ',' + jsonEscape(fields_[i].name) + ':';
+    if (!values[i].found || values[i].null)
+      line += "null";
+    else
+      line += values[i].number ? values[i].text : jsonEscape(values[i].text);
+  }
+  if (!error.empty())
+    line += ",\"error\":" + jsonEscape(error);
+  return line + "}\n";
+}
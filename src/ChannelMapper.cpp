@@ -0,0 +1,181 @@
+#include "ChannelMapper.hpp"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+// Samples of a block, the scratch buffers of a block stay in the cache
+#define MAP_BLOCK (1 << 14)
+
+// Copies samples of some channels of each frame, the size is known at
+// compile time so the copies are single moves
+template <unsigned int S>
+static void gatherSamples(const char *src, const unsigned int blockAlign,
+                          const unsigned int *channels, const unsigned int n,
+                          char *dst, const size_t nFrames) {
+  for (size_t i = 0; i < nFrames; i++, src += blockAlign) {
+    for (unsigned int c = 0; c < n; c++, dst += S)
+      memcpy(dst, src + channels[c] * S, S);
+  }
+}
+
+ChannelMapper::ChannelMapper(const SampleType type,
+                             const unsigned int channels,
+                             const SimdLevel level)
+    : converter_(type, level), channels_(channels), level_(level) {
+  init();
+}
+
+ChannelMapper::ChannelMapper(WavData &wav, const SimdLevel level)
+    : converter_(wav, level), channels_(wav.get<FmtSchema::Channels>()),
+      level_(level) {
+  if (channels_ * converter_.getSampleSize() !=
+      wav.get<FmtSchema::BlockAlign>())
+    throw std::string("Padded frames cannot be mapped\n");
+  init();
+}
+
+void ChannelMapper::init(void) {
+  if (channels_ == 0)
+    throw std::string("Frames have no channel\n");
+  deinterleave_ = getDeinterleaveKernel(channels_, level_);
+  interleave_ = getInterleaveKernel(channels_, level_);
+  mix_ = getMixKernel(level_);
+  // Enough for the blocks of any subset of the channels
+  const size_t samples = std::max<size_t>(MAP_BLOCK, channels_);
+  raw_.resize(samples * converter_.getSampleSize());
+  floats_.resize(samples);
+  planar_.resize(samples);
+}
+
+size_t ChannelMapper::blockFrames(const unsigned int channels) const {
+  return std::max(1u, MAP_BLOCK / channels);
+}
+
+void ChannelMapper::gather(const char *src, const unsigned int *channels,
+                           const unsigned int n, char *dst,
+                           const size_t nFrames) const {
+  const unsigned int blockAlign = channels_ * converter_.getSampleSize();
+  switch (converter_.getSampleSize()) {
+  case 1:
+    return gatherSamples<1>(src, blockAlign, channels, n, dst, nFrames);
+  case 2:
+    return gatherSamples<2>(src, blockAlign, channels, n, dst, nFrames);
+  case 3:
+    return gatherSamples<3>(src, blockAlign, channels, n, dst, nFrames);
+  case 4:
+    return gatherSamples<4>(src, blockAlign, channels, n, dst, nFrames);
+  case 8:
+    return gatherSamples<8>(src, blockAlign, channels, n, dst, nFrames);
+  }
+  assert(false);
+}
+
+void ChannelMapper::deinterleave(const char *src, float *const *dst,
+                                 const size_t nFrames) {
+  const size_t block = blockFrames(channels_);
+  const size_t frameSize = channels_ * converter_.getSampleSize();
+  std::vector<float *> out(dst, dst + channels_);
+  for (size_t done = 0; done < nFrames;) {
+    size_t n = std::min(block, nFrames - done);
+    converter_.decode(src + done * frameSize, floats_.data(), n * channels_);
+    deinterleave_(floats_.data(), n, channels_, out.data());
+    for (unsigned int c = 0; c < channels_; c++)
+      out[c] += n;
+    done += n;
+  }
+}
+
+void ChannelMapper::interleave(const float *const *src, char *dst,
+                               const size_t nFrames) {
+  const size_t block = blockFrames(channels_);
+  const size_t frameSize = channels_ * converter_.getSampleSize();
+  std::vector<const float *> in(src, src + channels_);
+  for (size_t done = 0; done < nFrames;) {
+    size_t n = std::min(block, nFrames - done);
+    interleave_(in.data(), n, channels_, floats_.data());
+    converter_.encode(floats_.data(), dst + done * frameSize, n * channels_);
+    for (unsigned int c = 0; c < channels_; c++)
+      in[c] += n;
+    done += n;
+  }
+}
+
+void ChannelMapper::extract(const char *src,
+                            const std::vector<unsigned int> &channels,
+                            float *const *dst, const size_t nFrames) {
+  const unsigned int k = channels.size();
+  for (unsigned int c = 0; c < k; c++) {
+    if (channels[c] >= channels_)
+      throw std::string("No such channel\n");
+  }
+  if (k == 0)
+    return;
+  bool all = k == channels_;
+  for (unsigned int c = 0; all && c < k; c++)
+    all = channels[c] == c;
+  if (all)
+    return deinterleave(src, dst, nFrames);
+
+  // Only the samples of the channels are decoded, a single channel straight
+  // into its array
+  const DeinterleaveKernel kernel = getDeinterleaveKernel(k, level_);
+  const size_t block = blockFrames(k);
+  const unsigned int sampleSize = converter_.getSampleSize();
+  const size_t frameSize = channels_ * sampleSize;
+  std::vector<float *> out(dst, dst + k);
+  for (size_t done = 0; done < nFrames;) {
+    size_t n = std::min(block, nFrames - done);
+    gather(src + done * frameSize, channels.data(), k, raw_.data(), n);
+    if (k == 1) {
+      converter_.decode(raw_.data(), out[0], n);
+    } else {
+      converter_.decode(raw_.data(), floats_.data(), n * k);
+      kernel(floats_.data(), n, k, out.data());
+    }
+    for (unsigned int c = 0; c < k; c++)
+      out[c] += n;
+    done += n;
+  }
+}
+
+void ChannelMapper::mixdown(const char *src, const std::vector<float> &matrix,
+                            float *const *dst, const size_t nFrames) {
+  if (matrix.size() % channels_)
+    throw std::string("A mixdown needs one gain per channel and output\n");
+  const unsigned int outputs = matrix.size() / channels_;
+  // Columns of the channels used by an output
+  std::vector<unsigned int> used;
+  for (unsigned int c = 0; c < channels_; c++) {
+    for (unsigned int o = 0; o < outputs; o++) {
+      if (matrix[o * channels_ + c] != 0.0f) {
+        used.push_back(c);
+        break;
+      }
+    }
+  }
+  const unsigned int k = used.size();
+  std::vector<float> gains(outputs * k);
+  for (unsigned int o = 0; o < outputs; o++) {
+    for (unsigned int c = 0; c < k; c++)
+      gains[o * k + c] = matrix[o * channels_ + used[c]];
+  }
+
+  const size_t block = blockFrames(channels_);
+  const size_t frameSize = channels_ * converter_.getSampleSize();
+  std::vector<float *> planes(k);
+  for (unsigned int c = 0; c < k; c++)
+    planes[c] = planar_.data() + c * block;
+  for (size_t done = 0; done < nFrames;) {
+    size_t n = std::min(block, nFrames - done);
+    extract(src + done * frameSize, used, planes.data(), n);
+    for (unsigned int o = 0; o < outputs; o++)
+      mix_(planes.data(), k, gains.data() + o * k, n, dst[o] + done);
+    done += n;
+  }
+}
+
+unsigned int ChannelMapper::getChannels(void) const { return channels_; }
+
+SampleType ChannelMapper::getSampleType(void) const {
+  return converter_.getSampleType();
+}
@@ -1,13 +1,202 @@
 #include "Chunk.hpp"
 #include "WavData.hpp"
+#include <algorithm>
 #include <assert.h>
 
-#define MAX_CHUNK_SIZE 0xffffffff
+FieldValue::FieldValue(void)
+    : arena_(nullptr), offset_(0), capacity_(0), view_(nullptr), size_(0),
+      dirty_(true) {}
+
+FieldValue::FieldValue(const std::string &s) : FieldValue() { str_ = s; }
+
+FieldValue::FieldValue(const char *s) : FieldValue() { str_ = s; }
+
+FieldValue::FieldValue(const FieldValue &v) : FieldValue() {
+  if (v.view_)
+    setView(v.view_, v.size_);
+  else
+    str_.assign(v.data(), v.size());
+  dirty_ = v.dirty_;
+}
+
+FieldValue::FieldValue(FieldValue &&v) noexcept
+    : str_(std::move(v.str_)), arena_(v.arena_), offset_(v.offset_),
+      capacity_(v.capacity_), view_(v.view_), size_(v.size_),
+      dirty_(v.dirty_) {
+  v.clear();
+}
+
+FieldValue &FieldValue::operator=(const FieldValue &v) {
+  if (this == &v)
+    return *this;
+  if (v.view_) {
+    setView(v.view_, v.size_);
+  } else if (arena_ && v.arena_ == arena_) {
+    // Both are in the same arena, which may move while this one grows
+    assign(std::string(v.data(), v.size()).data(), v.size());
+  } else {
+    assign(v.data(), v.size());
+  }
+  return *this;
+}
+
+FieldValue &FieldValue::operator=(const std::string &s) {
+  assign(s.data(), s.size());
+  return *this;
+}
+
+FieldValue &FieldValue::operator=(const char *s) {
+  return *this = std::string(s);
+}
+
+void FieldValue::assign(const char *data, size_t nBytes) {
+  dirty_ = true;
+  store(data, nBytes);
+}
+
+void FieldValue::store(const char *data, size_t nBytes) {
+  view_ = nullptr;
+  if (!arena_) {
+    str_.assign(data, nBytes);
+    return;
+  }
+  size_ = 0;
+  reserve(nBytes);
+  std::copy(data, data + nBytes, &(*arena_)[offset_]);
+  size_ = nBytes;
+}
+
+void FieldValue::setView(const char *data, size_t nBytes) {
+  str_.clear();
+  view_ = data;
+  size_ = nBytes;
+  dirty_ = true;
+}
+
+bool FieldValue::isView(void) const { return view_ != nullptr; }
+
+bool FieldValue::isDirty(void) const { return dirty_; }
+
+const char *FieldValue::data(void) const {
+  if (view_)
+    return view_;
+  return arena_ ? arena_->data() + offset_ : str_.data();
+}
+
+size_t FieldValue::size(void) const {
+  return view_ || arena_ ? size_ : str_.size();
+}
+
+bool FieldValue::empty(void) const { return size() == 0; }
+
+const char &FieldValue::operator[](const size_t i) const { return data()[i]; }
+
+char &FieldValue::operator[](const size_t i) {
+  materialize();
+  dirty_ = true;
+  return arena_ ? (*arena_)[offset_ + i] : str_[i];
+}
+
+void FieldValue::push_back(const char c) {
+  materialize();
+  dirty_ = true;
+  if (!arena_) {
+    str_.push_back(c);
+    return;
+  }
+  // Slots grow geometrically when values are built byte by byte
+  if (size_ == capacity_)
+    reserve(std::max<size_t>(2 * capacity_, 16));
+  (*arena_)[offset_ + size_++] = c;
+}
+
+void FieldValue::resize(const size_t n) {
+  materialize();
+  dirty_ = true;
+  if (!arena_) {
+    str_.resize(n);
+    return;
+  }
+  reserve(n);
+  if (n > size_)
+    std::fill(&(*arena_)[offset_ + size_], &(*arena_)[offset_] + n, '\0');
+  size_ = n;
+}
+
+std::string &FieldValue::str(void) {
+  materialize();
+  dirty_ = true;
+  if (arena_) {
+    str_.assign(data(), size_);
+    arena_ = nullptr;
+    offset_ = capacity_ = size_ = 0;
+  }
+  return str_;
+}
+
+FieldValue::operator std::string(void) const {
+  return std::string(data(), size());
+}
+
+void FieldValue::materialize(void) {
+  if (!view_)
+    return;
+  // The bytes do not change, so neither does the dirty flag
+  const char *view = view_;
+  size_t n = size_;
+  store(view, n);
+}
+
+void FieldValue::attach(std::string *arena, const size_t capacity) {
+  // Owned bytes move into the new slot, bytes of an old slot are dropped
+  std::string bytes;
+  if (!arena_ && !view_)
+    bytes.swap(str_);
+  arena_ = arena;
+  offset_ = arena->size();
+  capacity_ = capacity;
+  arena->resize(offset_ + capacity_);
+  if (!view_) {
+    size_ = 0;
+    store(bytes.data(), bytes.size());
+  }
+}
+
+void FieldValue::clear(void) {
+  str_.clear();
+  arena_ = nullptr;
+  offset_ = capacity_ = 0;
+  view_ = nullptr;
+  size_ = 0;
+  dirty_ = true;
+}
+
+void FieldValue::reserve(const size_t n) {
+  if (n <= capacity_)
+    return;
+  if (offset_ + capacity_ == arena_->size()) {
+    // The last slot grows in place
+    arena_->resize(offset_ + n);
+  } else {
+    // Others move to the end, their old slot is lost until the next reset
+    size_t offset = arena_->size();
+    arena_->resize(offset + n);
+    std::copy(&(*arena_)[offset_], &(*arena_)[offset_] + size_,
+              &(*arena_)[offset]);
+    offset_ = offset;
+  }
+  capacity_ = n;
+}
+
+std::ostream &operator<<(std::ostream &os, const FieldValue &v) {
+  return os.write(v.data(), v.size());
+}
 
 Chunk::Chunk(const std::string &name)
     : size_(0), actualSize_(0), undefined_(false), variableSize_(false) {
   assert(name.size() == 4);
   name_ = name;
+  key_ = toFourCC(name_.data());
 }
 
 Chunk::Chunk(const std::string &name, const std::vector<Field> &fields)
@@ -17,32 +206,105 @@ Chunk::Chunk(const std::string &name, const std::vector<Field> &fields)
   }
 }
 
+Chunk::Chunk(const Chunk &ck)
+    : size_(ck.size_), actualSize_(ck.actualSize_), name_(ck.name_),
+      key_(ck.key_), fields_(ck.fields_), fieldKeys_(ck.fieldKeys_),
+      undefined_(ck.undefined_),
+      variableSize_(ck.variableSize_), mapping_(ck.mapping_) {
+  layout();
+}
+
+Chunk &Chunk::operator=(const Chunk &ck) {
+  if (this == &ck)
+    return *this;
+  size_ = ck.size_;
+  actualSize_ = ck.actualSize_;
+  name_ = ck.name_;
+  key_ = ck.key_;
+  fields_.clear();
+  fields_ = ck.fields_;
+  fieldKeys_ = ck.fieldKeys_;
+  undefined_ = ck.undefined_;
+  variableSize_ = ck.variableSize_;
+  mapping_ = ck.mapping_;
+  layout();
+  return *this;
+}
+
 Chunk::~Chunk(void) {}
 
 void Chunk::addField(const struct Field f) {
   if (isVariable())
     throw std::string("Last field is variable. Cannot add anymore fields.");
-  std::shared_ptr<Field> f_p = std::make_shared<Field>(f);
-  fields_.push_back(f_p);
-  fieldMap_[f.name] = f_p;
-  long overflow = size_;
-  assert(overflow + f.nBytes < MAX_CHUNK_SIZE - 4 - 4);
+  fields_.push_back(f);
+  fields_.back().val.attach(&arena_, f.nBytes);
+  fieldKeys_.push_back(fieldKey(f.name));
+  // Sizes past MAX_CHUNK_SIZE are written as RF64
   size_ += (f.nBytes);
   if (f.nBytes == 0)
     makeVariable();
 }
 
-std::shared_ptr<Chunk::Field> Chunk::getField(const std::string &fieldName) {
-  return fieldMap_[fieldName];
+size_t Chunk::indexOf(const std::string &fieldName) const {
+  // Names are only compared when their hashes match
+  uint32_t key = fieldKey(fieldName);
+  for (size_t i = 0; i < fields_.size(); i++) {
+    if (fieldKeys_[i] == key && fields_[i].name == fieldName)
+      return i;
+  }
+  return fields_.size();
+}
+
+Chunk::FieldRef Chunk::getField(const std::string &fieldName) {
+  return getField(indexOf(fieldName));
+}
+
+Chunk::ConstFieldRef Chunk::getField(const std::string &fieldName) const {
+  return getField(indexOf(fieldName));
+}
+
+const Chunk::Field *Chunk::findField(const std::string &fieldName) const {
+  size_t index = indexOf(fieldName);
+  return index < fields_.size() ? &fields_[index] : nullptr;
 }
 
-std::vector<std::shared_ptr<Chunk::Field>> Chunk::getAllFields(void) const {
-  return fields_;
+Chunk::FieldRef Chunk::getField(const size_t index) {
+  return index < fields_.size() ? FieldRef(this, index) : FieldRef();
+}
+
+Chunk::ConstFieldRef Chunk::getField(const size_t index) const {
+  return index < fields_.size() ? ConstFieldRef(this, index) : ConstFieldRef();
+}
+
+size_t Chunk::getFieldCount(void) const { return fields_.size(); }
+
+std::vector<Chunk::FieldRef> Chunk::getAllFields(void) {
+  std::vector<FieldRef> refs;
+  for (size_t i = 0; i < fields_.size(); i++)
+    refs.push_back(FieldRef(this, i));
+  return refs;
+}
+
+std::vector<Chunk::ConstFieldRef> Chunk::getAllFields(void) const {
+  std::vector<ConstFieldRef> refs;
+  for (size_t i = 0; i < fields_.size(); i++)
+    refs.push_back(ConstFieldRef(this, i));
+  return refs;
 }
 
 std::string Chunk::getChunkName(void) const { return name_; }
 
-bool Chunk::checkSize(const unsigned int size) const { return (size == size_); }
+FourCC Chunk::getFourCC(void) const { return key_; }
+
+uint32_t Chunk::fieldKey(const std::string &name) {
+  // FNV-1a
+  uint32_t h = 2166136261u;
+  for (size_t i = 0; i < name.size(); i++)
+    h = (h ^ (unsigned char)name[i]) * 16777619u;
+  return h;
+}
+
+bool Chunk::checkSize(const uint64_t size) const { return (size == size_); }
 
 void Chunk::print(void) const { std::cout << *this; }
 
@@ -55,8 +317,9 @@ std::ostream &operator<<(std::ostream &os, const Chunk &ck) {
     os << (*it)->name << " : ";
     switch ((*it)->type) {
     case F_BYTE_ARRAY: {
-      for (int i = 0; i < (*it)->val.size(); i++) {
-        os << WavData::toType<unsigned int>(std::string(&((*it)->val[i]), 1))
+      const FieldValue &val = (*it)->val;
+      for (int i = 0; i < val.size(); i++) {
+        os << WavData::toType<unsigned int>(std::string(val.data() + i, 1))
            << '-';
       }
       break;
@@ -86,17 +349,26 @@ std::ostream &operator<<(std::ostream &os, const Chunk &ck) {
 
 void Chunk::resetChunk(void) {
   actualSize_ = 0;
-  for (auto it = fields_.begin(); it != fields_.end(); it++) {
-    (*it)->val = std::string("");
-  }
+  mapping_.reset();
+  for (auto it = fields_.begin(); it != fields_.end(); it++)
+    it->val.clear();
   if (variableSize_) {
-    fields_[fields_.size() - 1]->nBytes = 0;
+    fields_[fields_.size() - 1].nBytes = 0;
   }
+  layout();
 }
 
-unsigned int Chunk::getSize(void) const { return size_; }
+void Chunk::layout(void) {
+  // The arena keeps its capacity, so reading file after file does not
+  // allocate once every chunk was read
+  arena_.clear();
+  for (auto it = fields_.begin(); it != fields_.end(); it++)
+    it->val.attach(&arena_, it->nBytes);
+}
+
+uint64_t Chunk::getSize(void) const { return size_; }
 
-unsigned int Chunk::getActualSize(void) const { return actualSize_; }
+uint64_t Chunk::getActualSize(void) const { return actualSize_; }
 
 bool Chunk::isUndefined(void) const { return undefined_; }
 
@@ -106,4 +378,54 @@ bool Chunk::isVariable(void) const { return variableSize_; }
 
 void Chunk::makeVariable(void) { variableSize_ = true; }
 
-void Chunk::addToActualSize(const unsigned int size) { actualSize_ += size; }
+void Chunk::setActualSize(const uint64_t size) { actualSize_ = size; }
+
+bool Chunk::isDirty(void) const {
+  for (auto it = fields_.begin(); it != fields_.end(); it++) {
+    if (it->val.isDirty())
+      return true;
+  }
+  return false;
+}
+
+void Chunk::markClean(void) {
+  for (auto it = fields_.begin(); it != fields_.end(); it++)
+    it->val.dirty_ = false;
+}
+
+Chunk::FieldRef::FieldRef(void) : chunk_(nullptr), index_(0) {}
+
+Chunk::FieldRef::FieldRef(std::nullptr_t) : FieldRef() {}
+
+Chunk::FieldRef::FieldRef(Chunk *chunk, const size_t index)
+    : chunk_(chunk), index_(index) {}
+
+Chunk::Field *Chunk::FieldRef::operator->(void) const {
+  return &chunk_->fields_[index_];
+}
+
+Chunk::Field &Chunk::FieldRef::operator*(void) const {
+  return chunk_->fields_[index_];
+}
+
+Chunk::FieldRef::operator bool(void) const { return chunk_ != nullptr; }
+
+Chunk::ConstFieldRef::ConstFieldRef(void) : chunk_(nullptr), index_(0) {}
+
+Chunk::ConstFieldRef::ConstFieldRef(std::nullptr_t) : ConstFieldRef() {}
+
+Chunk::ConstFieldRef::ConstFieldRef(const Chunk *chunk, const size_t index)
+    : chunk_(chunk), index_(index) {}
+
+Chunk::ConstFieldRef::ConstFieldRef(const FieldRef &ref)
+    : chunk_(ref.chunk_), index_(ref.index_) {}
+
+const Chunk::Field *Chunk::ConstFieldRef::operator->(void) const {
+  return &chunk_->fields_[index_];
+}
+
+const Chunk::Field &Chunk::ConstFieldRef::operator*(void) const {
+  return chunk_->fields_[index_];
+}
+
+Chunk::ConstFieldRef::operator bool(void) const { return chunk_ != nullptr; }
@@ -0,0 +1,16 @@
+#include "ChunkSchema.hpp"
+
+// Schemas are read at runtime by makeChunk(), so they need a definition
+constexpr FieldSchema FmtSchema::fields[];
+constexpr FieldSchema BextSchema::fields[];
+constexpr FieldSchema FactSchema::fields[];
+constexpr FieldSchema CartSchema::fields[];
+constexpr FieldSchema DataSchema::fields[];
+
+// Offsets from the specifications
+static_assert(FmtSchema::SubFormat::offset == 24, "fmt layout");
+static_assert(BextSchema::UMID::offset == 348, "bext layout");
+static_assert(BextSchema::LoudnessValue::offset == 412, "bext layout");
+static_assert(BextSchema::CodingHistory::offset == 602, "bext layout");
+static_assert(CartSchema::LevelReference::offset == 680, "cart layout");
+static_assert(CartSchema::TagText::offset == 2048, "cart layout");
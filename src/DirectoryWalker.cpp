@@ -0,0 +1,74 @@
+#include "DirectoryWalker.hpp"
+#include <dirent.h>
+#include <sys/stat.h>
+
+DirectoryWalker::DirectoryWalker(ThreadPool &pool, const FileCallback &onFile,
+                                 const ErrorCallback &onError)
+    : pool_(pool), onFile_(onFile), onError_(onError) {}
+
+void DirectoryWalker::walk(const std::string &dir) {
+  pool_.submit([this, dir](unsigned int) { walkDir(dir); });
+}
+
+void DirectoryWalker::rethrow(void) {
+  std::exception_ptr error;
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    std::swap(error, error_);
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+void DirectoryWalker::reset(void) {
+  std::lock_guard<std::mutex> lock(m_);
+  visited_.clear();
+  error_ = nullptr;
+}
+
+void DirectoryWalker::walkDir(const std::string &dir) {
+  DIR *d = nullptr;
+  // An exception would end the worker, it is kept for rethrow() instead
+  try {
+    d = opendir(dir.c_str());
+    if (!d) {
+      if (onError_)
+        onError_(dir);
+      return;
+    }
+    // Symbolic links can lead back to a directory, each one is walked once
+    struct stat st;
+    if (fstat(dirfd(d), &st) == 0) {
+      std::lock_guard<std::mutex> lock(m_);
+      if (!visited_.insert(std::make_pair(st.st_dev, st.st_ino)).second) {
+        closedir(d);
+        return;
+      }
+    }
+    struct dirent *entry;
+    while ((entry = readdir(d))) {
+      const std::string name = entry->d_name;
+      if (name == "." || name == "..")
+        continue;
+      const std::string path = dir + '/' + name;
+      bool isDir = entry->d_type == DT_DIR;
+      bool isFile = entry->d_type == DT_REG;
+      if (entry->d_type == DT_UNKNOWN || entry->d_type == DT_LNK) {
+        if (stat(path.c_str(), &st) != 0)
+          continue;
+        isDir = S_ISDIR(st.st_mode);
+        isFile = S_ISREG(st.st_mode);
+      }
+      if (isDir)
+        walk(path);
+      else if (isFile)
+        onFile_(path, name);
+    }
+  } catch (...) {
+    std::lock_guard<std::mutex> lock(m_);
+    if (!error_)
+      error_ = std::current_exception();
+  }
+  if (d)
+    closedir(d);
+}
@@ -0,0 +1,96 @@
+#include "FileCopy.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <fcntl.h>
+#include <new>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <vector>
+#ifdef __linux__
+#include <sys/sendfile.h>
+#endif
+
+// Largest request, the calls return short counts for bigger ones anyway
+#define COPY_STEP (1 << 30)
+// Buffer of the user space fallback
+#define COPY_BUFFER (1 << 20)
+
+void copyFileRange(const std::string &src, const uint64_t srcOffset,
+                   const std::string &dst, const uint64_t dstOffset,
+                   const uint64_t nBytes) {
+  int in = open(src.c_str(), O_RDONLY);
+  if (in < 0)
+    throw std::string("Could not open " + src + '\n');
+  int out = open(dst.c_str(), O_WRONLY);
+  if (out < 0) {
+    close(in);
+    throw std::string("Could not open " + dst + '\n');
+  }
+  off_t inOffset = srcOffset, outOffset = dstOffset;
+  uint64_t left = nBytes;
+  ssize_t n = 0;
+#ifdef __linux__
+  // Fails with EXDEV across filesystems before Linux 5.19 and ENOSYS before
+  // Linux 4.5, the rest is copied by the next method
+  while (left) {
+    n = copy_file_range(in, &inOffset, out, &outOffset,
+                        std::min<uint64_t>(left, COPY_STEP), 0);
+    if (n <= 0)
+      break;
+    left -= n;
+  }
+  if (left && n < 0 && lseek(out, outOffset, SEEK_SET) == outOffset) {
+    while (left) {
+      n = sendfile(out, in, &inOffset, std::min<uint64_t>(left, COPY_STEP));
+      if (n <= 0)
+        break;
+      left -= n;
+      outOffset += n;
+    }
+  }
+#endif
+  if (left && n < 0) {
+    std::vector<char> buffer(COPY_BUFFER);
+    while (left) {
+      n = pread(in, &buffer[0], std::min<uint64_t>(left, COPY_BUFFER),
+                inOffset);
+      if (n <= 0 || pwrite(out, &buffer[0], n, outOffset) != n)
+        break;
+      left -= n;
+      inOffset += n;
+      outOffset += n;
+    }
+  }
+  close(in);
+  if (close(out) < 0 || left)
+    throw std::string("Could not copy " + src + " to " + dst + '\n');
+}
+
+bool isSameFile(const std::string &a, const std::string &b) {
+  struct stat sa, sb;
+  if (stat(a.c_str(), &sa) < 0 || stat(b.c_str(), &sb) < 0)
+    return false;
+  return sa.st_dev == sb.st_dev && sa.st_ino == sb.st_ino;
+}
+
+uint64_t fileSize(const std::string &fn) {
+  struct stat st;
+  return stat(fn.c_str(), &st) < 0 ? 0 : st.st_size;
+}
+
+int openDirect(const std::string &fn, const int flags) {
+#ifdef O_DIRECT
+  return open(fn.c_str(), flags | O_DIRECT);
+#else
+  (void)fn;
+  (void)flags;
+  return -1;
+#endif
+}
+
+std::unique_ptr<char, void (*)(void *)> allocDirect(const size_t size) {
+  void *p = nullptr;
+  if (posix_memalign(&p, DIRECT_ALIGNMENT, size) != 0)
+    throw std::bad_alloc();
+  return std::unique_ptr<char, void (*)(void *)>(static_cast<char *>(p), free);
+}
@@ -0,0 +1,186 @@
+#include "FrameReader.hpp"
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Raw bytes decoded at once, on the stack of the reading thread. It holds at
+// least one frame since BlockAlign is 16-bit.
+#define DECODE_BLOCK (1 << 16)
+// Largest O_DIRECT read through the aligned buffer
+#define DIRECT_READ (1 << 20)
+
+FrameReader::FrameReader(const std::string &fn, const bool direct)
+    : fd_(-1), direct_(false), offset_(0), frameCount_(0), sampleRate_(0),
+      blockAlign_(0), samplesPerFrame_(0), bounce_(nullptr, free) {
+  WavData wav;
+  wav.read(fn, READ_LAZY);
+  open(fn, wav, direct);
+}
+
+FrameReader::FrameReader(const std::string &fn, WavData &wav,
+                         const bool direct)
+    : fd_(-1), direct_(false), offset_(0), frameCount_(0), sampleRate_(0),
+      blockAlign_(0), samplesPerFrame_(0), bounce_(nullptr, free) {
+  open(fn, wav, direct);
+}
+
+void FrameReader::open(const std::string &fn, WavData &wav,
+                       const bool direct) {
+  auto directory = wav.getChunkDirectory();
+  const WavData::ChunkEntry *data = nullptr;
+  for (auto it = directory.begin(); it != directory.end(); it++) {
+    if (it->id == "data")
+      data = &*it;
+  }
+  if (!data)
+    throw std::string("No data chunk in " + fn + '\n');
+  sampleRate_ = wav.get<FmtSchema::SamplesPerSec>();
+  blockAlign_ = wav.get<FmtSchema::BlockAlign>();
+  if (blockAlign_ == 0)
+    throw std::string("Invalid BlockAlign in " + fn + '\n');
+  SampleType type = SampleConverter::getSampleType(wav);
+  if (type != S_NDEF) {
+    converter_.reset(new SampleConverter(type));
+    samplesPerFrame_ = blockAlign_ / converter_->getSampleSize();
+    // Padded frames cannot be decoded as a block of samples
+    if (samplesPerFrame_ * converter_->getSampleSize() != blockAlign_) {
+      converter_.reset();
+      samplesPerFrame_ = 0;
+    }
+  }
+  // A truncated data chunk ends with the file
+  offset_ = data->offset;
+  uint64_t size = fileSize(fn);
+  size = offset_ < size ? std::min(data->size, size - offset_) : 0;
+  frameCount_ = size / blockAlign_;
+
+  if (direct)
+    fd_ = openDirect(fn, O_RDONLY);
+  direct_ = fd_ >= 0;
+  if (!direct_)
+    fd_ = ::open(fn.c_str(), O_RDONLY);
+  if (fd_ < 0)
+    throw std::string("Could not open " + fn + '\n');
+}
+
+FrameReader::~FrameReader(void) { close(fd_); }
+
+size_t FrameReader::readRaw(const uint64_t frame, const size_t nFrames,
+                            char *dst) const {
+  if (frame >= frameCount_)
+    return 0;
+  size_t n = std::min<uint64_t>(nFrames, frameCount_ - frame);
+  uint64_t offset = offset_ + frame * blockAlign_;
+  size_t left = n * blockAlign_;
+  if (direct_) {
+    readDirect(offset, left, dst);
+    return n;
+  }
+  // pread does not move a shared file position, so threads never interfere
+  while (left != 0) {
+    ssize_t r = pread(fd_, dst, left, offset);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      throw std::string("Could not read frames\n");
+    dst += r;
+    offset += r;
+    left -= r;
+  }
+  return n;
+}
+
+void FrameReader::readDirect(uint64_t offset, size_t nBytes,
+                             char *dst) const {
+  const uint64_t mask = DIRECT_ALIGNMENT - 1;
+  // The buffer of the reader is used unless another thread holds it, a
+  // reader that has one thread, like the one of a StreamReader, allocates once
+  std::unique_lock<std::mutex> lock(bounceMutex_, std::defer_lock);
+  std::unique_ptr<char, void (*)(void *)> own(nullptr, free);
+  char *buffer = nullptr;
+  while (nBytes != 0) {
+    // Aligned requests are read in place, the others are read in aligned
+    // blocks that cover them and copied
+    bool inPlace = ((offset | nBytes | (uintptr_t)dst) & mask) == 0;
+    uint64_t start = offset & ~mask;
+    size_t size = inPlace ? nBytes
+                          : std::min<uint64_t>(
+                                (offset + nBytes - start + mask) & ~mask,
+                                DIRECT_READ);
+    if (!inPlace && !buffer && lock.try_lock()) {
+      if (!bounce_)
+        bounce_ = allocDirect(DIRECT_READ);
+      buffer = bounce_.get();
+    } else if (!inPlace && !buffer) {
+      // Later blocks are never larger than the first one
+      own = allocDirect(size);
+      buffer = own.get();
+    }
+    char *p = inPlace ? dst : buffer;
+    ssize_t r = pread(fd_, p, size, start);
+    if (r < 0 && errno == EINTR)
+      continue;
+    // The end of the file may cut the last block short
+    if (r <= (ssize_t)(offset - start))
+      throw std::string("Could not read frames\n");
+    size_t n = std::min<size_t>(r - (offset - start), nBytes);
+    if (!inPlace)
+      std::memcpy(dst, p + (offset - start), n);
+    dst += n;
+    offset += n;
+    nBytes -= n;
+  }
+}
+
+template <typename T>
+size_t FrameReader::decode(const uint64_t frame, const size_t nFrames,
+                           T *dst) const {
+  if (!converter_)
+    throw std::string("Samples of that format cannot be converted\n");
+  char raw[DECODE_BLOCK];
+  const size_t block = DECODE_BLOCK / blockAlign_;
+  size_t done = 0;
+  while (done < nFrames) {
+    size_t n = readRaw(frame + done, std::min(block, nFrames - done), raw);
+    if (n == 0)
+      break;
+    converter_->decode(raw, dst, n * samplesPerFrame_);
+    dst += n * samplesPerFrame_;
+    done += n;
+  }
+  return done;
+}
+
+size_t FrameReader::read(const uint64_t frame, const size_t nFrames,
+                         float *dst) const {
+  return decode(frame, nFrames, dst);
+}
+
+size_t FrameReader::read(const uint64_t frame, const size_t nFrames,
+                         int32_t *dst) const {
+  return decode(frame, nFrames, dst);
+}
+
+uint64_t FrameReader::frameAt(const double seconds) const {
+  return seconds <= 0 ? 0 : (uint64_t)(seconds * sampleRate_);
+}
+
+uint64_t FrameReader::getFrameCount(void) const { return frameCount_; }
+
+unsigned int FrameReader::getSampleRate(void) const { return sampleRate_; }
+
+unsigned int FrameReader::getBlockAlign(void) const { return blockAlign_; }
+
+unsigned int FrameReader::getSamplesPerFrame(void) const {
+  return samplesPerFrame_;
+}
+
+SampleType FrameReader::getSampleType(void) const {
+  return converter_ ? converter_->getSampleType() : S_NDEF;
+}
+
+uint64_t FrameReader::getDataOffset(void) const { return offset_; }
+
+bool FrameReader::isDirect(void) const { return direct_; }
@@ -0,0 +1,325 @@
+#include "LoudnessMeter.hpp"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+#define PI 3.14159265358979323846
+
+// Blocks of 100 ms, gating blocks of 400 ms and short-term windows of 3 s
+#define MOMENTARY_BLOCKS 4
+#define SHORT_TERM_BLOCKS 30
+// Gates in LUFS and LU (BS.1770-4, EBU Tech 3342)
+#define ABSOLUTE_GATE -70.0
+#define INTEGRATED_GATE -10.0
+#define RANGE_GATE -20.0
+// Histogram bins of 0.01 LU from the absolute gate up to +30 LUFS
+#define HISTOGRAM_STEP 0.01
+#define HISTOGRAM_BINS 10000
+// Taps of each phase of the true-peak filter
+#define TAPS_PER_PHASE 12
+// Frames decoded at once by measure()
+#define MEASURE_FRAMES (1 << 16)
+// bext value for a loudness that is not available
+#define BEXT_NOT_AVAILABLE 0x7fff
+
+static double loudnessOf(const double energy) {
+  return energy > 0 ? -0.691 + 10 * std::log10(energy)
+                    : -std::numeric_limits<double>::infinity();
+}
+
+// Direct form II transposed, k holds b0 b1 b2 a1 a2
+static inline double biquad(const double *k, double *s, const double x) {
+  double y = k[0] * x + s[0];
+  s[0] = k[1] * x - k[3] * y + s[1];
+  s[1] = k[2] * x - k[4] * y;
+  return y;
+}
+
+LoudnessMeter::LoudnessMeter(const unsigned int sampleRate,
+                             const unsigned int channels,
+                             const unsigned int nThreads)
+    : sampleRate_(sampleRate), channels_(channels), weights_(channels, 1.0),
+      channelState_(channels), blockFrames_((sampleRate + 5) / 10),
+      blockFill_(0), blockEnergy_(0),
+      maxMomentary_(-std::numeric_limits<double>::infinity()),
+      maxShortTerm_(-std::numeric_limits<double>::infinity()) {
+  if (sampleRate == 0 || channels == 0)
+    throw std::string("Invalid sample rate or channel count\n");
+  if (channels == 6) {
+    weights_[3] = 0.0;
+    weights_[4] = weights_[5] = 1.41;
+  }
+  if (nThreads != 1 && channels > 1)
+    pool_.reset(new ThreadPool(nThreads));
+
+  // K-weighting, a high shelf then a high-pass filter (BS.1770-4)
+  double f0 = 1681.974450955533, g = 3.999843853973347,
+         q = 0.7071752369554196;
+  double k = std::tan(PI * f0 / sampleRate);
+  double vh = std::pow(10.0, g / 20.0), vb = std::pow(vh, 0.4996667741545416);
+  double a0 = 1.0 + k / q + k * k;
+  pre_[0] = (vh + vb * k / q + k * k) / a0;
+  pre_[1] = 2.0 * (k * k - vh) / a0;
+  pre_[2] = (vh - vb * k / q + k * k) / a0;
+  pre_[3] = 2.0 * (k * k - 1.0) / a0;
+  pre_[4] = (1.0 - k / q + k * k) / a0;
+  f0 = 38.13547087602444;
+  q = 0.5003270373238773;
+  k = std::tan(PI * f0 / sampleRate);
+  a0 = 1.0 + k / q + k * k;
+  rlb_[0] = 1.0;
+  rlb_[1] = -2.0;
+  rlb_[2] = 1.0;
+  rlb_[3] = 2.0 * (k * k - 1.0) / a0;
+  rlb_[4] = (1.0 - k / q + k * k) / a0;
+
+  // True peak on 4 times oversampled signals below 96 kHz, 2 times below
+  // 192 kHz. The interpolator is a Hann windowed sinc split in phases.
+  oversampling_ = sampleRate < 96000 ? 4 : sampleRate < 192000 ? 2 : 1;
+  nTaps_ = oversampling_ == 1 ? 1 : TAPS_PER_PHASE;
+  taps_.resize(oversampling_ * nTaps_);
+  const unsigned int n = oversampling_ * nTaps_;
+  for (unsigned int p = 0; p < oversampling_; p++) {
+    double sum = 0;
+    for (unsigned int j = 0; j < nTaps_; j++) {
+      unsigned int i = j * oversampling_ + p;
+      double x = (i - (n - 1) / 2.0) / oversampling_;
+      double h = x == 0 ? 1.0 : std::sin(PI * x) / (PI * x);
+      if (n > 1)
+        h *= 0.5 - 0.5 * std::cos(2 * PI * (i + 0.5) / n);
+      // Newest sample last, as the kernel reads them
+      taps_[p * nTaps_ + nTaps_ - 1 - j] = h;
+      sum += h;
+    }
+    for (unsigned int j = 0; j < nTaps_; j++)
+      taps_[p * nTaps_ + j] /= sum;
+  }
+  firPeak_ = getFirPeakKernel(detectSimdLevel());
+  for (auto it = channelState_.begin(); it != channelState_.end(); it++) {
+    it->pre[0] = it->pre[1] = it->rlb[0] = it->rlb[1] = 0;
+    it->buffer.assign(nTaps_ - 1, 0.0f);
+    it->peak = 0.0f;
+  }
+
+  momentary_.count.assign(HISTOGRAM_BINS, 0);
+  momentary_.energy.assign(HISTOGRAM_BINS, 0);
+  shortTerm_ = momentary_;
+}
+
+LoudnessMeter::~LoudnessMeter(void) {}
+
+void LoudnessMeter::setChannelWeight(const unsigned int channel,
+                                     const double weight) {
+  if (channel >= channels_)
+    throw std::string("No such channel\n");
+  weights_[channel] = weight;
+}
+
+void LoudnessMeter::filter(const unsigned int c, const float *frames,
+                           const size_t nFrames,
+                           const std::vector<size_t> &ends, double *energy) {
+  Channel &ch = channelState_[c];
+  // The history of the true-peak filter comes first
+  const size_t history = nTaps_ - 1;
+  ch.buffer.resize(history + nFrames);
+  float *x = ch.buffer.data() + history;
+  for (size_t i = 0; i < nFrames; i++)
+    x[i] = frames[i * channels_ + c];
+
+  size_t i = 0;
+  for (size_t s = 0; s < ends.size(); s++) {
+    double sum = 0;
+    for (; i < ends[s]; i++) {
+      double y = biquad(rlb_, ch.rlb, biquad(pre_, ch.pre, x[i]));
+      sum += y * y;
+    }
+    energy[s] = sum;
+    // Decaying states would end up as slow denormals after the signal
+    for (int j = 0; j < 2; j++) {
+      if (std::fabs(ch.pre[j]) < 1e-30)
+        ch.pre[j] = 0;
+      if (std::fabs(ch.rlb[j]) < 1e-30)
+        ch.rlb[j] = 0;
+    }
+  }
+
+  for (unsigned int p = 0; p < oversampling_; p++)
+    ch.peak = std::max(ch.peak, firPeak_(ch.buffer.data(), nFrames,
+                                         &taps_[p * nTaps_], nTaps_));
+  std::copy(ch.buffer.end() - history, ch.buffer.end(), ch.buffer.begin());
+  ch.buffer.resize(history);
+}
+
+void LoudnessMeter::process(const float *frames, const size_t nFrames) {
+  // Segments end where the 100 ms blocks end
+  std::vector<size_t> ends;
+  for (size_t end = blockFrames_ - blockFill_; end < nFrames;
+       end += blockFrames_)
+    ends.push_back(end);
+  ends.push_back(nFrames);
+  const size_t nSegments = ends.size();
+  std::vector<double> energy(channels_ * nSegments);
+
+  if (pool_) {
+    for (unsigned int c = 0; c < channels_; c++)
+      pool_->submit([this, c, frames, nFrames, &ends, &energy](unsigned int) {
+        filter(c, frames, nFrames, ends, &energy[c * ends.size()]);
+      });
+    pool_->wait();
+  } else {
+    for (unsigned int c = 0; c < channels_; c++)
+      filter(c, frames, nFrames, ends, &energy[c * nSegments]);
+  }
+
+  size_t start = 0;
+  for (size_t s = 0; s < nSegments; s++) {
+    for (unsigned int c = 0; c < channels_; c++)
+      blockEnergy_ += weights_[c] * energy[c * nSegments + s];
+    blockFill_ += ends[s] - start;
+    start = ends[s];
+    if (blockFill_ == blockFrames_)
+      endBlock();
+  }
+}
+
+void LoudnessMeter::endBlock(void) {
+  blocks_.push_back(blockEnergy_ / blockFrames_);
+  if (blocks_.size() > SHORT_TERM_BLOCKS)
+    blocks_.pop_front();
+  blockEnergy_ = 0;
+  blockFill_ = 0;
+
+  // Gating blocks overlap by 75 %, short-term windows are updated at 10 Hz
+  if (blocks_.size() >= MOMENTARY_BLOCKS) {
+    double e = 0;
+    for (auto it = blocks_.end() - MOMENTARY_BLOCKS; it != blocks_.end(); it++)
+      e += *it;
+    e /= MOMENTARY_BLOCKS;
+    maxMomentary_ = std::max(maxMomentary_, loudnessOf(e));
+    add(momentary_, e);
+  }
+  if (blocks_.size() == SHORT_TERM_BLOCKS) {
+    double e = 0;
+    for (auto it = blocks_.begin(); it != blocks_.end(); it++)
+      e += *it;
+    e /= SHORT_TERM_BLOCKS;
+    maxShortTerm_ = std::max(maxShortTerm_, loudnessOf(e));
+    add(shortTerm_, e);
+  }
+}
+
+void LoudnessMeter::add(Histogram &h, const double energy) {
+  double l = loudnessOf(energy);
+  if (!(l > ABSOLUTE_GATE))
+    return;
+  size_t bin = std::min<double>((l - ABSOLUTE_GATE) / HISTOGRAM_STEP,
+                                HISTOGRAM_BINS - 1);
+  h.count[bin]++;
+  h.energy[bin] += energy;
+}
+
+double LoudnessMeter::gatedMean(const Histogram &h, const double relativeGate,
+                                uint64_t &count, size_t &first) {
+  double sum = 0;
+  count = 0;
+  for (size_t i = 0; i < HISTOGRAM_BINS; i++) {
+    count += h.count[i];
+    sum += h.energy[i];
+  }
+  first = HISTOGRAM_BINS;
+  if (count == 0)
+    return 0;
+  // Bins that are entirely above the relative gate
+  double gate = loudnessOf(sum / count) + relativeGate;
+  first = (size_t)std::min<double>(
+      std::max(0.0, std::ceil((gate - ABSOLUTE_GATE) / HISTOGRAM_STEP)),
+      HISTOGRAM_BINS);
+  sum = 0;
+  count = 0;
+  for (size_t i = first; i < HISTOGRAM_BINS; i++) {
+    count += h.count[i];
+    sum += h.energy[i];
+  }
+  return count ? sum / count : 0;
+}
+
+Loudness LoudnessMeter::getLoudness(void) const {
+  const double none = -std::numeric_limits<double>::infinity();
+  Loudness l;
+  uint64_t count;
+  size_t first;
+  double e = gatedMean(momentary_, INTEGRATED_GATE, count, first);
+  l.integrated = count ? loudnessOf(e) : none;
+
+  // Loudness range, from the 10th to the 95th percentile of the gated
+  // short-term loudness
+  gatedMean(shortTerm_, RANGE_GATE, count, first);
+  l.range = none;
+  if (count) {
+    const uint64_t low = (uint64_t)((count - 1) * 0.10 + 0.5),
+                   high = (uint64_t)((count - 1) * 0.95 + 0.5);
+    double lowL = 0, highL = 0;
+    uint64_t seen = 0;
+    for (size_t i = first; i < HISTOGRAM_BINS; i++) {
+      double center = ABSOLUTE_GATE + (i + 0.5) * HISTOGRAM_STEP;
+      if (seen <= low && low < seen + shortTerm_.count[i])
+        lowL = center;
+      if (seen <= high && high < seen + shortTerm_.count[i]) {
+        highL = center;
+        break;
+      }
+      seen += shortTerm_.count[i];
+    }
+    l.range = highL - lowL;
+  }
+
+  l.maxMomentary = maxMomentary_;
+  l.maxShortTerm = maxShortTerm_;
+  float peak = 0;
+  for (auto it = channelState_.begin(); it != channelState_.end(); it++)
+    peak = std::max(peak, it->peak);
+  l.truePeak = peak > 0 ? 20 * std::log10(peak) : none;
+  return l;
+}
+
+Loudness LoudnessMeter::measure(const FrameReader &reader,
+                                const unsigned int nThreads) {
+  if (reader.getSamplesPerFrame() == 0)
+    throw std::string("Samples of that format cannot be converted\n");
+  LoudnessMeter meter(reader.getSampleRate(), reader.getSamplesPerFrame(),
+                      nThreads);
+  std::vector<float> samples((size_t)MEASURE_FRAMES *
+                             reader.getSamplesPerFrame());
+  for (uint64_t frame = 0; frame < reader.getFrameCount();) {
+    size_t n = reader.read(frame, MEASURE_FRAMES, samples.data());
+    if (n == 0)
+      throw std::string("Could not read frames\n");
+    meter.process(samples.data(), n);
+    frame += n;
+  }
+  return meter.getLoudness();
+}
+
+// Hundredths that fit in the field, the maximum means not available
+static int16_t bextValue(const double v) {
+  double r = std::round(v * 100);
+  if (!std::isfinite(r) || r < -32768 || r >= BEXT_NOT_AVAILABLE)
+    return BEXT_NOT_AVAILABLE;
+  return (int16_t)r;
+}
+
+void LoudnessMeter::writeBext(const Loudness &loudness, WavData &wav) {
+  std::shared_ptr<Chunk> bext = wav.getChunk(toFourCC("bext"));
+  if (!bext)
+    throw std::string("No bext chunk\n");
+  bext->set<BextSchema::LoudnessValue>(bextValue(loudness.integrated));
+  bext->set<BextSchema::LoudnessRange>(bextValue(loudness.range));
+  bext->set<BextSchema::MaxTruePeakLevel>(bextValue(loudness.truePeak));
+  bext->set<BextSchema::MaxMomentaryLoudness>(
+      bextValue(loudness.maxMomentary));
+  bext->set<BextSchema::MaxShortTermLoudness>(
+      bextValue(loudness.maxShortTerm));
+  // The loudness fields were added in version 2
+  if (bext->get<BextSchema::Version>() < 2)
+    bext->set<BextSchema::Version>(2);
+}
@@ -0,0 +1,43 @@
+#include "MappedFile.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::MappedFile(const std::string &fn)
+    : addr_(nullptr), size_(0), owned_(true) {
+  int fd = open(fn.c_str(), O_RDONLY);
+  if (fd < 0)
+    throw std::string("Could not open " + fn + '\n');
+  struct stat st;
+  if (fstat(fd, &st) < 0) {
+    close(fd);
+    throw std::string("Could not stat " + fn + '\n');
+  }
+  size_ = st.st_size;
+  // mmap refuses empty mappings, an empty file is simply an empty view
+  if (size_ != 0) {
+    addr_ = mmap(nullptr, size_, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (addr_ == MAP_FAILED) {
+      addr_ = nullptr;
+      close(fd);
+      throw std::string("Could not map " + fn + '\n');
+    }
+  }
+  // The mapping stays valid once the descriptor is closed
+  close(fd);
+}
+
+MappedFile::MappedFile(const char *data, const size_t size)
+    : addr_(const_cast<char *>(data)), size_(size), owned_(false) {}
+
+MappedFile::~MappedFile(void) {
+  if (addr_ && owned_)
+    munmap(addr_, size_);
+}
+
+const char *MappedFile::data(void) const {
+  return static_cast<const char *>(addr_);
+}
+
+size_t MappedFile::size(void) const { return size_; }
@@ -0,0 +1,473 @@
+#include "MetadataIndex.hpp"
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define INDEX_MAGIC "WAVINDEX"
+#define INDEX_VERSION 1
+// Size of a missing value
+#define INDEX_ABSENT UINT64_MAX
+
+/*
+ * Layout of an index, every section 8-byte aligned: the header, the names of
+ * the fields, one record per file in path order, nFields values per record,
+ * the chunk directories of all files, then the bytes of the strings.
+ */
+
+struct MetadataIndex::Header {
+  char magic[8];
+  uint32_t version;
+  uint32_t nFields;
+  uint64_t nEntries;
+  uint64_t nChunks;
+  uint64_t stringsSize;
+};
+
+struct MetadataIndex::StrRef {
+  uint64_t offset;
+  uint64_t size;
+};
+
+struct MetadataIndex::Record {
+  FileIdentity identity;
+  StrRef path;
+  StrRef error;
+  uint64_t firstChunk;
+  uint64_t nChunks;
+};
+
+struct MetadataIndex::ChunkRecord {
+  char id[ID_SIZE];
+  uint32_t reserved;
+  uint64_t offset;
+  uint64_t size;
+};
+
+// File of an update, with its entry if it was parsed again
+struct MetadataIndex::Parsed {
+  std::string path;
+  FileIdentity identity;
+  size_t old; // Position of the unchanged entry, or nEntries_
+  std::vector<WavData::ChunkEntry> directory;
+  std::vector<std::string> values;
+  std::vector<bool> found;
+  std::string error;
+};
+
+// Appends entries to the sections of a new index
+class MetadataIndex::Builder {
+public:
+  Builder(const std::vector<BatchScanner::FieldSpec> &fields) {
+    for (auto it = fields.begin(); it != fields.end(); it++)
+      names_.push_back(add(it->name));
+  }
+
+  StrRef add(const std::string &s) {
+    StrRef ref = {strings_.size(), s.size()};
+    strings_ += s;
+    return ref;
+  }
+
+  void addEntry(const std::string &path, const FileIdentity &identity,
+                const std::vector<WavData::ChunkEntry> &directory,
+                const std::vector<std::string> &values,
+                const std::vector<bool> &found, const std::string &error) {
+    Record r = {identity, add(path), add(error), chunks_.size(),
+                directory.size()};
+    records_.push_back(r);
+    for (auto it = directory.begin(); it != directory.end(); it++) {
+      ChunkRecord ck;
+      memcpy(ck.id, it->id.data(), ID_SIZE);
+      ck.reserved = 0;
+      ck.offset = it->offset;
+      ck.size = it->size;
+      chunks_.push_back(ck);
+    }
+    for (size_t i = 0; i < values.size(); i++) {
+      StrRef ref = {0, INDEX_ABSENT};
+      values_.push_back(found[i] ? add(values[i]) : ref);
+    }
+  }
+
+  std::string image(void) const {
+    Header h;
+    memcpy(h.magic, INDEX_MAGIC, sizeof(h.magic));
+    h.version = INDEX_VERSION;
+    h.nFields = names_.size();
+    h.nEntries = records_.size();
+    h.nChunks = chunks_.size();
+    h.stringsSize = strings_.size();
+    std::string out(reinterpret_cast<const char *>(&h), sizeof(h));
+    append(out, names_);
+    append(out, records_);
+    append(out, values_);
+    append(out, chunks_);
+    return out + strings_;
+  }
+
+private:
+  template <typename T>
+  static void append(std::string &out, const std::vector<T> &v) {
+    out.append(reinterpret_cast<const char *>(v.data()), v.size() * sizeof(T));
+  }
+
+  std::vector<StrRef> names_;
+  std::vector<Record> records_;
+  std::vector<StrRef> values_;
+  std::vector<ChunkRecord> chunks_;
+  std::string strings_;
+};
+
+static bool sameIdentity(const FileIdentity &a, const FileIdentity &b) {
+  return a.device == b.device && a.inode == b.inode && a.size == b.size &&
+         a.mtime == b.mtime;
+}
+
+MetadataIndex::MetadataIndex(const std::vector<std::string> &fields,
+                             unsigned int nThreads)
+    : pool_(nThreads),
+      walker_(pool_, [this](const std::string &path, const std::string &name) {
+        addFile(path, name);
+      }) {
+  for (auto it = fields.begin(); it != fields.end(); it++)
+    fields_.push_back(BatchScanner::parseField(*it));
+  for (unsigned int i = 0; i < pool_.size(); i++)
+    parsers_.push_back(std::unique_ptr<WavData>(new WavData()));
+  image_ = Builder(fields_).image();
+  attach(image_.data(), image_.size());
+}
+
+MetadataIndex::~MetadataIndex(void) {}
+
+void MetadataIndex::attach(const char *data, const size_t size) {
+  Header h;
+  if (size < sizeof(h))
+    throw std::string("Truncated index\n");
+  memcpy(&h, data, sizeof(h));
+  // Sections are checked against the size so that no access goes past it
+  uint64_t offset = sizeof(h) + h.nFields * sizeof(StrRef);
+  const uint64_t records = offset;
+  offset += h.nEntries * sizeof(Record);
+  const uint64_t values = offset;
+  offset += h.nEntries * h.nFields * sizeof(StrRef);
+  const uint64_t chunks = offset;
+  offset += h.nChunks * sizeof(ChunkRecord);
+  if (h.nEntries > size || h.nChunks > size || offset > size ||
+      size - offset != h.stringsSize)
+    throw std::string("Truncated index\n");
+  data_ = data;
+  size_ = size;
+  records_ = reinterpret_cast<const Record *>(data + records);
+  values_ = reinterpret_cast<const StrRef *>(data + values);
+  chunks_ = reinterpret_cast<const ChunkRecord *>(data + chunks);
+  strings_ = data + offset;
+  nEntries_ = h.nEntries;
+  nChunks_ = h.nChunks;
+  stringsSize_ = h.stringsSize;
+}
+
+bool MetadataIndex::load(const std::string &fn) {
+  struct stat st;
+  if (stat(fn.c_str(), &st) != 0)
+    return false;
+  std::unique_ptr<MappedFile> file(new MappedFile(fn));
+  Header h;
+  if (file->size() < sizeof(h))
+    return false;
+  memcpy(&h, file->data(), sizeof(h));
+  if (memcmp(h.magic, INDEX_MAGIC, sizeof(h.magic)) ||
+      h.version != INDEX_VERSION || h.nFields != fields_.size())
+    return false;
+
+  // A truncated index or one of other fields leaves this one as it was
+  std::unique_ptr<MappedFile> previous(std::move(file_));
+  const char *data = data_;
+  const size_t size = size_;
+  file_ = std::move(file);
+  bool same = true;
+  try {
+    attach(file_->data(), file_->size());
+    const StrRef *names =
+        reinterpret_cast<const StrRef *>(file_->data() + sizeof(h));
+    for (size_t i = 0; i < fields_.size() && same; i++)
+      same = str(names[i]) == fields_[i].name;
+  } catch (const std::string &) {
+    same = false;
+  }
+  if (!same) {
+    file_ = std::move(previous);
+    attach(data, size);
+    return false;
+  }
+  image_.clear();
+  return true;
+}
+
+size_t MetadataIndex::update(const std::vector<std::string> &paths) {
+  found_.clear();
+  walker_.reset();
+  for (auto it = paths.begin(); it != paths.end(); it++) {
+    std::string path = *it;
+    while (path.size() > 1 && path.back() == '/')
+      path.pop_back();
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0 && S_ISDIR(st.st_mode)) {
+      walker_.walk(path);
+    } else {
+      // Files given explicitly are indexed whatever their extension
+      FileIdentity identity;
+      if (!identify(path, identity))
+        continue;
+      std::lock_guard<std::mutex> lock(walkMutex_);
+      found_.push_back(std::make_pair(path, identity));
+    }
+  }
+  pool_.wait();
+  try {
+    walker_.rethrow();
+  } catch (...) {
+    found_.clear();
+    throw;
+  }
+  std::sort(found_.begin(), found_.end(),
+            [](const std::pair<std::string, FileIdentity> &a,
+               const std::pair<std::string, FileIdentity> &b) {
+              return a.first < b.first;
+            });
+
+  // Only new and changed files are parsed
+  std::vector<Parsed> files(found_.size());
+  size_t nParsed = 0;
+  for (size_t i = 0; i < files.size(); i++) {
+    Parsed &parsed = files[i];
+    if (i > 0 && found_[i].first == found_[i - 1].first) {
+      parsed.old = nEntries_;
+      continue;
+    }
+    parsed.path = found_[i].first;
+    parsed.identity = found_[i].second;
+    parsed.old = lowerBound(parsed.path);
+    if (parsed.old < nEntries_ &&
+        compare(records_[parsed.old].path, parsed.path) == 0 &&
+        sameIdentity(records_[parsed.old].identity, parsed.identity))
+      continue;
+    parsed.old = nEntries_;
+    nParsed++;
+    pool_.submit([this, &parsed](unsigned int worker) {
+      // An exception would end the worker, it is rethrown below instead
+      try {
+        parse(parsed, worker);
+      } catch (...) {
+        std::lock_guard<std::mutex> lock(walkMutex_);
+        if (!error_)
+          error_ = std::current_exception();
+      }
+    });
+  }
+  pool_.wait();
+  if (error_) {
+    std::exception_ptr error = error_;
+    error_ = nullptr;
+    found_.clear();
+    std::rethrow_exception(error);
+  }
+
+  Builder builder(fields_);
+  for (auto it = files.begin(); it != files.end(); it++) {
+    if (it->path.empty())
+      continue;
+    if (it->old == nEntries_) {
+      builder.addEntry(it->path, it->identity, it->directory, it->values,
+                       it->found, it->error);
+      continue;
+    }
+    IndexEntry entry = getEntry(it->old);
+    builder.addEntry(entry.path, entry.identity, entry.directory, entry.values,
+                     entry.found, entry.error);
+  }
+  found_.clear();
+  image_ = builder.image();
+  attach(image_.data(), image_.size());
+  file_.reset();
+  return nParsed;
+}
+
+void MetadataIndex::addFile(const std::string &path, const std::string &name) {
+  FileIdentity identity;
+  if (!BatchScanner::isWavFile(name) || !identify(path, identity))
+    return;
+  std::lock_guard<std::mutex> lock(walkMutex_);
+  found_.push_back(std::make_pair(path, identity));
+}
+
+void MetadataIndex::parse(Parsed &parsed, const unsigned int worker) {
+  std::vector<BatchScanner::Value> values;
+  // Files that cannot be parsed keep their error until they change
+  parsed.error = BatchScanner::extractFields(
+      *parsers_[worker], parsed.path, fields_, parsed.directory, values);
+  parsed.values.clear();
+  parsed.found.clear();
+  for (auto it = values.begin(); it != values.end(); it++) {
+    parsed.values.push_back(it->text);
+    parsed.found.push_back(it->found);
+  }
+}
+
+void MetadataIndex::save(const std::string &fn) const {
+  // A unique temporary file next to the index, so that processes saving the
+  // same index at once do not write into each other's
+  std::string tmp = fn + ".XXXXXX";
+  int fd = mkstemp(&tmp[0]);
+  if (fd < 0)
+    throw std::string("Could not create a temporary file for " + fn + '\n');
+  // mkstemp creates it for the owner only, the index keeps the usual mode
+  struct stat st;
+  fchmod(fd, stat(fn.c_str(), &st) == 0 ? st.st_mode & 07777 : 0644);
+  bool written = true;
+  for (size_t done = 0; written && done < size_;) {
+    ssize_t r = write(fd, data_ + done, size_ - done);
+    if (r < 0 && errno == EINTR)
+      continue;
+    written = r > 0;
+    done += written ? r : 0;
+  }
+  // The data is on disk before the rename makes it the index
+  written = written && fsync(fd) == 0;
+  written = close(fd) == 0 && written;
+  if (!written || rename(tmp.c_str(), fn.c_str()) != 0) {
+    unlink(tmp.c_str());
+    throw std::string("Could not write " + fn + '\n');
+  }
+}
+
+size_t MetadataIndex::size(void) const { return nEntries_; }
+
+IndexEntry MetadataIndex::getEntry(const size_t i) const {
+  if (i >= nEntries_)
+    throw std::string("No such entry\n");
+  const Record &r = records_[i];
+  IndexEntry entry;
+  entry.path = str(r.path);
+  entry.identity = r.identity;
+  entry.error = str(r.error);
+  if (r.firstChunk > nChunks_ || r.nChunks > nChunks_ - r.firstChunk)
+    throw std::string("Corrupted index\n");
+  for (uint64_t k = r.firstChunk; k < r.firstChunk + r.nChunks; k++) {
+    WavData::ChunkEntry ck = {std::string(chunks_[k].id, ID_SIZE),
+                              chunks_[k].offset, chunks_[k].size, false};
+    entry.directory.push_back(ck);
+  }
+  const StrRef *v = values(i);
+  for (size_t f = 0; f < fields_.size(); f++) {
+    const bool found = v[f].size != INDEX_ABSENT;
+    entry.found.push_back(found);
+    entry.values.push_back(found ? str(v[f]) : std::string());
+  }
+  return entry;
+}
+
+bool MetadataIndex::find(const std::string &path, IndexEntry &entry) const {
+  size_t i = lowerBound(path);
+  if (i == nEntries_ || compare(records_[i].path, path) != 0)
+    return false;
+  entry = getEntry(i);
+  return true;
+}
+
+std::pair<size_t, size_t>
+MetadataIndex::findPrefix(const std::string &prefix) const {
+  size_t first = lowerBound(prefix), last = first;
+  // Paths that start with the prefix follow it in order, up to the first
+  // one that does not
+  while (last < nEntries_ &&
+         compare(records_[last].path, prefix, prefix.size()) == 0)
+    last++;
+  return std::make_pair(first, last);
+}
+
+bool MetadataIndex::getField(const size_t i, const std::string &field,
+                             std::string &value) const {
+  if (i >= nEntries_)
+    throw std::string("No such entry\n");
+  const StrRef &ref = values(i)[fieldIndex(field)];
+  if (ref.size == INDEX_ABSENT)
+    return false;
+  value = str(ref);
+  return true;
+}
+
+std::vector<size_t> MetadataIndex::filter(const std::string &field,
+                                          const std::string &value,
+                                          const std::string &prefix) const {
+  const size_t f = fieldIndex(field);
+  std::pair<size_t, size_t> range = findPrefix(prefix);
+  std::vector<size_t> out;
+  for (size_t i = range.first; i < range.second; i++) {
+    // Compared in place, nothing is copied
+    const StrRef &ref = values(i)[f];
+    if (ref.size == value.size() && compare(ref, value) == 0)
+      out.push_back(i);
+  }
+  return out;
+}
+
+bool MetadataIndex::identify(const std::string &fn, FileIdentity &identity) {
+  struct stat st;
+  if (stat(fn.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+    return false;
+  identity.device = st.st_dev;
+  identity.inode = st.st_ino;
+  identity.size = st.st_size;
+  identity.mtime = (int64_t)st.st_mtim.tv_sec * 1000000000 + st.st_mtim.tv_nsec;
+  return true;
+}
+
+size_t MetadataIndex::lowerBound(const std::string &path) const {
+  size_t first = 0, count = nEntries_;
+  while (count > 0) {
+    size_t half = count / 2;
+    if (compare(records_[first + half].path, path) < 0) {
+      first += half + 1;
+      count -= half + 1;
+    } else {
+      count = half;
+    }
+  }
+  return first;
+}
+
+size_t MetadataIndex::fieldIndex(const std::string &field) const {
+  for (size_t i = 0; i < fields_.size(); i++) {
+    if (fields_[i].name == field)
+      return i;
+  }
+  throw std::string("Field " + field + " is not indexed\n");
+}
+
+const char *MetadataIndex::bytes(const StrRef &ref) const {
+  if (ref.offset > stringsSize_ || ref.size > stringsSize_ - ref.offset)
+    throw std::string("Corrupted index\n");
+  return strings_ + ref.offset;
+}
+
+std::string MetadataIndex::str(const StrRef &ref) const {
+  return std::string(bytes(ref), ref.size);
+}
+
+int MetadataIndex::compare(const StrRef &ref, const std::string &s,
+                           const size_t n) const {
+  // Same order as std::string, bytes are compared unsigned
+  const size_t len = std::min<uint64_t>(ref.size, n);
+  int c = memcmp(bytes(ref), s.data(), std::min(len, s.size()));
+  if (c != 0 || len == s.size())
+    return c;
+  return len < s.size() ? -1 : 1;
+}
+
+const MetadataIndex::StrRef *MetadataIndex::values(const size_t i) const {
+  return values_ + i * fields_.size();
+}
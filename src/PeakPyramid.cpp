@@ -0,0 +1,236 @@
+#include "PeakPyramid.hpp"
+#include "MappedFile.hpp"
+#include "SampleKernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+
+constexpr FieldSchema PeakSchema::fields[];
+
+// Peaks are written as they are in memory, like float samples
+static_assert(sizeof(Peak) == 12, "Peak must be 3 packed floats");
+static_assert(PeakSchema::Peaks::offset == 20, "ovrw layout");
+
+#define PEAK_VERSION 1
+// First bytes of a sidecar file, the peaks stay 4-byte aligned after it
+#define SIDECAR_MAGIC "WPYR"
+// Frames decoded at once while building
+#define BUILD_FRAMES (1 << 16)
+
+// Merges bins [first, end) of a level into one peak per channel. Every bin
+// holds binFrames frames except the last one of the level.
+static void mergeBins(const Peak *level, const uint64_t first,
+                      const uint64_t end, const uint64_t binFrames,
+                      const uint64_t frameCount, const unsigned int channels,
+                      Peak *dst) {
+  for (unsigned int c = 0; c < channels; c++) {
+    Peak p = level[first * channels + c];
+    double energy = 0;
+    uint64_t frames = 0;
+    for (uint64_t b = first; b < end; b++) {
+      const Peak &q = level[b * channels + c];
+      uint64_t n = std::min(binFrames, frameCount - b * binFrames);
+      p.min = std::min(p.min, q.min);
+      p.max = std::max(p.max, q.max);
+      energy += (double)q.rms * q.rms * n;
+      frames += n;
+    }
+    p.rms = frames ? std::sqrt(energy / frames) : 0;
+    dst[c] = p;
+  }
+}
+
+PeakPyramid::PeakPyramid(void)
+    : peaks_(nullptr), channels_(0), binFrames_(0), levels_(0),
+      frameCount_(0) {
+  layout(0);
+}
+
+bool PeakPyramid::layout(const uint64_t maxPeaks) {
+  // A crafted header must not wrap the offsets around
+  offsets_.assign(1, 0);
+  for (unsigned int l = 0; l < levels_; l++) {
+    uint64_t bins = getBinCount(l);
+    if (bins > (maxPeaks - offsets_.back()) / channels_)
+      return false;
+    offsets_.push_back(offsets_.back() + bins * channels_);
+  }
+  return true;
+}
+
+PeakPyramid PeakPyramid::build(const FrameReader &reader,
+                               const unsigned int binFrames,
+                               const unsigned int levels) {
+  if (binFrames == 0 || levels == 0 || levels > PEAK_MAX_LEVELS)
+    throw std::string("Invalid peak pyramid layout\n");
+  if (reader.getSamplesPerFrame() == 0)
+    throw std::string("Samples of that format cannot be converted\n");
+  PeakPyramid p;
+  p.channels_ = reader.getSamplesPerFrame();
+  p.binFrames_ = binFrames;
+  p.levels_ = levels;
+  p.frameCount_ = reader.getFrameCount();
+  if (!p.layout(SIZE_MAX / sizeof(Peak)))
+    throw std::string("Invalid peak pyramid layout\n");
+  auto peaks = std::make_shared<std::vector<Peak>>(p.offsets_.back());
+
+  // Level 0 in one pass, whole bins are decoded at once
+  const unsigned int channels = p.channels_;
+  PeakKernel kernel = getPeakKernel(channels, detectSimdLevel());
+  const size_t block =
+      std::max<size_t>(1, BUILD_FRAMES / binFrames) * binFrames;
+  std::vector<float> samples(block * channels);
+  std::vector<float> lo(channels), hi(channels), sq(channels);
+  Peak *dst = peaks->data();
+  for (uint64_t frame = 0; frame < p.frameCount_;) {
+    size_t n = reader.read(frame, block, samples.data());
+    if (n == 0)
+      throw std::string("Could not read frames\n");
+    for (size_t i = 0; i < n; i += binFrames) {
+      size_t count = std::min<size_t>(binFrames, n - i);
+      kernel(samples.data() + i * channels, count, channels, lo.data(),
+             hi.data(), sq.data());
+      for (unsigned int c = 0; c < channels; c++, dst++) {
+        dst->min = lo[c];
+        dst->max = hi[c];
+        dst->rms = std::sqrt(sq[c] / count);
+      }
+    }
+    frame += n;
+  }
+
+  // Each level merges pairs of bins of the level below
+  for (unsigned int l = 1; l < levels; l++) {
+    const Peak *below = peaks->data() + p.offsets_[l - 1];
+    Peak *out = peaks->data() + p.offsets_[l];
+    uint64_t nBelow = p.getBinCount(l - 1);
+    for (uint64_t b = 0; b < p.getBinCount(l); b++)
+      mergeBins(below, 2 * b, std::min(2 * b + 2, nBelow),
+                p.getBinFrames(l - 1), p.frameCount_, channels,
+                out + b * channels);
+  }
+  p.peaks_ = peaks->data();
+  p.storage_ = peaks;
+  return p;
+}
+
+PeakPyramid PeakPyramid::parse(const char *body, const size_t size) {
+  const size_t header = PeakSchema::Peaks::offset;
+  if (size < header)
+    throw std::string("Invalid peak pyramid\n");
+  std::string h(body, header);
+  PeakPyramid p;
+  uint16_t version = WavData::toType<uint16_t>(h.substr(0, 2));
+  p.channels_ = WavData::toType<uint16_t>(h.substr(2, 2));
+  p.binFrames_ = WavData::toType<uint32_t>(h.substr(4, 4));
+  p.levels_ = WavData::toType<uint32_t>(h.substr(8, 4));
+  p.frameCount_ = (uint64_t)WavData::toType<uint32_t>(h.substr(16, 4)) << 32 |
+                  WavData::toType<uint32_t>(h.substr(12, 4));
+  if (version != PEAK_VERSION || p.channels_ == 0 || p.binFrames_ == 0 ||
+      p.levels_ == 0 || p.levels_ > PEAK_MAX_LEVELS)
+    throw std::string("Invalid peak pyramid\n");
+  if (!p.layout((size - header) / sizeof(Peak)))
+    throw std::string("Truncated peak pyramid\n");
+  p.peaks_ = reinterpret_cast<const Peak *>(body + header);
+  return p;
+}
+
+PeakPyramid PeakPyramid::fromChunk(const Chunk &ck) {
+  if (ck.getChunkName() != PeakSchema::id())
+    throw std::string("Not an ovrw chunk\n");
+  // An undefined chunk has the whole body in one field
+  std::string body;
+  auto fields = ck.getAllFields();
+  for (auto it = fields.begin(); it != fields.end(); it++)
+    body.append((*it)->val.data(), (*it)->val.size());
+  PeakPyramid p = parse(body.data(), body.size());
+  auto peaks = std::make_shared<std::vector<Peak>>(p.offsets_.back());
+  std::memcpy(peaks->data(), body.data() + PeakSchema::Peaks::offset,
+              peaks->size() * sizeof(Peak));
+  p.peaks_ = peaks->data();
+  p.storage_ = peaks;
+  return p;
+}
+
+Chunk PeakPyramid::toChunk(void) const {
+  Chunk ck = makeChunk<PeakSchema>();
+  ck.set<PeakSchema::Version>(PEAK_VERSION);
+  ck.set<PeakSchema::Channels>(channels_);
+  ck.set<PeakSchema::BinFrames>(binFrames_);
+  ck.set<PeakSchema::Levels>(levels_);
+  ck.set<PeakSchema::FrameCountLow>((uint32_t)frameCount_);
+  ck.set<PeakSchema::FrameCountHigh>((uint32_t)(frameCount_ >> 32));
+  ck.getField(PeakSchema::Peaks::index)
+      ->val.assign(reinterpret_cast<const char *>(peaks_),
+                   offsets_.back() * sizeof(Peak));
+  return ck;
+}
+
+PeakPyramid PeakPyramid::load(const std::string &fn) {
+  auto map = std::make_shared<MappedFile>(fn);
+  const size_t magic = sizeof(SIDECAR_MAGIC) - 1;
+  if (map->size() < magic ||
+      std::memcmp(map->data(), SIDECAR_MAGIC, magic) != 0)
+    throw std::string(fn + " is not a peak file\n");
+  PeakPyramid p = parse(map->data() + magic, map->size() - magic);
+  p.storage_ = map;
+  return p;
+}
+
+void PeakPyramid::save(const std::string &fn) const {
+  std::ofstream out(fn, std::ios::binary);
+  if (!out.is_open())
+    throw std::string("Could not open " + fn + '\n');
+  out.write(SIDECAR_MAGIC, sizeof(SIDECAR_MAGIC) - 1);
+  Chunk ck = toChunk();
+  auto fields = ck.getAllFields();
+  for (auto it = fields.begin(); it != fields.end(); it++)
+    out.write((*it)->val.data(), (*it)->val.size());
+  out.close();
+  if (out.fail())
+    throw std::string("Could not write " + fn + '\n');
+}
+
+size_t PeakPyramid::query(const uint64_t frame, uint64_t nFrames,
+                          size_t nBins, Peak *dst) const {
+  if (frame >= frameCount_ || nFrames == 0 || nBins == 0)
+    return 0;
+  nFrames = std::min(nFrames, frameCount_ - frame);
+  nBins = std::min<uint64_t>(nBins, nFrames);
+  // Bins of the next level would be wider than the requested ones
+  unsigned int level = 0;
+  while (level + 1 < levels_ && getBinFrames(level + 1) * nBins <= nFrames)
+    level++;
+  const uint64_t binFrames = getBinFrames(level);
+  for (size_t i = 0; i < nBins; i++) {
+    uint64_t start = frame + nFrames * i / nBins;
+    uint64_t end = frame + nFrames * (i + 1) / nBins;
+    mergeBins(getLevel(level), start / binFrames,
+              (end + binFrames - 1) / binFrames, binFrames, frameCount_,
+              channels_, dst + i * channels_);
+  }
+  return nBins;
+}
+
+const Peak *PeakPyramid::getLevel(const unsigned int level) const {
+  assert(level < levels_);
+  return peaks_ + offsets_[level];
+}
+
+uint64_t PeakPyramid::getBinCount(const unsigned int level) const {
+  uint64_t binFrames = getBinFrames(level);
+  return binFrames ? frameCount_ / binFrames + (frameCount_ % binFrames != 0)
+                   : 0;
+}
+
+uint64_t PeakPyramid::getBinFrames(const unsigned int level) const {
+  return (uint64_t)binFrames_ << level;
+}
+
+unsigned int PeakPyramid::getLevelCount(void) const { return levels_; }
+
+unsigned int PeakPyramid::getChannels(void) const { return channels_; }
+
+uint64_t PeakPyramid::getFrameCount(void) const { return frameCount_; }
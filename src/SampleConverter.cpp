@@ -0,0 +1,69 @@
+#include "SampleConverter.hpp"
+
+SampleConverter::SampleConverter(const SampleType type, const SimdLevel level)
+    : type_(type), kernels_(getSampleKernels(type, level)) {
+  if (type_ == S_NDEF)
+    throw std::string("Samples of that format cannot be converted\n");
+}
+
+SampleConverter::SampleConverter(WavData &wav, const SimdLevel level)
+    : SampleConverter(getSampleType(wav), level) {}
+
+void SampleConverter::decode(const char *src, float *dst,
+                             const size_t nSamples) const {
+  kernels_.toFloat(src, dst, nSamples);
+}
+
+void SampleConverter::decode(const char *src, int32_t *dst,
+                             const size_t nSamples) const {
+  kernels_.toInt(src, dst, nSamples);
+}
+
+void SampleConverter::encode(const float *src, char *dst,
+                             const size_t nSamples) const {
+  kernels_.fromFloat(src, dst, nSamples);
+}
+
+void SampleConverter::encode(const int32_t *src, char *dst,
+                             const size_t nSamples) const {
+  kernels_.fromInt(src, dst, nSamples);
+}
+
+SampleType SampleConverter::getSampleType(void) const { return type_; }
+
+unsigned int SampleConverter::getSampleSize(void) const {
+  return ::getSampleSize(type_);
+}
+
+SampleType SampleConverter::getSampleType(WavData &wav) {
+  auto fmt = wav.getChunk("fmt ");
+  int tag = fmt->get<FmtSchema::FormatTag>();
+  int bits = fmt->get<FmtSchema::BitsPerSample>();
+  // The actual format tag of WAVE_FORMAT_EXTENSIBLE starts its SubFormat GUID
+  if (tag == WAVE_FORMAT_EXTENSIBLE) {
+    std::string subFormat = fmt->get<FmtSchema::SubFormat>();
+    tag = WavData::toType<int>(subFormat.substr(0, 2));
+  }
+  if (tag == WAVE_FORMAT_PCM) {
+    switch (bits) {
+    case 8:
+      return S_PCM_U8;
+    case 16:
+      return S_PCM_16;
+    case 24:
+      return S_PCM_24;
+    case 32:
+      return S_PCM_32;
+    }
+  } else if (tag == WAVE_FORMAT_IEEE_FLOAT) {
+    if (bits == 32)
+      return S_FLOAT_32;
+    if (bits == 64)
+      return S_FLOAT_64;
+  } else if (bits == 8 && tag == WAVE_FORMAT_ALAW) {
+    return S_ALAW;
+  } else if (bits == 8 && tag == WAVE_FORMAT_MULAW) {
+    return S_MULAW;
+  }
+  return S_NDEF;
+}
@@ -0,0 +1,1506 @@
+#include "SampleKernels.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define HAS_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+// Samples are little endian, float samples are copied as they are so the host
+// must be little endian with IEEE floats like the file
+
+#define SCALE_8 128.0f
+#define SCALE_16 32768.0f
+#define SCALE_24 8388608.0f
+#define SCALE_32 2147483648.0f
+// Largest float below 2^31, bigger values do not fit in an int32_t
+#define MAX_FLOAT_32 2147483520.0f
+
+static inline int32_t load16(const unsigned char *p) {
+  return (int16_t)(p[0] | p[1] << 8);
+}
+
+static inline int32_t load24(const unsigned char *p) {
+  return (int32_t)((uint32_t)p[0] << 8 | (uint32_t)p[1] << 16 |
+                   (uint32_t)p[2] << 24) >>
+         8;
+}
+
+static inline int32_t load32(const unsigned char *p) {
+  return (int32_t)((uint32_t)p[0] | (uint32_t)p[1] << 8 |
+                   (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24);
+}
+
+static inline void store16(unsigned char *p, const int32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+}
+
+static inline void store24(unsigned char *p, const int32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+}
+
+static inline void store32(unsigned char *p, const int32_t v) {
+  p[0] = v;
+  p[1] = v >> 8;
+  p[2] = v >> 16;
+  p[3] = v >> 24;
+}
+
+// Scales, saturates then rounds to the nearest integer like cvtps2dq does.
+// NaN is silence on every instruction set.
+static inline int32_t quantize(const float v, const float scale,
+                               const float hi) {
+  if (std::isnan(v))
+    return 0;
+  return lrintf(std::min(std::max(v * scale, -scale), hi));
+}
+
+/*
+ * Scalar kernels
+ */
+
+static void u8ToFloat(const char *src, float *dst, size_t n) {
+  const unsigned char *s = (const unsigned char *)src;
+  for (size_t i = 0; i < n; i++)
+    dst[i] = ((int32_t)s[i] - 128) * (1.0f / SCALE_8);
+}
+
+static void s16ToFloat(const char *src, float *dst, size_t n) {
+  const unsigned char *s = (const unsigned char *)src;
+  for (size_t i = 0; i < n; i++)
+    dst[i] = load16(s + 2 * i) * (1.0f / SCALE_16);
+}
+
+static void s24ToFloat(const char *src, float *dst, size_t n) {
+  const unsigned char *s = (const unsigned char *)src;
+  for (size_t i = 0; i < n; i++)
+    dst[i] = load24(s + 3 * i) * (1.0f / SCALE_24);
+}
+
+static void s32ToFloat(const char *src, float *dst, size_t n) {
+  const unsigned char *s = (const unsigned char *)src;
+  for (size_t i = 0; i < n; i++)
+    dst[i] = load32(s + 4 * i) * (1.0f / SCALE_32);
+}
+
+static void f32ToFloat(const char *src, float *dst, size_t n) {
+  memcpy(dst, src, n * sizeof(float));
+}
+
+static void f64ToFloat(const char *src, float *dst, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    double d;
+    memcpy(&d, src + 8 * i, sizeof(d));
+    dst[i] = (float)d;
+  }
+}
+
+static void u8ToInt(const char *src, int32_t *dst, size_t n) {
+  const unsigned char *s = (const unsigned char *)src;
+  for (size_t i = 0; i < n; i++)
+    dst[i] = (int32_t)((uint32_t)(s[i] ^ 0x80) << 24);
+}
+
+static void s16ToInt(const char *src, int32_t *dst, size_t n) {
+  const unsigned char *s = (const unsigned char *)src;
+  for (size_t i = 0; i < n; i++)
+    dst[i] = (int32_t)((uint32_t)load16(s + 2 * i) << 16);
+}
+
+static void s24ToInt(const char *src, int32_t *dst, size_t n) {
+  const unsigned char *s = (const unsigned char *)src;
+  for (size_t i = 0; i < n; i++)
+    dst[i] = (int32_t)((uint32_t)load24(s + 3 * i) << 8);
+}
+
+static void s32ToInt(const char *src, int32_t *dst, size_t n) {
+  const unsigned char *s = (const unsigned char *)src;
+  for (size_t i = 0; i < n; i++)
+    dst[i] = load32(s + 4 * i);
+}
+
+static void f32ToInt(const char *src, int32_t *dst, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    float f;
+    memcpy(&f, src + 4 * i, sizeof(f));
+    dst[i] = quantize(f, SCALE_32, MAX_FLOAT_32);
+  }
+}
+
+static void f64ToInt(const char *src, int32_t *dst, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    double d;
+    memcpy(&d, src + 8 * i, sizeof(d));
+    d = std::min(std::max(d * SCALE_32, -2147483648.0), 2147483647.0);
+    dst[i] = std::isnan(d) ? 0 : lrint(d);
+  }
+}
+
+static void floatToU8(const float *src, char *dst, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    dst[i] = quantize(src[i], SCALE_8, SCALE_8 - 1) + 128;
+}
+
+static void floatToS16(const float *src, char *dst, size_t n) {
+  unsigned char *d = (unsigned char *)dst;
+  for (size_t i = 0; i < n; i++)
+    store16(d + 2 * i, quantize(src[i], SCALE_16, SCALE_16 - 1));
+}
+
+static void floatToS24(const float *src, char *dst, size_t n) {
+  unsigned char *d = (unsigned char *)dst;
+  for (size_t i = 0; i < n; i++)
+    store24(d + 3 * i, quantize(src[i], SCALE_24, SCALE_24 - 1));
+}
+
+static void floatToS32(const float *src, char *dst, size_t n) {
+  unsigned char *d = (unsigned char *)dst;
+  for (size_t i = 0; i < n; i++)
+    store32(d + 4 * i, quantize(src[i], SCALE_32, MAX_FLOAT_32));
+}
+
+static void floatToF32(const float *src, char *dst, size_t n) {
+  memcpy(dst, src, n * sizeof(float));
+}
+
+static void floatToF64(const float *src, char *dst, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    double d = src[i];
+    memcpy(dst + 8 * i, &d, sizeof(d));
+  }
+}
+
+static void intToU8(const int32_t *src, char *dst, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    dst[i] = (src[i] >> 24) + 128;
+}
+
+static void intToS16(const int32_t *src, char *dst, size_t n) {
+  unsigned char *d = (unsigned char *)dst;
+  for (size_t i = 0; i < n; i++)
+    store16(d + 2 * i, src[i] >> 16);
+}
+
+static void intToS24(const int32_t *src, char *dst, size_t n) {
+  unsigned char *d = (unsigned char *)dst;
+  for (size_t i = 0; i < n; i++)
+    store24(d + 3 * i, src[i] >> 8);
+}
+
+static void intToS32(const int32_t *src, char *dst, size_t n) {
+  unsigned char *d = (unsigned char *)dst;
+  for (size_t i = 0; i < n; i++)
+    store32(d + 4 * i, src[i]);
+}
+
+static void intToF32(const int32_t *src, char *dst, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    float f = src[i] * (1.0f / SCALE_32);
+    memcpy(dst + 4 * i, &f, sizeof(f));
+  }
+}
+
+static void intToF64(const int32_t *src, char *dst, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    double d = src[i] * (1.0 / SCALE_32);
+    memcpy(dst + 8 * i, &d, sizeof(d));
+  }
+}
+
+/*
+ * G.711 A-law and mu-law. Decoding goes through 256 entry tables of 16-bit
+ * linear values, encoding searches the segment of the value like the ITU-T
+ * reference does.
+ */
+
+#define ALAW_MASK 0x55
+#define ULAW_BIAS 0x84
+#define ULAW_CLIP 8159
+
+// Last value of each segment
+static const int32_t aLawSegEnd[8] = {0x1f,  0x3f,  0x7f,  0xff,
+                                      0x1ff, 0x3ff, 0x7ff, 0xfff};
+static const int32_t uLawSegEnd[8] = {0x3f,  0x7f,  0xff,  0x1ff,
+                                      0x3ff, 0x7ff, 0xfff, 0x1fff};
+
+static int32_t aLawToLinear(unsigned char a) {
+  a ^= ALAW_MASK;
+  int32_t t = (a & 0xf) << 4;
+  int32_t seg = (a & 0x70) >> 4;
+  if (seg == 0)
+    t += 8;
+  else
+    t = (t + 0x108) << (seg - 1);
+  return (a & 0x80) ? t : -t;
+}
+
+static int32_t uLawToLinear(unsigned char u) {
+  u = ~u;
+  int32_t t = (((u & 0xf) << 3) + ULAW_BIAS) << ((u & 0x70) >> 4);
+  return (u & 0x80) ? ULAW_BIAS - t : t - ULAW_BIAS;
+}
+
+struct G711Tables {
+  G711Tables(void) {
+    for (int i = 0; i < 256; i++) {
+      aLaw[i] = aLawToLinear(i);
+      uLaw[i] = uLawToLinear(i);
+    }
+  }
+  int32_t aLaw[256];
+  int32_t uLaw[256];
+};
+
+static const G711Tables &g711Tables(void) {
+  static const G711Tables tables;
+  return tables;
+}
+
+static inline int32_t searchSegment(const int32_t v, const int32_t *segEnd) {
+  int32_t seg = 0;
+  while (seg < 8 && v > segEnd[seg])
+    seg++;
+  return seg;
+}
+
+// Linear values are 16-bit
+static inline unsigned char linearToALaw(int32_t v) {
+  v >>= 3;
+  int32_t mask = v >= 0 ? 0xd5 : 0x55;
+  if (v < 0)
+    v = -v - 1;
+  int32_t seg = searchSegment(v, aLawSegEnd);
+  if (seg >= 8)
+    return 0x7f ^ mask;
+  return ((seg << 4) | ((v >> (seg < 2 ? 1 : seg)) & 0xf)) ^ mask;
+}
+
+static inline unsigned char linearToULaw(int32_t v) {
+  v >>= 2;
+  int32_t mask = v >= 0 ? 0xff : 0x7f;
+  if (v < 0)
+    v = -v;
+  v = std::min(v, ULAW_CLIP) + (ULAW_BIAS >> 2);
+  int32_t seg = searchSegment(v, uLawSegEnd);
+  if (seg >= 8)
+    return 0x7f ^ mask;
+  return ((seg << 4) | ((v >> (seg + 1)) & 0xf)) ^ mask;
+}
+
+static void g711ToFloat(const int32_t *table, const char *src, float *dst,
+                        size_t n) {
+  const unsigned char *s = (const unsigned char *)src;
+  for (size_t i = 0; i < n; i++)
+    dst[i] = table[s[i]] * (1.0f / SCALE_16);
+}
+
+static void g711ToInt(const int32_t *table, const char *src, int32_t *dst,
+                      size_t n) {
+  const unsigned char *s = (const unsigned char *)src;
+  for (size_t i = 0; i < n; i++)
+    dst[i] = (int32_t)((uint32_t)table[s[i]] << 16);
+}
+
+static void aLawToFloat(const char *src, float *dst, size_t n) {
+  g711ToFloat(g711Tables().aLaw, src, dst, n);
+}
+
+static void uLawToFloat(const char *src, float *dst, size_t n) {
+  g711ToFloat(g711Tables().uLaw, src, dst, n);
+}
+
+static void aLawToInt(const char *src, int32_t *dst, size_t n) {
+  g711ToInt(g711Tables().aLaw, src, dst, n);
+}
+
+static void uLawToInt(const char *src, int32_t *dst, size_t n) {
+  g711ToInt(g711Tables().uLaw, src, dst, n);
+}
+
+static void floatToALaw(const float *src, char *dst, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    dst[i] = linearToALaw(quantize(src[i], SCALE_16, SCALE_16 - 1));
+}
+
+static void floatToULaw(const float *src, char *dst, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    dst[i] = linearToULaw(quantize(src[i], SCALE_16, SCALE_16 - 1));
+}
+
+static void intToALaw(const int32_t *src, char *dst, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    dst[i] = linearToALaw(src[i] >> 16);
+}
+
+static void intToULaw(const int32_t *src, char *dst, size_t n) {
+  for (size_t i = 0; i < n; i++)
+    dst[i] = linearToULaw(src[i] >> 16);
+}
+
+/*
+ * Peak kernels, minimum, maximum and sum of squares of each channel
+ */
+
+static void peakScalar(const float *src, size_t nFrames, unsigned int channels,
+                       float *min, float *max, float *sumSq) {
+  for (unsigned int c = 0; c < channels; c++) {
+    min[c] = max[c] = src[c];
+    sumSq[c] = 0.0f;
+  }
+  for (size_t i = 0; i < nFrames; i++, src += channels) {
+    for (unsigned int c = 0; c < channels; c++) {
+      min[c] = std::min(min[c], src[c]);
+      max[c] = std::max(max[c], src[c]);
+      sumSq[c] += src[c] * src[c];
+    }
+  }
+}
+
+// Lane j of a vector holds channel j % channels when the channel count divides
+// the vector width. The lanes are folded into channels, then the samples after
+// the last full vector are added, starting with channel 0.
+static void foldPeaks(const float *lo, const float *hi, const float *sq,
+                      const unsigned int width, const float *tail,
+                      const size_t nTail, const unsigned int channels,
+                      float *min, float *max, float *sumSq) {
+  for (unsigned int c = 0; c < channels; c++) {
+    min[c] = lo[c];
+    max[c] = hi[c];
+    sumSq[c] = sq[c];
+  }
+  for (unsigned int j = channels; j < width; j++) {
+    unsigned int c = j % channels;
+    min[c] = std::min(min[c], lo[j]);
+    max[c] = std::max(max[c], hi[j]);
+    sumSq[c] += sq[j];
+  }
+  for (size_t j = 0; j < nTail; j++) {
+    unsigned int c = j % channels;
+    min[c] = std::min(min[c], tail[j]);
+    max[c] = std::max(max[c], tail[j]);
+    sumSq[c] += tail[j] * tail[j];
+  }
+}
+
+/*
+ * TPDF dither. The noise of a sample is a hash of its counter, so every
+ * instruction set adds the same noise.
+ */
+
+static inline uint32_t ditherHash(uint32_t x) {
+  x ^= x >> 16;
+  x *= 0x7feb352du;
+  x ^= x >> 15;
+  x *= 0x846ca68bu;
+  x ^= x >> 16;
+  return x;
+}
+
+// The difference of two 16-bit uniform values is triangular in (-1, 1)
+static void tpdfDither(float *samples, size_t n, float lsb, uint32_t counter) {
+  const float scale = lsb / 65536.0f;
+  for (size_t i = 0; i < n; i++) {
+    uint32_t h = ditherHash(counter + (uint32_t)i);
+    samples[i] += (float)((int32_t)(h & 0xffff) - (int32_t)(h >> 16)) * scale;
+  }
+}
+
+static float firPeakScalar(const float *src, size_t n, const float *taps,
+                           unsigned int nTaps) {
+  float peak = 0.0f;
+  for (size_t i = 0; i < n; i++) {
+    float acc = 0.0f;
+    for (unsigned int k = 0; k < nTaps; k++)
+      acc += taps[k] * src[i + k];
+    peak = std::max(peak, std::fabs(acc));
+  }
+  return peak;
+}
+
+/*
+ * Channel kernels, between interleaved frames and one array per channel. The
+ * vectorized kernels leave the frames after the last full vector to the
+ * scalar loops, which start at frame first.
+ */
+
+static void deinterleaveFrom(const float *src, size_t first, size_t nFrames,
+                             unsigned int channels, float *const *dst) {
+  src += first * channels;
+  for (size_t i = first; i < nFrames; i++, src += channels) {
+    for (unsigned int c = 0; c < channels; c++)
+      dst[c][i] = src[c];
+  }
+}
+
+static void interleaveFrom(const float *const *src, size_t first,
+                           size_t nFrames, unsigned int channels, float *dst) {
+  dst += first * channels;
+  for (size_t i = first; i < nFrames; i++, dst += channels) {
+    for (unsigned int c = 0; c < channels; c++)
+      dst[c] = src[c][i];
+  }
+}
+
+static void mixFrom(const float *const *src, unsigned int nSrc,
+                    const float *gains, size_t first, size_t n, float *dst) {
+  for (size_t i = first; i < n; i++) {
+    float acc = nSrc ? gains[0] * src[0][i] : 0.0f;
+    for (unsigned int c = 1; c < nSrc; c++)
+      acc += gains[c] * src[c][i];
+    dst[i] = acc;
+  }
+}
+
+static void deinterleaveScalar(const float *src, size_t nFrames,
+                               unsigned int channels, float *const *dst) {
+  deinterleaveFrom(src, 0, nFrames, channels, dst);
+}
+
+static void interleaveScalar(const float *const *src, size_t nFrames,
+                             unsigned int channels, float *dst) {
+  interleaveFrom(src, 0, nFrames, channels, dst);
+}
+
+static void mixScalar(const float *const *src, unsigned int nSrc,
+                      const float *gains, size_t n, float *dst) {
+  mixFrom(src, nSrc, gains, 0, n, dst);
+}
+
+#ifdef HAS_X86_KERNELS
+
+/*
+ * SSE4.1 kernels, 4 samples per iteration. The scalar kernels do the rest.
+ */
+
+#define SSE41 __attribute__((target("sse4.1")))
+
+// Places 3-byte samples in the upper bytes of 32-bit lanes
+#define SHUFFLE_24_TO_32                                                       \
+  -1, 0, 1, 2, -1, 3, 4, 5, -1, 6, 7, 8, -1, 9, 10, 11
+// Packs the upper 3 bytes of 32-bit lanes in the lower 12 bytes
+#define SHUFFLE_32_TO_24                                                       \
+  1, 2, 3, 5, 6, 7, 9, 10, 11, 13, 14, 15, -1, -1, -1, -1
+
+SSE41 static void u8ToFloatSse41(const char *src, float *dst, size_t n) {
+  const __m128 scale = _mm_set1_ps(1.0f / SCALE_8);
+  const __m128i bias = _mm_set1_epi32(128);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    int32_t bytes;
+    memcpy(&bytes, src + i, sizeof(bytes));
+    __m128i v = _mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes));
+    v = _mm_sub_epi32(v, bias);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+  }
+  u8ToFloat(src + i, dst + i, n - i);
+}
+
+SSE41 static void s16ToFloatSse41(const char *src, float *dst, size_t n) {
+  const __m128 scale = _mm_set1_ps(1.0f / SCALE_16);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+    __m128i lo = _mm_cvtepi16_epi32(v);
+    __m128i hi = _mm_cvtepi16_epi32(_mm_srli_si128(v, 8));
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(lo), scale));
+    _mm_storeu_ps(dst + i + 4, _mm_mul_ps(_mm_cvtepi32_ps(hi), scale));
+  }
+  s16ToFloat(src + 2 * i, dst + i, n - i);
+}
+
+SSE41 static void s24ToFloatSse41(const char *src, float *dst, size_t n) {
+  const __m128 scale = _mm_set1_ps(1.0f / SCALE_24);
+  const __m128i shuffle = _mm_setr_epi8(SHUFFLE_24_TO_32);
+  size_t i = 0;
+  // 16 bytes are loaded for 12, the last samples are left to the scalar loop
+  for (; i + 6 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + 3 * i));
+    v = _mm_srai_epi32(_mm_shuffle_epi8(v, shuffle), 8);
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+  }
+  s24ToFloat(src + 3 * i, dst + i, n - i);
+}
+
+SSE41 static void s32ToFloatSse41(const char *src, float *dst, size_t n) {
+  const __m128 scale = _mm_set1_ps(1.0f / SCALE_32);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + 4 * i));
+    _mm_storeu_ps(dst + i, _mm_mul_ps(_mm_cvtepi32_ps(v), scale));
+  }
+  s32ToFloat(src + 4 * i, dst + i, n - i);
+}
+
+SSE41 static void f64ToFloatSse41(const char *src, float *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 lo = _mm_cvtpd_ps(_mm_loadu_pd((const double *)(src + 8 * i)));
+    __m128 hi = _mm_cvtpd_ps(_mm_loadu_pd((const double *)(src + 8 * i + 16)));
+    _mm_storeu_ps(dst + i, _mm_movelh_ps(lo, hi));
+  }
+  f64ToFloat(src + 8 * i, dst + i, n - i);
+}
+
+SSE41 static void s16ToIntSse41(const char *src, int32_t *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + 2 * i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_unpacklo_epi16(_mm_setzero_si128(), v));
+    _mm_storeu_si128((__m128i *)(dst + i + 4),
+                     _mm_unpackhi_epi16(_mm_setzero_si128(), v));
+  }
+  s16ToInt(src + 2 * i, dst + i, n - i);
+}
+
+SSE41 static void s24ToIntSse41(const char *src, int32_t *dst, size_t n) {
+  const __m128i shuffle = _mm_setr_epi8(SHUFFLE_24_TO_32);
+  size_t i = 0;
+  for (; i + 6 <= n; i += 4) {
+    __m128i v = _mm_loadu_si128((const __m128i *)(src + 3 * i));
+    _mm_storeu_si128((__m128i *)(dst + i), _mm_shuffle_epi8(v, shuffle));
+  }
+  s24ToInt(src + 3 * i, dst + i, n - i);
+}
+
+SSE41 static inline __m128i quantizeSse41(const __m128 v, const float scale,
+                                          const float hi) {
+  __m128 s = _mm_mul_ps(v, _mm_set1_ps(scale));
+  // NaN lanes are cleared, cvtps2dq would give INT_MIN
+  s = _mm_and_ps(s, _mm_cmpord_ps(s, s));
+  s = _mm_min_ps(_mm_max_ps(s, _mm_set1_ps(-scale)), _mm_set1_ps(hi));
+  return _mm_cvtps_epi32(s);
+}
+
+SSE41 static void floatToS16Sse41(const float *src, char *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i lo = quantizeSse41(_mm_loadu_ps(src + i), SCALE_16, SCALE_16 - 1);
+    __m128i hi =
+        quantizeSse41(_mm_loadu_ps(src + i + 4), SCALE_16, SCALE_16 - 1);
+    _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_packs_epi32(lo, hi));
+  }
+  floatToS16(src + i, dst + 2 * i, n - i);
+}
+
+// Stores the upper 3 bytes of 4 full scale samples
+SSE41 static inline void store24Sse41(char *dst, const __m128i v) {
+  const __m128i shuffle = _mm_setr_epi8(SHUFFLE_32_TO_24);
+  __m128i packed = _mm_shuffle_epi8(v, shuffle);
+  _mm_storel_epi64((__m128i *)dst, packed);
+  int32_t last = _mm_extract_epi32(packed, 2);
+  memcpy(dst + 8, &last, sizeof(last));
+}
+
+SSE41 static void floatToS24Sse41(const float *src, char *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i v = quantizeSse41(_mm_loadu_ps(src + i), SCALE_24, SCALE_24 - 1);
+    store24Sse41(dst + 3 * i, _mm_slli_epi32(v, 8));
+  }
+  floatToS24(src + i, dst + 3 * i, n - i);
+}
+
+SSE41 static void floatToS32Sse41(const float *src, char *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm_storeu_si128(
+        (__m128i *)(dst + 4 * i),
+        quantizeSse41(_mm_loadu_ps(src + i), SCALE_32, MAX_FLOAT_32));
+  floatToS32(src + i, dst + 4 * i, n - i);
+}
+
+SSE41 static void floatToF64Sse41(const float *src, char *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 v = _mm_loadu_ps(src + i);
+    _mm_storeu_pd((double *)(dst + 8 * i), _mm_cvtps_pd(v));
+    _mm_storeu_pd((double *)(dst + 8 * i + 16), _mm_cvtps_pd(_mm_movehl_ps(v, v)));
+  }
+  floatToF64(src + i, dst + 8 * i, n - i);
+}
+
+SSE41 static void intToS16Sse41(const int32_t *src, char *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128i lo = _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(src + i)), 16);
+    __m128i hi =
+        _mm_srai_epi32(_mm_loadu_si128((const __m128i *)(src + i + 4)), 16);
+    _mm_storeu_si128((__m128i *)(dst + 2 * i), _mm_packs_epi32(lo, hi));
+  }
+  intToS16(src + i, dst + 2 * i, n - i);
+}
+
+SSE41 static void intToS24Sse41(const int32_t *src, char *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    store24Sse41(dst + 3 * i, _mm_loadu_si128((const __m128i *)(src + i)));
+  intToS24(src + i, dst + 3 * i, n - i);
+}
+
+SSE41 static void peakSse41(const float *src, size_t nFrames,
+                           unsigned int channels, float *min, float *max,
+                           float *sumSq) {
+  const size_t n = nFrames * channels;
+  if (n < 4) {
+    peakScalar(src, nFrames, channels, min, max, sumSq);
+    return;
+  }
+  __m128 lo = _mm_loadu_ps(src), hi = lo, sq = _mm_mul_ps(lo, lo);
+  size_t i = 4;
+  for (; i + 4 <= n; i += 4) {
+    __m128 v = _mm_loadu_ps(src + i);
+    lo = _mm_min_ps(lo, v);
+    hi = _mm_max_ps(hi, v);
+    sq = _mm_add_ps(sq, _mm_mul_ps(v, v));
+  }
+  float l[4], h[4], q[4];
+  _mm_storeu_ps(l, lo);
+  _mm_storeu_ps(h, hi);
+  _mm_storeu_ps(q, sq);
+  foldPeaks(l, h, q, 4, src + i, n - i, channels, min, max, sumSq);
+}
+
+SSE41 static inline __m128i ditherHashSse41(__m128i x) {
+  x = _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+  x = _mm_mullo_epi32(x, _mm_set1_epi32(0x7feb352d));
+  x = _mm_xor_si128(x, _mm_srli_epi32(x, 15));
+  x = _mm_mullo_epi32(x, _mm_set1_epi32((int)0x846ca68bu));
+  return _mm_xor_si128(x, _mm_srli_epi32(x, 16));
+}
+
+SSE41 static void tpdfDitherSse41(float *samples, size_t n, float lsb,
+                                  uint32_t counter) {
+  const __m128 scale = _mm_set1_ps(lsb / 65536.0f);
+  const __m128i low = _mm_set1_epi32(0xffff);
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128i h = ditherHashSse41(_mm_add_epi32(
+        _mm_set1_epi32(counter + (uint32_t)i), _mm_setr_epi32(0, 1, 2, 3)));
+    __m128i d = _mm_sub_epi32(_mm_and_si128(h, low), _mm_srli_epi32(h, 16));
+    _mm_storeu_ps(samples + i,
+                  _mm_add_ps(_mm_loadu_ps(samples + i),
+                             _mm_mul_ps(_mm_cvtepi32_ps(d), scale)));
+  }
+  tpdfDither(samples + i, n - i, lsb, counter + (uint32_t)i);
+}
+
+// Each lane is one output, so the taps are added in the scalar order
+SSE41 static float firPeakSse41(const float *src, size_t n, const float *taps,
+                                unsigned int nTaps) {
+  const __m128 sign = _mm_set1_ps(-0.0f);
+  __m128 peak = _mm_setzero_ps();
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4) {
+    __m128 acc = _mm_setzero_ps();
+    for (unsigned int k = 0; k < nTaps; k++)
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(taps[k]),
+                                       _mm_loadu_ps(src + i + k)));
+    peak = _mm_max_ps(peak, _mm_andnot_ps(sign, acc));
+  }
+  float p[4];
+  _mm_storeu_ps(p, peak);
+  float tail = firPeakScalar(src + i, n - i, taps, nTaps);
+  return std::max(std::max(p[0], p[1]), std::max(std::max(p[2], p[3]), tail));
+}
+
+// Two floats of a frame, as the low half of a vector
+SSE41 static inline __m128i loadPairSse41(const float *p) {
+  return _mm_loadl_epi64(reinterpret_cast<const __m128i *>(p));
+}
+
+SSE41 static inline void storePairSse41(float *p, const __m128i v) {
+  _mm_storel_epi64(reinterpret_cast<__m128i *>(p), v);
+}
+
+// 4 frames per iteration: groups of 4 channels are transposed as 4x4 blocks,
+// the last 2 channels of 6 are shuffled in pairs
+template <unsigned int C>
+SSE41 static void deinterleaveSse41(const float *src, size_t nFrames,
+                                    unsigned int, float *const *dst) {
+  size_t i = 0;
+  for (; i + 4 <= nFrames; i += 4) {
+    const float *f = src + i * C;
+    for (unsigned int c = 0; c + 4 <= C; c += 4) {
+      __m128 r0 = _mm_loadu_ps(f + c), r1 = _mm_loadu_ps(f + C + c),
+             r2 = _mm_loadu_ps(f + 2 * C + c), r3 = _mm_loadu_ps(f + 3 * C + c);
+      _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+      _mm_storeu_ps(dst[c] + i, r0);
+      _mm_storeu_ps(dst[c + 1] + i, r1);
+      _mm_storeu_ps(dst[c + 2] + i, r2);
+      _mm_storeu_ps(dst[c + 3] + i, r3);
+    }
+    if (C % 4) {
+      const unsigned int c = C - 2;
+      __m128 a = _mm_castsi128_ps(_mm_unpacklo_epi64(
+          loadPairSse41(f + c), loadPairSse41(f + C + c)));
+      __m128 b = _mm_castsi128_ps(_mm_unpacklo_epi64(
+          loadPairSse41(f + 2 * C + c), loadPairSse41(f + 3 * C + c)));
+      _mm_storeu_ps(dst[c] + i, _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm_storeu_ps(dst[c + 1] + i,
+                    _mm_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+  }
+  deinterleaveFrom(src, i, nFrames, C, dst);
+}
+
+template <unsigned int C>
+SSE41 static void interleaveSse41(const float *const *src, size_t nFrames,
+                                  unsigned int, float *dst) {
+  size_t i = 0;
+  for (; i + 4 <= nFrames; i += 4) {
+    float *f = dst + i * C;
+    for (unsigned int c = 0; c + 4 <= C; c += 4) {
+      __m128 r0 = _mm_loadu_ps(src[c] + i), r1 = _mm_loadu_ps(src[c + 1] + i),
+             r2 = _mm_loadu_ps(src[c + 2] + i),
+             r3 = _mm_loadu_ps(src[c + 3] + i);
+      _MM_TRANSPOSE4_PS(r0, r1, r2, r3);
+      _mm_storeu_ps(f + c, r0);
+      _mm_storeu_ps(f + C + c, r1);
+      _mm_storeu_ps(f + 2 * C + c, r2);
+      _mm_storeu_ps(f + 3 * C + c, r3);
+    }
+    if (C % 4) {
+      const unsigned int c = C - 2;
+      __m128 v0 = _mm_loadu_ps(src[c] + i), v1 = _mm_loadu_ps(src[c + 1] + i);
+      __m128i lo = _mm_castps_si128(_mm_unpacklo_ps(v0, v1));
+      __m128i hi = _mm_castps_si128(_mm_unpackhi_ps(v0, v1));
+      storePairSse41(f + c, lo);
+      storePairSse41(f + C + c, _mm_unpackhi_epi64(lo, lo));
+      storePairSse41(f + 2 * C + c, hi);
+      storePairSse41(f + 3 * C + c, _mm_unpackhi_epi64(hi, hi));
+    }
+  }
+  interleaveFrom(src, i, nFrames, C, dst);
+}
+
+SSE41 static void mixSse41(const float *const *src, unsigned int nSrc,
+                           const float *gains, size_t n, float *dst) {
+  size_t i = 0;
+  for (; nSrc && i + 4 <= n; i += 4) {
+    __m128 acc = _mm_mul_ps(_mm_set1_ps(gains[0]), _mm_loadu_ps(src[0] + i));
+    for (unsigned int c = 1; c < nSrc; c++)
+      acc = _mm_add_ps(acc, _mm_mul_ps(_mm_set1_ps(gains[c]),
+                                       _mm_loadu_ps(src[c] + i)));
+    _mm_storeu_ps(dst + i, acc);
+  }
+  mixFrom(src, nSrc, gains, i, n, dst);
+}
+
+/*
+ * AVX2 kernels, 8 samples per iteration. The SSE4.1 kernels do the rest.
+ */
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static void u8ToFloatAvx2(const char *src, float *dst, size_t n) {
+  const __m256 scale = _mm256_set1_ps(1.0f / SCALE_8);
+  const __m256i bias = _mm256_set1_epi32(128);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)(src + i)));
+    v = _mm256_sub_epi32(v, bias);
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+  }
+  u8ToFloatSse41(src + i, dst + i, n - i);
+}
+
+AVX2 static void s16ToFloatAvx2(const char *src, float *dst, size_t n) {
+  const __m256 scale = _mm256_set1_ps(1.0f / SCALE_16);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v =
+        _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + 2 * i)));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+  }
+  s16ToFloatSse41(src + 2 * i, dst + i, n - i);
+}
+
+AVX2 static inline __m256i load24Avx2(const char *src) {
+  // Both lanes hold 4 samples, loading 28 bytes in total
+  const __m256i shuffle = _mm256_setr_epi8(SHUFFLE_24_TO_32, SHUFFLE_24_TO_32);
+  __m128i lo = _mm_loadu_si128((const __m128i *)src);
+  __m128i hi = _mm_loadu_si128((const __m128i *)(src + 12));
+  __m256i v = _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1);
+  return _mm256_shuffle_epi8(v, shuffle);
+}
+
+AVX2 static void s24ToFloatAvx2(const char *src, float *dst, size_t n) {
+  const __m256 scale = _mm256_set1_ps(1.0f / SCALE_24);
+  size_t i = 0;
+  for (; i + 10 <= n; i += 8) {
+    __m256i v = _mm256_srai_epi32(load24Avx2(src + 3 * i), 8);
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+  }
+  s24ToFloatSse41(src + 3 * i, dst + i, n - i);
+}
+
+AVX2 static void s32ToFloatAvx2(const char *src, float *dst, size_t n) {
+  const __m256 scale = _mm256_set1_ps(1.0f / SCALE_32);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + 4 * i));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(_mm256_cvtepi32_ps(v), scale));
+  }
+  s32ToFloatSse41(src + 4 * i, dst + i, n - i);
+}
+
+AVX2 static void f64ToFloatAvx2(const char *src, float *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m128 lo = _mm256_cvtpd_ps(_mm256_loadu_pd((const double *)(src + 8 * i)));
+    __m128 hi =
+        _mm256_cvtpd_ps(_mm256_loadu_pd((const double *)(src + 8 * i + 32)));
+    _mm256_storeu_ps(dst + i,
+                     _mm256_insertf128_ps(_mm256_castps128_ps256(lo), hi, 1));
+  }
+  f64ToFloatSse41(src + 8 * i, dst + i, n - i);
+}
+
+AVX2 static void s16ToIntAvx2(const char *src, int32_t *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v =
+        _mm256_cvtepi16_epi32(_mm_loadu_si128((const __m128i *)(src + 2 * i)));
+    _mm256_storeu_si256((__m256i *)(dst + i), _mm256_slli_epi32(v, 16));
+  }
+  s16ToIntSse41(src + 2 * i, dst + i, n - i);
+}
+
+AVX2 static void s24ToIntAvx2(const char *src, int32_t *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 10 <= n; i += 8)
+    _mm256_storeu_si256((__m256i *)(dst + i), load24Avx2(src + 3 * i));
+  s24ToIntSse41(src + 3 * i, dst + i, n - i);
+}
+
+AVX2 static inline __m256i quantizeAvx2(const __m256 v, const float scale,
+                                        const float hi) {
+  __m256 s = _mm256_mul_ps(v, _mm256_set1_ps(scale));
+  s = _mm256_and_ps(s, _mm256_cmp_ps(s, s, _CMP_ORD_Q));
+  s = _mm256_min_ps(_mm256_max_ps(s, _mm256_set1_ps(-scale)),
+                    _mm256_set1_ps(hi));
+  return _mm256_cvtps_epi32(s);
+}
+
+AVX2 static void floatToS16Avx2(const float *src, char *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = quantizeAvx2(_mm256_loadu_ps(src + i), SCALE_16, SCALE_16 - 1);
+    _mm_storeu_si128((__m128i *)(dst + 2 * i),
+                     _mm_packs_epi32(_mm256_castsi256_si128(v),
+                                     _mm256_extracti128_si256(v, 1)));
+  }
+  floatToS16Sse41(src + i, dst + 2 * i, n - i);
+}
+
+AVX2 static void floatToS24Avx2(const float *src, char *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = quantizeAvx2(_mm256_loadu_ps(src + i), SCALE_24, SCALE_24 - 1);
+    v = _mm256_slli_epi32(v, 8);
+    store24Sse41(dst + 3 * i, _mm256_castsi256_si128(v));
+    store24Sse41(dst + 3 * i + 12, _mm256_extracti128_si256(v, 1));
+  }
+  floatToS24Sse41(src + i, dst + 3 * i, n - i);
+}
+
+AVX2 static void floatToS32Avx2(const float *src, char *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_si256(
+        (__m256i *)(dst + 4 * i),
+        quantizeAvx2(_mm256_loadu_ps(src + i), SCALE_32, MAX_FLOAT_32));
+  floatToS32Sse41(src + i, dst + 4 * i, n - i);
+}
+
+AVX2 static void floatToF64Avx2(const float *src, char *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 4 <= n; i += 4)
+    _mm256_storeu_pd((double *)(dst + 8 * i),
+                     _mm256_cvtps_pd(_mm_loadu_ps(src + i)));
+  floatToF64(src + i, dst + 8 * i, n - i);
+}
+
+/*
+ * G.711 AVX2 kernels. Decoding gathers 8 table entries at once, encoding
+ * counts the segment ends each value is above instead of searching.
+ */
+
+AVX2 static inline __m256i gatherG711(const int32_t *table, const char *src) {
+  __m256i idx =
+      _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i *)src));
+  return _mm256_i32gather_epi32((const int *)table, idx, 4);
+}
+
+AVX2 static void g711ToFloatAvx2(const int32_t *table, const char *src,
+                                 float *dst, size_t n) {
+  const __m256 scale = _mm256_set1_ps(1.0f / SCALE_16);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_cvtepi32_ps(gatherG711(table, src + i));
+    _mm256_storeu_ps(dst + i, _mm256_mul_ps(v, scale));
+  }
+  g711ToFloat(table, src + i, dst + i, n - i);
+}
+
+AVX2 static void g711ToIntAvx2(const int32_t *table, const char *src,
+                               int32_t *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8)
+    _mm256_storeu_si256((__m256i *)(dst + i),
+                        _mm256_slli_epi32(gatherG711(table, src + i), 16));
+  g711ToInt(table, src + i, dst + i, n - i);
+}
+
+AVX2 static inline __m256i segmentAvx2(const __m256i v,
+                                       const int32_t *segEnd) {
+  __m256i seg = _mm256_setzero_si256();
+  for (int i = 0; i < 8; i++)
+    seg = _mm256_sub_epi32(
+        seg, _mm256_cmpgt_epi32(v, _mm256_set1_epi32(segEnd[i])));
+  return seg;
+}
+
+// Stores the low byte of 8 32-bit lanes
+AVX2 static inline void storeBytesAvx2(char *dst, const __m256i v) {
+  const __m256i shuffle = _mm256_setr_epi8(
+      0, 4, 8, 12, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 4, 8, 12,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1);
+  __m256i packed = _mm256_shuffle_epi8(v, shuffle);
+  packed = _mm256_permutevar8x32_epi32(packed,
+                                       _mm256_setr_epi32(0, 4, 1, 1, 1, 1, 1, 1));
+  _mm_storel_epi64((__m128i *)dst, _mm256_castsi256_si128(packed));
+}
+
+AVX2 static inline __m256i linearToALawAvx2(__m256i v) {
+  v = _mm256_srai_epi32(v, 3);
+  __m256i sign = _mm256_srai_epi32(v, 31);
+  __m256i mask = _mm256_blendv_epi8(_mm256_set1_epi32(0xd5),
+                                    _mm256_set1_epi32(0x55), sign);
+  // -v - 1 for negative values
+  v = _mm256_xor_si256(v, sign);
+  __m256i seg = segmentAvx2(v, aLawSegEnd);
+  __m256i shift = _mm256_max_epi32(seg, _mm256_set1_epi32(1));
+  __m256i a = _mm256_or_si256(
+      _mm256_slli_epi32(seg, 4),
+      _mm256_and_si256(_mm256_srlv_epi32(v, shift), _mm256_set1_epi32(0xf)));
+  __m256i clip = _mm256_cmpgt_epi32(seg, _mm256_set1_epi32(7));
+  a = _mm256_blendv_epi8(a, _mm256_set1_epi32(0x7f), clip);
+  return _mm256_xor_si256(a, mask);
+}
+
+AVX2 static inline __m256i linearToULawAvx2(__m256i v) {
+  v = _mm256_srai_epi32(v, 2);
+  __m256i sign = _mm256_srai_epi32(v, 31);
+  __m256i mask = _mm256_blendv_epi8(_mm256_set1_epi32(0xff),
+                                    _mm256_set1_epi32(0x7f), sign);
+  v = _mm256_min_epi32(_mm256_abs_epi32(v), _mm256_set1_epi32(ULAW_CLIP));
+  v = _mm256_add_epi32(v, _mm256_set1_epi32(ULAW_BIAS >> 2));
+  __m256i seg = segmentAvx2(v, uLawSegEnd);
+  __m256i shift = _mm256_add_epi32(seg, _mm256_set1_epi32(1));
+  __m256i u = _mm256_or_si256(
+      _mm256_slli_epi32(seg, 4),
+      _mm256_and_si256(_mm256_srlv_epi32(v, shift), _mm256_set1_epi32(0xf)));
+  __m256i clip = _mm256_cmpgt_epi32(seg, _mm256_set1_epi32(7));
+  u = _mm256_blendv_epi8(u, _mm256_set1_epi32(0x7f), clip);
+  return _mm256_xor_si256(u, mask);
+}
+
+AVX2 static void aLawToFloatAvx2(const char *src, float *dst, size_t n) {
+  g711ToFloatAvx2(g711Tables().aLaw, src, dst, n);
+}
+
+AVX2 static void uLawToFloatAvx2(const char *src, float *dst, size_t n) {
+  g711ToFloatAvx2(g711Tables().uLaw, src, dst, n);
+}
+
+AVX2 static void aLawToIntAvx2(const char *src, int32_t *dst, size_t n) {
+  g711ToIntAvx2(g711Tables().aLaw, src, dst, n);
+}
+
+AVX2 static void uLawToIntAvx2(const char *src, int32_t *dst, size_t n) {
+  g711ToIntAvx2(g711Tables().uLaw, src, dst, n);
+}
+
+// NaN is quantized to 0 like in the scalar kernels, so it gives the code of
+// silence rather than the one of INT_MIN
+AVX2 static void floatToALawAvx2(const float *src, char *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = quantizeAvx2(_mm256_loadu_ps(src + i), SCALE_16, SCALE_16 - 1);
+    storeBytesAvx2(dst + i, linearToALawAvx2(v));
+  }
+  floatToALaw(src + i, dst + i, n - i);
+}
+
+AVX2 static void floatToULawAvx2(const float *src, char *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = quantizeAvx2(_mm256_loadu_ps(src + i), SCALE_16, SCALE_16 - 1);
+    storeBytesAvx2(dst + i, linearToULawAvx2(v));
+  }
+  floatToULaw(src + i, dst + i, n - i);
+}
+
+AVX2 static void intToALawAvx2(const int32_t *src, char *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+    storeBytesAvx2(dst + i, linearToALawAvx2(_mm256_srai_epi32(v, 16)));
+  }
+  intToALaw(src + i, dst + i, n - i);
+}
+
+AVX2 static void intToULawAvx2(const int32_t *src, char *dst, size_t n) {
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i v = _mm256_loadu_si256((const __m256i *)(src + i));
+    storeBytesAvx2(dst + i, linearToULawAvx2(_mm256_srai_epi32(v, 16)));
+  }
+  intToULaw(src + i, dst + i, n - i);
+}
+
+AVX2 static void peakAvx2(const float *src, size_t nFrames,
+                         unsigned int channels, float *min, float *max,
+                         float *sumSq) {
+  const size_t n = nFrames * channels;
+  // 8 channels always fill a vector
+  if (n < 8) {
+    peakSse41(src, nFrames, channels, min, max, sumSq);
+    return;
+  }
+  __m256 lo = _mm256_loadu_ps(src), hi = lo, sq = _mm256_mul_ps(lo, lo);
+  size_t i = 8;
+  for (; i + 8 <= n; i += 8) {
+    __m256 v = _mm256_loadu_ps(src + i);
+    lo = _mm256_min_ps(lo, v);
+    hi = _mm256_max_ps(hi, v);
+    sq = _mm256_add_ps(sq, _mm256_mul_ps(v, v));
+  }
+  float l[8], h[8], q[8];
+  _mm256_storeu_ps(l, lo);
+  _mm256_storeu_ps(h, hi);
+  _mm256_storeu_ps(q, sq);
+  foldPeaks(l, h, q, 8, src + i, n - i, channels, min, max, sumSq);
+}
+
+AVX2 static void tpdfDitherAvx2(float *samples, size_t n, float lsb,
+                               uint32_t counter) {
+  const __m256 scale = _mm256_set1_ps(lsb / 65536.0f);
+  const __m256i low = _mm256_set1_epi32(0xffff);
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256i h = _mm256_add_epi32(_mm256_set1_epi32(counter + (uint32_t)i),
+                                 _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+    h = _mm256_mullo_epi32(h, _mm256_set1_epi32(0x7feb352d));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 15));
+    h = _mm256_mullo_epi32(h, _mm256_set1_epi32((int)0x846ca68bu));
+    h = _mm256_xor_si256(h, _mm256_srli_epi32(h, 16));
+    __m256i d =
+        _mm256_sub_epi32(_mm256_and_si256(h, low), _mm256_srli_epi32(h, 16));
+    _mm256_storeu_ps(samples + i,
+                     _mm256_add_ps(_mm256_loadu_ps(samples + i),
+                                   _mm256_mul_ps(_mm256_cvtepi32_ps(d), scale)));
+  }
+  tpdfDitherSse41(samples + i, n - i, lsb, counter + (uint32_t)i);
+}
+
+AVX2 static float firPeakAvx2(const float *src, size_t n, const float *taps,
+                              unsigned int nTaps) {
+  const __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 peak = _mm256_setzero_ps();
+  size_t i = 0;
+  for (; i + 8 <= n; i += 8) {
+    __m256 acc = _mm256_setzero_ps();
+    for (unsigned int k = 0; k < nTaps; k++)
+      acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(taps[k]),
+                                             _mm256_loadu_ps(src + i + k)));
+    peak = _mm256_max_ps(peak, _mm256_andnot_ps(sign, acc));
+  }
+  float p[8];
+  _mm256_storeu_ps(p, peak);
+  float m = firPeakSse41(src + i, n - i, taps, nTaps);
+  for (int j = 0; j < 8; j++)
+    m = std::max(m, p[j]);
+  return m;
+}
+
+// Transposes the 4x4 blocks of both lanes
+AVX2 static inline void transpose4Avx2(__m256 &r0, __m256 &r1, __m256 &r2,
+                                       __m256 &r3) {
+  __m256 t0 = _mm256_unpacklo_ps(r0, r1), t1 = _mm256_unpacklo_ps(r2, r3);
+  __m256 t2 = _mm256_unpackhi_ps(r0, r1), t3 = _mm256_unpackhi_ps(r2, r3);
+  r0 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(1, 0, 1, 0));
+  r1 = _mm256_shuffle_ps(t0, t1, _MM_SHUFFLE(3, 2, 3, 2));
+  r2 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(1, 0, 1, 0));
+  r3 = _mm256_shuffle_ps(t2, t3, _MM_SHUFFLE(3, 2, 3, 2));
+}
+
+// Frames k and k + 4 in the low and high lanes
+AVX2 static inline __m256 loadLanesAvx2(const float *lo, const float *hi) {
+  return _mm256_insertf128_ps(_mm256_castps128_ps256(_mm_loadu_ps(lo)),
+                              _mm_loadu_ps(hi), 1);
+}
+
+AVX2 static inline __m256 loadPairsAvx2(const float *p0, const float *p1,
+                                        const float *p2, const float *p3) {
+  __m128i lo = _mm_unpacklo_epi64(loadPairSse41(p0), loadPairSse41(p1));
+  __m128i hi = _mm_unpacklo_epi64(loadPairSse41(p2), loadPairSse41(p3));
+  return _mm256_castsi256_ps(
+      _mm256_inserti128_si256(_mm256_castsi128_si256(lo), hi, 1));
+}
+
+// 8 frames per iteration. Frames k and k + 4 share a vector so that the
+// in-lane transposes of 4 channels give 8 consecutive samples of a channel.
+template <unsigned int C>
+AVX2 static void deinterleaveAvx2(const float *src, size_t nFrames,
+                                  unsigned int, float *const *dst) {
+  size_t i = 0;
+  for (; i + 8 <= nFrames; i += 8) {
+    const float *f = src + i * C;
+    for (unsigned int c = 0; c + 4 <= C; c += 4) {
+      __m256 r0 = loadLanesAvx2(f + c, f + 4 * C + c);
+      __m256 r1 = loadLanesAvx2(f + C + c, f + 5 * C + c);
+      __m256 r2 = loadLanesAvx2(f + 2 * C + c, f + 6 * C + c);
+      __m256 r3 = loadLanesAvx2(f + 3 * C + c, f + 7 * C + c);
+      transpose4Avx2(r0, r1, r2, r3);
+      _mm256_storeu_ps(dst[c] + i, r0);
+      _mm256_storeu_ps(dst[c + 1] + i, r1);
+      _mm256_storeu_ps(dst[c + 2] + i, r2);
+      _mm256_storeu_ps(dst[c + 3] + i, r3);
+    }
+    if (C % 4) {
+      const unsigned int c = C - 2;
+      __m256 a = loadPairsAvx2(f + c, f + C + c, f + 4 * C + c, f + 5 * C + c);
+      __m256 b = loadPairsAvx2(f + 2 * C + c, f + 3 * C + c, f + 6 * C + c,
+                               f + 7 * C + c);
+      _mm256_storeu_ps(dst[c] + i,
+                       _mm256_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+      _mm256_storeu_ps(dst[c + 1] + i,
+                       _mm256_shuffle_ps(a, b, _MM_SHUFFLE(3, 1, 3, 1)));
+    }
+  }
+  deinterleaveFrom(src, i, nFrames, C, dst);
+}
+
+template <unsigned int C>
+AVX2 static void interleaveAvx2(const float *const *src, size_t nFrames,
+                                unsigned int, float *dst) {
+  size_t i = 0;
+  for (; i + 8 <= nFrames; i += 8) {
+    float *f = dst + i * C;
+    for (unsigned int c = 0; c + 4 <= C; c += 4) {
+      __m256 r0 = _mm256_loadu_ps(src[c] + i);
+      __m256 r1 = _mm256_loadu_ps(src[c + 1] + i);
+      __m256 r2 = _mm256_loadu_ps(src[c + 2] + i);
+      __m256 r3 = _mm256_loadu_ps(src[c + 3] + i);
+      transpose4Avx2(r0, r1, r2, r3);
+      _mm_storeu_ps(f + c, _mm256_castps256_ps128(r0));
+      _mm_storeu_ps(f + C + c, _mm256_castps256_ps128(r1));
+      _mm_storeu_ps(f + 2 * C + c, _mm256_castps256_ps128(r2));
+      _mm_storeu_ps(f + 3 * C + c, _mm256_castps256_ps128(r3));
+      _mm_storeu_ps(f + 4 * C + c, _mm256_extractf128_ps(r0, 1));
+      _mm_storeu_ps(f + 5 * C + c, _mm256_extractf128_ps(r1, 1));
+      _mm_storeu_ps(f + 6 * C + c, _mm256_extractf128_ps(r2, 1));
+      _mm_storeu_ps(f + 7 * C + c, _mm256_extractf128_ps(r3, 1));
+    }
+    if (C % 4) {
+      const unsigned int c = C - 2;
+      __m256 v0 = _mm256_loadu_ps(src[c] + i);
+      __m256 v1 = _mm256_loadu_ps(src[c + 1] + i);
+      __m256i lo = _mm256_castps_si256(_mm256_unpacklo_ps(v0, v1));
+      __m256i hi = _mm256_castps_si256(_mm256_unpackhi_ps(v0, v1));
+      // Pairs of frames 0 1 4 5 in lo and 2 3 6 7 in hi
+      __m128i p[4] = {_mm256_castsi256_si128(lo), _mm256_castsi256_si128(hi),
+                      _mm256_extracti128_si256(lo, 1),
+                      _mm256_extracti128_si256(hi, 1)};
+      for (unsigned int k = 0; k < 4; k++) {
+        storePairSse41(f + 2 * k * C + c, p[k]);
+        storePairSse41(f + (2 * k + 1) * C + c, _mm_unpackhi_epi64(p[k], p[k]));
+      }
+    }
+  }
+  interleaveFrom(src, i, nFrames, C, dst);
+}
+
+AVX2 static void mixAvx2(const float *const *src, unsigned int nSrc,
+                         const float *gains, size_t n, float *dst) {
+  size_t i = 0;
+  for (; nSrc && i + 8 <= n; i += 8) {
+    __m256 acc =
+        _mm256_mul_ps(_mm256_set1_ps(gains[0]), _mm256_loadu_ps(src[0] + i));
+    for (unsigned int c = 1; c < nSrc; c++)
+      acc = _mm256_add_ps(acc, _mm256_mul_ps(_mm256_set1_ps(gains[c]),
+                                             _mm256_loadu_ps(src[c] + i)));
+    _mm256_storeu_ps(dst + i, acc);
+  }
+  mixFrom(src, nSrc, gains, i, n, dst);
+}
+
+#endif // HAS_X86_KERNELS
+
+static SimdLevel detect(void) {
+  SimdLevel level = SIMD_SCALAR;
+#ifdef HAS_X86_KERNELS
+  __builtin_cpu_init();
+  if (__builtin_cpu_supports("avx2"))
+    level = SIMD_AVX2;
+  else if (__builtin_cpu_supports("sse4.1"))
+    level = SIMD_SSE41;
+#endif
+  const char *env = getenv("WAV_RIFF_SIMD");
+  if (env) {
+    std::string name(env);
+    if (name == "scalar")
+      level = SIMD_SCALAR;
+    else if (name == "sse4.1")
+      level = std::min(level, SIMD_SSE41);
+  }
+  return level;
+}
+
+SimdLevel detectSimdLevel(void) {
+  // The CPU and the environment are only checked once
+  static const SimdLevel level = detect();
+  return level;
+}
+
+SampleKernels getSampleKernels(const SampleType type, const SimdLevel level) {
+  SampleKernels k = {nullptr, nullptr, nullptr, nullptr};
+  switch (type) {
+  case S_PCM_U8:
+    k = {u8ToFloat, u8ToInt, floatToU8, intToU8};
+    break;
+  case S_PCM_16:
+    k = {s16ToFloat, s16ToInt, floatToS16, intToS16};
+    break;
+  case S_PCM_24:
+    k = {s24ToFloat, s24ToInt, floatToS24, intToS24};
+    break;
+  case S_PCM_32:
+    k = {s32ToFloat, s32ToInt, floatToS32, intToS32};
+    break;
+  case S_FLOAT_32:
+    k = {f32ToFloat, f32ToInt, floatToF32, intToF32};
+    break;
+  case S_FLOAT_64:
+    k = {f64ToFloat, f64ToInt, floatToF64, intToF64};
+    break;
+  case S_ALAW:
+    k = {aLawToFloat, aLawToInt, floatToALaw, intToALaw};
+    break;
+  case S_MULAW:
+    k = {uLawToFloat, uLawToInt, floatToULaw, intToULaw};
+    break;
+  default:
+    return k;
+  }
+#ifdef HAS_X86_KERNELS
+  if (level == SIMD_SSE41) {
+    switch (type) {
+    case S_PCM_U8:
+      k.toFloat = u8ToFloatSse41;
+      break;
+    case S_PCM_16:
+      k = {s16ToFloatSse41, s16ToIntSse41, floatToS16Sse41, intToS16Sse41};
+      break;
+    case S_PCM_24:
+      k = {s24ToFloatSse41, s24ToIntSse41, floatToS24Sse41, intToS24Sse41};
+      break;
+    case S_PCM_32:
+      k.toFloat = s32ToFloatSse41;
+      k.fromFloat = floatToS32Sse41;
+      break;
+    case S_FLOAT_64:
+      k.toFloat = f64ToFloatSse41;
+      k.fromFloat = floatToF64Sse41;
+      break;
+    default:
+      break;
+    }
+  } else if (level == SIMD_AVX2) {
+    switch (type) {
+    case S_PCM_U8:
+      k.toFloat = u8ToFloatAvx2;
+      break;
+    case S_PCM_16:
+      k = {s16ToFloatAvx2, s16ToIntAvx2, floatToS16Avx2, intToS16Sse41};
+      break;
+    case S_PCM_24:
+      k = {s24ToFloatAvx2, s24ToIntAvx2, floatToS24Avx2, intToS24Sse41};
+      break;
+    case S_PCM_32:
+      k.toFloat = s32ToFloatAvx2;
+      k.fromFloat = floatToS32Avx2;
+      break;
+    case S_FLOAT_64:
+      k.toFloat = f64ToFloatAvx2;
+      k.fromFloat = floatToF64Avx2;
+      break;
+    case S_ALAW:
+      k = {aLawToFloatAvx2, aLawToIntAvx2, floatToALawAvx2, intToALawAvx2};
+      break;
+    case S_MULAW:
+      k = {uLawToFloatAvx2, uLawToIntAvx2, floatToULawAvx2, intToULawAvx2};
+      break;
+    default:
+      break;
+    }
+  }
+#else
+  (void)level;
+#endif
+  return k;
+}
+
+PeakKernel getPeakKernel(const unsigned int channels, const SimdLevel level) {
+#ifdef HAS_X86_KERNELS
+  if (channels != 0 && level == SIMD_AVX2 && 8 % channels == 0)
+    return peakAvx2;
+  if (channels != 0 && level != SIMD_SCALAR && 4 % channels == 0)
+    return peakSse41;
+#else
+  (void)level;
+#endif
+  return peakScalar;
+}
+
+FirPeakKernel getFirPeakKernel(const SimdLevel level) {
+#ifdef HAS_X86_KERNELS
+  if (level == SIMD_AVX2)
+    return firPeakAvx2;
+  if (level == SIMD_SSE41)
+    return firPeakSse41;
+#else
+  (void)level;
+#endif
+  return firPeakScalar;
+}
+
+DitherKernel getDitherKernel(const SimdLevel level) {
+#ifdef HAS_X86_KERNELS
+  if (level == SIMD_AVX2)
+    return tpdfDitherAvx2;
+  if (level == SIMD_SSE41)
+    return tpdfDitherSse41;
+#else
+  (void)level;
+#endif
+  return tpdfDither;
+}
+
+DeinterleaveKernel getDeinterleaveKernel(const unsigned int channels,
+                                         const SimdLevel level) {
+#ifdef HAS_X86_KERNELS
+  if (level == SIMD_AVX2) {
+    switch (channels) {
+    case 2:
+      return deinterleaveAvx2<2>;
+    case 4:
+      return deinterleaveAvx2<4>;
+    case 6:
+      return deinterleaveAvx2<6>;
+    case 8:
+      return deinterleaveAvx2<8>;
+    case 16:
+      return deinterleaveAvx2<16>;
+    }
+  }
+  if (level != SIMD_SCALAR) {
+    switch (channels) {
+    case 2:
+      return deinterleaveSse41<2>;
+    case 4:
+      return deinterleaveSse41<4>;
+    case 6:
+      return deinterleaveSse41<6>;
+    case 8:
+      return deinterleaveSse41<8>;
+    case 16:
+      return deinterleaveSse41<16>;
+    }
+  }
+#else
+  (void)channels;
+  (void)level;
+#endif
+  return deinterleaveScalar;
+}
+
+InterleaveKernel getInterleaveKernel(const unsigned int channels,
+                                     const SimdLevel level) {
+#ifdef HAS_X86_KERNELS
+  if (level == SIMD_AVX2) {
+    switch (channels) {
+    case 2:
+      return interleaveAvx2<2>;
+    case 4:
+      return interleaveAvx2<4>;
+    case 6:
+      return interleaveAvx2<6>;
+    case 8:
+      return interleaveAvx2<8>;
+    case 16:
+      return interleaveAvx2<16>;
+    }
+  }
+  if (level != SIMD_SCALAR) {
+    switch (channels) {
+    case 2:
+      return interleaveSse41<2>;
+    case 4:
+      return interleaveSse41<4>;
+    case 6:
+      return interleaveSse41<6>;
+    case 8:
+      return interleaveSse41<8>;
+    case 16:
+      return interleaveSse41<16>;
+    }
+  }
+#else
+  (void)channels;
+  (void)level;
+#endif
+  return interleaveScalar;
+}
+
+MixKernel getMixKernel(const SimdLevel level) {
+#ifdef HAS_X86_KERNELS
+  if (level == SIMD_AVX2)
+    return mixAvx2;
+  if (level == SIMD_SSE41)
+    return mixSse41;
+#else
+  (void)level;
+#endif
+  return mixScalar;
+}
+
+unsigned int getSampleSize(const SampleType type) {
+  switch (type) {
+  case S_PCM_U8:
+  case S_ALAW:
+  case S_MULAW:
+    return 1;
+  case S_PCM_16:
+    return 2;
+  case S_PCM_24:
+    return 3;
+  case S_PCM_32:
+  case S_FLOAT_32:
+    return 4;
+  case S_FLOAT_64:
+    return 8;
+  default:
+    return 0;
+  }
+}
@@ -0,0 +1,114 @@
+#include "StreamReader.hpp"
+#include <algorithm>
+#include <exception>
+
+StreamReader::StreamReader(const std::string &fn, const size_t blockFrames,
+                           const unsigned int depth, const bool decode,
+                           const bool direct, const uint64_t first)
+    : reader_(fn, direct), blockFrames_(blockFrames), head_(0), tail_(0),
+      done_(false), stop_(false), holding_(false), producerWaiting_(false),
+      consumerWaiting_(false) {
+  if (blockFrames == 0 || depth < 2)
+    throw std::string("Invalid read-ahead layout\n");
+  if (decode && reader_.getSampleType() == S_NDEF)
+    throw std::string("Samples of that format cannot be converted\n");
+  if (decode)
+    converter_.reset(new SampleConverter(reader_.getSampleType()));
+  // Whole pages so that O_DIRECT reads of whole pages fit
+  const size_t mask = DIRECT_ALIGNMENT - 1;
+  const size_t rawSize =
+      (blockFrames * reader_.getBlockAlign() + mask) & ~mask;
+  for (unsigned int i = 0; i < depth; i++) {
+    Slot slot = {allocDirect(rawSize), std::vector<float>(), 0, 0};
+    if (decode)
+      slot.samples.resize(blockFrames * reader_.getSamplesPerFrame());
+    slots_.push_back(std::move(slot));
+  }
+  thread_ = std::thread(&StreamReader::run, this, first);
+}
+
+StreamReader::~StreamReader(void) {
+  stop_ = true;
+  {
+    std::lock_guard<std::mutex> lock(m_);
+    cv_.notify_all();
+  }
+  thread_.join();
+}
+
+template <typename Ready>
+void StreamReader::wait(std::atomic<bool> &waiting, const Ready &ready) {
+  if (ready())
+    return;
+  // The other thread sees the flag or this one sees its update, the flag
+  // and the counters are sequentially consistent
+  std::unique_lock<std::mutex> lock(m_);
+  waiting = true;
+  cv_.wait(lock, ready);
+  waiting = false;
+}
+
+void StreamReader::wake(const std::atomic<bool> &waiting) {
+  if (!waiting)
+    return;
+  std::lock_guard<std::mutex> lock(m_);
+  cv_.notify_all();
+}
+
+void StreamReader::run(uint64_t frame) {
+  const uint64_t depth = slots_.size();
+  try {
+    while (frame < reader_.getFrameCount()) {
+      const uint64_t head = head_.load(std::memory_order_relaxed);
+      wait(producerWaiting_,
+           [this, head, depth] { return stop_ || head - tail_ < depth; });
+      if (stop_)
+        break;
+      Slot &slot = slots_[head % depth];
+      slot.frame = frame;
+      slot.nFrames = reader_.readRaw(frame, blockFrames_, slot.raw.get());
+      if (slot.nFrames == 0)
+        break;
+      if (converter_)
+        converter_->decode(slot.raw.get(), slot.samples.data(),
+                           slot.nFrames * reader_.getSamplesPerFrame());
+      frame += slot.nFrames;
+      head_ = head + 1;
+      wake(consumerWaiting_);
+    }
+  } catch (const std::string &e) {
+    error_ = e;
+  } catch (const std::exception &e) {
+    // Such as std::bad_alloc, thrown by next() like the library's own errors
+    error_ = std::string(e.what()) + '\n';
+  }
+  done_ = true;
+  wake(consumerWaiting_);
+}
+
+bool StreamReader::next(StreamBlock &block) {
+  uint64_t tail = tail_.load(std::memory_order_relaxed);
+  if (holding_) {
+    holding_ = false;
+    tail_ = ++tail;
+    wake(producerWaiting_);
+  }
+  wait(consumerWaiting_, [this, tail] { return head_ != tail || done_; });
+  // Blocks written before the end are still handed out
+  if (head_ == tail) {
+    if (!error_.empty())
+      throw error_;
+    return false;
+  }
+  const Slot &slot = slots_[tail % slots_.size()];
+  block.frame = slot.frame;
+  block.nFrames = slot.nFrames;
+  block.raw = slot.raw.get();
+  block.samples = converter_ ? slot.samples.data() : nullptr;
+  holding_ = true;
+  return true;
+}
+
+const FrameReader &StreamReader::getFrameReader(void) const {
+  return reader_;
+}
@@ -0,0 +1,117 @@
+#include "ThreadPool.hpp"
+#include <algorithm>
+
+// Pool and index of the worker running on the current thread, if any
+static thread_local ThreadPool *currentPool = nullptr;
+static thread_local unsigned int currentWorker = 0;
+
+ThreadPool::ThreadPool(unsigned int nThreads)
+    : queued_(0), pending_(0), next_(0), stop_(false) {
+  if (nThreads == 0)
+    nThreads = std::max(1u, std::thread::hardware_concurrency());
+  for (unsigned int i = 0; i < nThreads; i++)
+    queues_.push_back(std::unique_ptr<Queue>(new Queue()));
+  for (unsigned int i = 0; i < nThreads; i++)
+    threads_.push_back(std::thread(&ThreadPool::run, this, i));
+}
+
+ThreadPool::~ThreadPool(void) {
+  {
+    // Like wait(), but an exception of a task is not thrown from here
+    std::unique_lock<std::mutex> lock(m_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+    stop_ = true;
+  }
+  cv_.notify_all();
+  for (auto it = threads_.begin(); it != threads_.end(); it++)
+    it->join();
+}
+
+void ThreadPool::submit(const Task &task) {
+  unsigned int worker;
+  {
+    // Counted before it is pushed, so that a worker that pops it at once
+    // never takes queued_ below zero
+    std::lock_guard<std::mutex> lock(m_);
+    pending_++;
+    queued_++;
+    worker = currentPool == this ? currentWorker : next_++ % queues_.size();
+  }
+  try {
+    Queue &q = *queues_[worker];
+    std::lock_guard<std::mutex> lock(q.m);
+    q.tasks.push_back(task);
+  } catch (...) {
+    // A task that could not be queued must not hold wait() back
+    std::lock_guard<std::mutex> lock(m_);
+    queued_--;
+    if (--pending_ == 0)
+      done_.notify_all();
+    throw;
+  }
+  cv_.notify_one();
+}
+
+void ThreadPool::wait(void) {
+  std::exception_ptr error;
+  {
+    std::unique_lock<std::mutex> lock(m_);
+    done_.wait(lock, [this] { return pending_ == 0; });
+    std::swap(error, error_);
+  }
+  if (error)
+    std::rethrow_exception(error);
+}
+
+unsigned int ThreadPool::size(void) const { return threads_.size(); }
+
+bool ThreadPool::pop(const unsigned int worker, Task &task) {
+  // Own queue first, newest task first since it is the most likely to be hot
+  for (size_t i = 0; i < queues_.size(); i++) {
+    Queue &q = *queues_[(worker + i) % queues_.size()];
+    std::lock_guard<std::mutex> lock(q.m);
+    if (q.tasks.empty())
+      continue;
+    if (i == 0) {
+      task = std::move(q.tasks.back());
+      q.tasks.pop_back();
+    } else {
+      // Thieves take the oldest task
+      task = std::move(q.tasks.front());
+      q.tasks.pop_front();
+    }
+    return true;
+  }
+  return false;
+}
+
+void ThreadPool::run(const unsigned int worker) {
+  currentPool = this;
+  currentWorker = worker;
+  while (true) {
+    Task task;
+    if (pop(worker, task)) {
+      {
+        std::lock_guard<std::mutex> lock(m_);
+        queued_--;
+      }
+      // An exception would end the worker, wait() throws it instead
+      std::exception_ptr error;
+      try {
+        task(worker);
+      } catch (...) {
+        error = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(m_);
+      if (error && !error_)
+        error_ = error;
+      if (--pending_ == 0)
+        done_.notify_all();
+      continue;
+    }
+    std::unique_lock<std::mutex> lock(m_);
+    cv_.wait(lock, [this] { return stop_ || queued_ > 0; });
+    if (stop_ && queued_ == 0)
+      return;
+  }
+}
@@ -0,0 +1,163 @@
+#include "Transcoder.hpp"
+#include "FileCopy.hpp"
+#include "FrameReader.hpp"
+#include "WavWriter.hpp"
+#include <algorithm>
+
+// Samples converted at once, the decoded block stays in the cache
+#define TRANSCODE_BLOCK (1 << 16)
+
+// Bytes 2 to 15 of the SubFormat GUID of WAVE_FORMAT_EXTENSIBLE, after the
+// format tag
+#define SUBFORMAT_TAIL "\0\0\0\0\x10\0\x80\0\0\xaa\0\x38\x9b\x71"
+
+static bool isFloat(const SampleType type) {
+  return type == S_FLOAT_32 || type == S_FLOAT_64;
+}
+
+// Bits of resolution, G.711 samples are 13 or 14-bit values
+static unsigned int resolution(const SampleType type) {
+  switch (type) {
+  case S_PCM_U8:
+    return 8;
+  case S_PCM_16:
+    return 16;
+  case S_PCM_24:
+    return 24;
+  case S_PCM_32:
+    return 32;
+  case S_ALAW:
+    return 13;
+  case S_MULAW:
+    return 14;
+  default:
+    return 64;
+  }
+}
+
+Transcoder::Transcoder(const SampleType type, const Dither dither,
+                       const uint32_t seed, const SimdLevel level)
+    : to_(type, level), level_(level), dither_(dither),
+      counter_(seed * 0x9e3779b9u), ditherKernel_(getDitherKernel(level)),
+      floats_(TRANSCODE_BLOCK), ints_(TRANSCODE_BLOCK) {}
+
+bool Transcoder::dithers(const SampleType from) const {
+  SampleType to = to_.getSampleType();
+  return dither_ == DITHER_TPDF &&
+         (to == S_PCM_U8 || to == S_PCM_16 || to == S_PCM_24) &&
+         resolution(from) > resolution(to);
+}
+
+void Transcoder::convert(const SampleConverter &from, const char *src,
+                         char *dst, const size_t nSamples) {
+  const SampleType type = from.getSampleType();
+  const bool dither = dithers(type);
+  // Integers only go through int32 when no bit is lost, otherwise they are
+  // rounded like floats
+  const bool viaFloat = dither || isFloat(type) ||
+                        isFloat(to_.getSampleType()) ||
+                        resolution(type) > resolution(to_.getSampleType());
+  const float lsb =
+      dither ? 1.0f / (1 << (resolution(to_.getSampleType()) - 1)) : 0.0f;
+  const unsigned int inSize = from.getSampleSize(),
+                     outSize = to_.getSampleSize();
+  for (size_t done = 0; done < nSamples;) {
+    size_t n = std::min<size_t>(TRANSCODE_BLOCK, nSamples - done);
+    if (viaFloat) {
+      from.decode(src + done * inSize, floats_.data(), n);
+      if (dither) {
+        ditherKernel_(floats_.data(), n, lsb, counter_);
+        counter_ += n;
+      }
+      to_.encode(floats_.data(), dst + done * outSize, n);
+    } else {
+      from.decode(src + done * inSize, ints_.data(), n);
+      to_.encode(ints_.data(), dst + done * outSize, n);
+    }
+    done += n;
+  }
+}
+
+void Transcoder::setFormat(WavData &wav) const {
+  const SampleType type = to_.getSampleType();
+  uint16_t tag = isFloat(type)         ? WAVE_FORMAT_IEEE_FLOAT
+                 : type == S_ALAW      ? WAVE_FORMAT_ALAW
+                 : type == S_MULAW     ? WAVE_FORMAT_MULAW
+                                       : WAVE_FORMAT_PCM;
+  const uint16_t bits = to_.getSampleSize() * 8;
+  const uint16_t blockAlign = wav.get<FmtSchema::Channels>() * (bits / 8);
+  if (wav.get<FmtSchema::FormatTag>() == WAVE_FORMAT_EXTENSIBLE) {
+    std::string guid = WavData::toByte<uint16_t>(tag) +
+                       std::string(SUBFORMAT_TAIL, sizeof(SUBFORMAT_TAIL) - 1);
+    wav.set<FmtSchema::SubFormat>(guid);
+    wav.set<FmtSchema::ValidBitsPerSample>(bits);
+  } else {
+    wav.set<FmtSchema::FormatTag>(tag);
+  }
+  wav.set<FmtSchema::BitsPerSample>(bits);
+  wav.set<FmtSchema::BlockAlign>(blockAlign);
+  wav.set<FmtSchema::AvgBytesPerSec>(wav.get<FmtSchema::SamplesPerSec>() *
+                                     blockAlign);
+}
+
+uint64_t Transcoder::transcode(WavData &src, const std::string &fn,
+                               bool writeUndefinedChunks) {
+  SampleConverter from(src, level_);
+  const unsigned int blockAlign = src.get<FmtSchema::BlockAlign>();
+  const unsigned int channels = src.get<FmtSchema::Channels>();
+  if (channels == 0 || channels * from.getSampleSize() != blockAlign)
+    throw std::string("Padded frames cannot be transcoded\n");
+
+  // Data stays in the file unless it was loaded already
+  bool fromFile = !src.fn_.empty();
+  for (size_t i = 0; i < src.directory_.size(); i++) {
+    if (src.directory_[i].id == "data")
+      fromFile = fromFile && !src.directory_[i].loaded;
+  }
+  // Mapped samples would be truncated too
+  if (!src.fn_.empty() && isSameFile(src.fn_, fn))
+    throw std::string("Cannot transcode " + fn + " onto itself\n");
+
+  const FourCC data = toFourCC("data");
+  WavData dst;
+  src.copyMetadata(dst, std::vector<FourCC>());
+  setFormat(dst);
+
+  std::unique_ptr<FrameReader> reader;
+  const char *samples = nullptr;
+  uint64_t frameCount;
+  if (fromFile) {
+    reader.reset(new FrameReader(src.fn_));
+    if (reader->getBlockAlign() != blockAlign)
+      throw std::string("The fmt chunk does not match " + src.fn_ + '\n');
+    frameCount = reader->getFrameCount();
+  } else {
+    const FieldValue &val = src.getChunk(data)->getField(0)->val;
+    samples = val.data();
+    frameCount = val.size() / blockAlign;
+  }
+
+  // fact's SampleLength and the sizes are set by the writer
+  WavWriter writer(dst, fn, writeUndefinedChunks);
+  const size_t blockFrames = std::max(1u, TRANSCODE_BLOCK / channels);
+  const unsigned int outAlign = channels * to_.getSampleSize();
+  std::vector<char> in(fromFile ? blockFrames * blockAlign : 0);
+  std::vector<char> out(blockFrames * outAlign);
+  for (uint64_t frame = 0; frame < frameCount;) {
+    size_t n = std::min<uint64_t>(blockFrames, frameCount - frame);
+    const char *raw = in.data();
+    if (!fromFile)
+      raw = samples + frame * blockAlign;
+    else if ((n = reader->readRaw(frame, n, in.data())) == 0)
+      throw std::string("Could not read frames\n");
+    convert(from, raw, out.data(), n * channels);
+    writer.append(out.data(), n * outAlign);
+    frame += n;
+  }
+  writer.finalize();
+  return frameCount;
+}
+
+SampleType Transcoder::getSampleType(void) const {
+  return to_.getSampleType();
+}
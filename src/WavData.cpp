@@ -1,9 +1,20 @@
 #include "WavData.hpp"
+#include "FileCopy.hpp"
+#include "SampleConverter.hpp"
+#include "WavSnapshot.hpp"
+#include <algorithm>
 #include <iostream>
+#include <iterator>
+#include <unistd.h>
 
-#define WAVE_FORMAT_PCM 0x0001
+// Smallest unmodified data chunk that write() copies in the kernel
+#define KERNEL_COPY_MIN (1 << 16)
+// Block size of the chunks that write() copies from a source stream
+#define COPY_BLOCK (1 << 20)
 
-WavData::WavData(void) : riffSize_(4) {
+WavData::WavData(void)
+    : riffSize_(4), rf64_(false), junkReserve_(0), dataAlignment_(1),
+      in_(nullptr), pos_(0), views_(false), out_(nullptr) {
   // RIFF
   Chunk riff("RIFF");
   Chunk::Field field;
@@ -13,116 +24,16 @@ WavData::WavData(void) : riffSize_(4) {
   riff.addField(field);
   addChunk(riff);
 
-  // fmt
-  std::vector<std::string> fmtNames = {
-      "FormatTag",   "Channels",      "SamplesPerSec", "AvgBytesPerSec",
-      "BlockAlign",  "BitsPerSample", "Size",          "ValidBitsPerSample",
-      "ChannelMask", "SubFormat[16]"};
-
-  std::vector<unsigned int> fmtSizes = {2, 2, 4, 4, 2, 2, 2, 2, 4, 16};
-
-  std::vector<F_TYPE> fmtTypes = {F_INT, F_INT, F_INT, F_INT, F_INT,
-                                  F_INT, F_INT, F_INT, F_INT, F_BYTE_ARRAY};
-
-  // Only fmt has variable amounts of fields (not to be confused with variable
-  // size)
-  Chunk fmtChunk("fmt ");
-  for (int i = 0; i < fmtNames.size(); i++) {
-    Chunk::Field f;
-    f.name = fmtNames[i];
-    f.nBytes = fmtSizes[i];
-    f.type = fmtTypes[i];
-    fmtChunk.addField(f);
-  }
+  // Chunks are built from their schemas once, then copied
+  static const Chunk fmtChunk = makeChunk<FmtSchema>();
+  static const Chunk bextChunk = makeChunk<BextSchema>();
+  static const Chunk factChunk = makeChunk<FactSchema>();
+  static const Chunk cartChunk = makeChunk<CartSchema>();
+  static const Chunk dataChunk = makeChunk<DataSchema>();
   addChunk(fmtChunk);
-
-  // bext
-  std::vector<std::string> bextNames = {"Description",
-                                        "Originator",
-                                        "OriginatorReference",
-                                        "OriginationDate",
-                                        "OriginationTime",
-                                        "TimeReferenceLow",
-                                        "TimeReferenceHigh",
-                                        "Version",
-                                        "UMID[64]",
-                                        "LoudnessValue",
-                                        "LoudnessRange",
-                                        "MaxTruePeakLevel",
-                                        "MaxMomentaryLoudness",
-                                        "MaxShortTermLoudness",
-                                        "Reserved",
-                                        "CodingHistory"};
-  std::vector<unsigned int> bextSizes = {256, 32, 32, 10, 8, 4, 4,   2,
-                                         64,  2,  2,  2,  2, 2, 180, 0};
-  std::vector<F_TYPE> bextTypes = {F_STRING,     F_STRING, F_STRING, F_STRING,
-                                   F_STRING,     F_UINT,   F_UINT,   F_INT,
-                                   F_BYTE_ARRAY, F_SHORT,  F_SHORT,  F_SHORT,
-                                   F_SHORT,      F_SHORT,  F_NDEF,   F_NDEF};
-
-  Chunk bextChunk("bext");
-  for (int i = 0; i < bextNames.size(); i++) {
-    Chunk::Field f;
-    f.name = bextNames[i];
-    f.nBytes = bextSizes[i];
-    f.type = bextTypes[i];
-    bextChunk.addField(f);
-  }
-  bextChunk.makeVariable();
   addChunk(bextChunk);
-
-  // fact
-  Chunk factChunk("fact");
-  Chunk::Field sampleL;
-  sampleL.name = "SampleLength";
-  sampleL.nBytes = 4;
-  sampleL.type = F_INT;
-  factChunk.addField(sampleL);
   addChunk(factChunk);
-
-  // cart
-  Chunk cartChunk("cart");
-  std::vector<std::string> cartNames = {"Version",
-                                        "Title",
-                                        "Artist",
-                                        "CutID",
-                                        "ClientID",
-                                        "Category",
-                                        "Classification",
-                                        "OutCue",
-                                        "StartDate",
-                                        "StartTime",
-                                        "EndDate",
-                                        "EndTime",
-                                        "ProducerAppID",
-                                        "ProducerAppVersion",
-                                        "UserDef",
-                                        "LevelReference",
-                                        "PostTimer",
-                                        "Reserved",
-                                        "URL",
-                                        "TagText"};
-  std::vector<unsigned int> cartSizes = {4,  64, 64, 64,  64,   64, 64,
-                                         64, 10, 8,  10,  8,    64, 64,
-                                         64, 4,  8,  276, 1024, 0};
-
-  for (int i = 0; i < cartNames.size(); i++) {
-    Chunk::Field f;
-    f.name = cartNames[i];
-    f.nBytes = cartSizes[i];
-    f.type = F_STRING;
-    cartChunk.addField(f);
-  }
-  cartChunk.makeVariable();
   addChunk(cartChunk);
-
-  Chunk dataChunk("data");
-  Chunk::Field dataField;
-  dataField.name = "data";
-  dataField.nBytes = 0;
-  dataField.type = F_NDEF;
-  dataChunk.addField(dataField);
-  dataChunk.makeVariable();
   addChunk(dataChunk);
 }
 
@@ -131,192 +42,1026 @@ WavData::WavData(std::vector<Chunk> chunks) : WavData() {
     addChunk(*it);
 }
 
+WavData::WavData(const WavSnapshot &snapshot) : WavData() {
+  auto ids = snapshot.getChunkIds();
+  for (auto it = ids.begin(); it != ids.end(); it++)
+    chunks_[*it] = std::make_shared<Chunk>(*snapshot.getChunk(*it));
+}
+
 WavData::~WavData(void) {}
 
 std::shared_ptr<Chunk> WavData::getChunk(const std::string &name) {
-  return chunks_[name];
+  // IDs that are not 4 characters long cannot be in the table
+  if (name.size() != ID_SIZE)
+    return nullptr;
+  return getChunk(toFourCC(name.data()));
 }
 
-std::map<std::string, std::shared_ptr<Chunk>>
-WavData::getAllChunks(void) const {
-  return chunks_;
+std::shared_ptr<Chunk> WavData::getChunk(const FourCC key) {
+  loadChunk(key);
+  // A missing chunk is not inserted
+  std::shared_ptr<Chunk> *ck = chunks_.find(key);
+  return ck ? *ck : nullptr;
+}
+
+std::map<std::string, std::shared_ptr<Chunk>> WavData::getAllChunks(void) {
+  loadAllChunks();
+  std::map<std::string, std::shared_ptr<Chunk>> chunks;
+  chunks_.forEach([&chunks](FourCC key, std::shared_ptr<Chunk> &ck) {
+    chunks[fourCCString(key)] = ck;
+  });
+  return chunks;
 }
 
 void WavData::addChunk(const Chunk &chunk) {
-  if (exists(chunk.getChunkName()))
+  FourCC key = toFourCC(chunk.getChunkName().data());
+  // A lazy read may not have loaded the chunk of the file yet
+  loadChunk(key);
+  if (exists(key))
     return;
-  std::shared_ptr<Chunk> ch = std::make_shared<Chunk>(chunk);
-  chunks_[chunk.getChunkName()] = ch;
+  chunks_[key] = std::make_shared<Chunk>(chunk);
 }
 
-void WavData::readChunk(std::string &readData) {
-  // If the chunk is not defined and is not considered junk, it is saved as
-  // undefined
-  if (!exists(readData)) {
-    if (readData != "JUNK") {
-      saveUndefinedChunk(readData);
-    } else {
-      readBytes(CK_SIZE_BYTES, readData);
-      r_.ignore(toType<unsigned int>(readData));
-    }
-    return;
-  }
-  auto ck = chunks_[readData];
-  readBytes(CK_SIZE_BYTES, readData);
-  unsigned int ckSize = toType<unsigned int>(readData);
+void WavData::readChunk(const FourCC key, const uint64_t ckSize) {
+  auto ck = *chunks_.find(key);
 
   // If the expected chunk size is bigger than what is read, it is ignored
   // Only fmt is processed because it guarantees backward compatibility
   // Alternatively, an error could be raised
-  if (ck->getSize() > ckSize && ck->getChunkName() != "fmt ") {
-    r_.ignore(ckSize);
+  if (ck->getSize() > ckSize && ck->getChunkName() != "fmt ")
     return;
-  }
+  ck->resetChunk();
+  if (views_)
+    ck->mapping_ = map_;
 
   // Saving the amount of expected bytes into the proper fields
-  auto fields = ck->getAllFields();
-  unsigned int i = 0;     // field index
-  unsigned int count = 0; // amount of bytes read
-  while (count < ckSize) {
-    unsigned int size = fields[i]->nBytes;
+  std::vector<Chunk::Field> &fields = ck->fields_;
+  size_t n = 0;       // amount of fields read
+  uint64_t count = 0; // amount of bytes read
+  while (count < ckSize && n < fields.size()) {
+    uint64_t size = fields[n].nBytes;
     if (count + size > ckSize)
       break;
     // Variable chunks get the rest in their last field (like TagText)
     if (size == 0) {
       if (ck->isVariable()) {
-        fields[i]->nBytes = ckSize - count;
-        readBytes(fields[i]->nBytes, fields[i]->val);
-        count += fields[i++]->nBytes;
+        fields[n++].nBytes = ckSize - count;
+        count = ckSize;
         break; // There should be no field in that chunk after a variable one
       } else {
         throw std::string("A defined field is variable but the chunk is not\n");
       }
     }
     count += size;
-    readBytes(size, fields[i++]->val);
+    n++;
+  }
+
+  // Fields are laid out in the arena like in the file, so the body is read
+  // with one copy (or none when mapped)
+  uint64_t available;
+  if (views_) {
+    available = std::min<uint64_t>(count, map_->size() - pos_);
+  } else {
+    for (size_t i = 0; i < n; i++)
+      fields[i].val.resize(fields[i].nBytes);
+    available = n ? readBytes(count, &ck->arena_[0]) : 0;
+  }
+  // A truncated file leaves the last fields short or empty
+  uint64_t offset = 0;
+  for (size_t i = 0; i < n; i++) {
+    uint64_t size = std::min(fields[i].nBytes, available - offset);
+    if (views_)
+      fields[i].val.setView(map_->data() + pos_ + offset, size);
+    else
+      fields[i].val.resize(size);
+    offset += size;
   }
+  if (views_)
+    pos_ += available;
+  ck->markClean();
 }
 
-void WavData::read(const std::string &fn) {
+void WavData::scanChunks(void) {
+  std::string data;
+  // Trailing bytes that cannot hold a chunk header are not a chunk
+  while (readBytes(ID_SIZE, data) == ID_SIZE) {
+    ChunkEntry entry;
+    entry.id = data;
+    if (readBytes(CK_SIZE_BYTES, data) < CK_SIZE_BYTES)
+      break;
+    entry.size = toType<unsigned int>(data);
+    entry.offset = tell();
+    entry.loaded = false;
+    if (entry.id == "ds64" && rf64_ && directory_.empty())
+      readDs64(entry.size);
+    else if (entry.size == MAX_CHUNK_SIZE &&
+             ds64Sizes_.find(toFourCC(entry.id.data())))
+      entry.size = *ds64Sizes_.find(toFourCC(entry.id.data()));
+    directory_.push_back(entry);
+    // Chunks are word aligned, odd sized ones are followed by a pad byte
+    seek(entry.offset + entry.size + (entry.size & 1));
+  }
+}
+
+void WavData::readDs64(const uint64_t ckSize) {
+  // riffSize, dataSize and sampleCount, then a table of other chunk sizes
+  std::string data;
+  if (ckSize < 28 || readBytes(28, data) < 28)
+    throw std::string("Malformed ds64 chunk\n");
+  ds64Sizes_[toFourCC("RIFF")] = toType<uint64_t>(data.substr(0, 8));
+  ds64Sizes_[toFourCC("data")] = toType<uint64_t>(data.substr(8, 8));
+  unsigned int tableLength = toType<unsigned int>(data.substr(24, 4));
+  for (unsigned int i = 0; i < tableLength && 28 + 12 * (i + 1) <= ckSize;
+       i++) {
+    if (readBytes(12, data) < 12)
+      break;
+    ds64Sizes_[toFourCC(data.data())] = toType<uint64_t>(data.substr(4, 8));
+  }
+}
+
+void WavData::loadEntry(const size_t index) {
+  ChunkEntry &entry = directory_[index];
+  entry.loaded = true;
+  FourCC key = toFourCC(entry.id.data());
+  // Junk and ds64 are never kept, they are only known to the directory, and
+  // removed chunks are not brought back
+  if (key == toFourCC("JUNK") || key == toFourCC("ds64") || removed_.find(key))
+    return;
+  seek(entry.offset);
+  // If the chunk is not defined, it is saved as undefined (only the first one
+  // of a given ID is kept) and a defined chunk holds the last one
+  if (!exists(key)) {
+    saveUndefinedChunk(entry.id, entry.size);
+    if (exists(key))
+      entryOf_[key] = index;
+  } else {
+    readChunk(key, entry.size);
+    entryOf_[key] = index;
+  }
+}
+
+void WavData::loadChunk(const FourCC key) {
+  for (size_t i = 0; i < directory_.size(); i++) {
+    if (!directory_[i].loaded && toFourCC(directory_[i].id.data()) == key)
+      loadEntry(i);
+  }
+}
+
+void WavData::loadAllChunks(void) {
+  for (size_t i = 0; i < directory_.size(); i++) {
+    if (!directory_[i].loaded)
+      loadEntry(i);
+  }
+}
+
+void WavData::loadMetadata(void) {
+  for (size_t i = 0; i < directory_.size(); i++) {
+    if (!directory_[i].loaded && directory_[i].id != "data")
+      loadEntry(i);
+  }
+}
+
+void WavData::copyMetadata(WavData &dst, const std::vector<FourCC> &drop) {
+  // dst gets the same chunks (default ones included) but data and the
+  // dropped ones, the samples stay in the file
+  loadMetadata();
+  const FourCC data = toFourCC("data");
+  auto keys = dst.chunks_.keys();
+  for (auto it = keys.begin(); it != keys.end(); it++)
+    dst.chunks_.erase(*it);
+  chunks_.forEach([&](const FourCC key, std::shared_ptr<Chunk> &ck) {
+    if (ck && key != data &&
+        std::find(drop.begin(), drop.end(), key) == drop.end())
+      dst.chunks_[key] = std::make_shared<Chunk>(*ck);
+  });
+  dst.junkReserve_ = junkReserve_;
+  dst.dataAlignment_ = dataAlignment_;
+}
+
+void WavData::closeSource(void) {
+  map_.reset();
+  views_ = false;
+  in_ = nullptr;
+  if (r_.is_open())
+    r_.close();
+}
+
+void WavData::beginRead(void) {
+  // Undefined chunks come from the previous file and a reused WavData must
+  // not parse the next one with their sizes
+  chunks_.eraseIf([](FourCC, std::shared_ptr<Chunk> &ck) {
+    return !ck || ck->isUndefined();
+  });
   resetData();
-  r_.open(fn, std::ifstream::binary);
-  assert(r_.is_open());
+  fn_.clear();
+}
+
+void WavData::read(const std::string &fn, int flags) {
+  beginRead();
+  fn_ = fn;
+  if (flags & READ_MAPPED) {
+    map_ = std::make_shared<const MappedFile>(fn);
+    pos_ = 0;
+    views_ = true;
+  } else {
+    r_.open(fn, std::ifstream::binary);
+    assert(r_.is_open());
+    in_ = &r_;
+  }
+  parse(flags);
+}
 
-  // RIFF check
-  auto riff = chunks_["RIFF"];
+void WavData::readBuffer(const char *data, const size_t nBytes,
+                         int flags) {
+  beginRead();
+  map_ = std::make_shared<const MappedFile>(data, nBytes);
+  pos_ = 0;
+  views_ = flags & READ_MAPPED;
+  parse(flags);
+}
+
+void WavData::read(std::istream &is, int flags) {
+  beginRead();
+  if (is.tellg() < 0) {
+    // Without seeks, the whole file is copied once into the fields
+    std::string data((std::istreambuf_iterator<char>(is)),
+                     std::istreambuf_iterator<char>());
+    map_ = std::make_shared<const MappedFile>(data.data(), data.size());
+    pos_ = 0;
+    parse(READ_COPY);
+    return;
+  }
+  in_ = &is;
+  parse(flags & ~READ_MAPPED);
+}
+
+void WavData::parse(int flags) {
+  // RIFF check, RF64 and BW64 sizes are in a ds64 chunk
   std::string data;
   readBytes(ID_SIZE, data);
-  if (data.compare(0, ID_SIZE, "RIFF"))
+  rf64_ = data == "RF64" || data == "BW64";
+  if (data.compare(0, ID_SIZE, "RIFF") && !rf64_)
     throw std::string("Not a RIFF compliant file format\n");
   readBytes(CK_SIZE_BYTES, data);
-  unsigned int ckSize = toType<unsigned int>(data);
   readBytes(4, data);
   if (data.compare(0, ID_SIZE, "WAVE"))
     throw std::string("Not an adequate wav file format\n");
 
-  // Reading chunks
-  while (!r_.eof()) {
-    readBytes(ID_SIZE, data);
-    readChunk(data);
-  }
-  r_.close();
+  // Only headers are read, bodies are loaded now or when they are accessed
+  scanChunks();
+  if (flags & READ_LAZY)
+    return;
+  loadAllChunks();
+  // Chunks that hold views keep the mapping alive on their own
+  closeSource();
+}
+
+WavSnapshot WavData::snapshot(void) {
+  // Copies, so that later edits and reads of this object never reach it
+  loadAllChunks();
+  auto state = std::make_shared<WavSnapshot::State>();
+  chunks_.forEach([&state](FourCC key, std::shared_ptr<Chunk> &ck) {
+    state->chunks[key] = std::make_shared<const Chunk>(*ck);
+  });
+  state->directory = directory_;
+  state->rf64 = rf64_;
+  return WavSnapshot(state);
 }
 
+std::vector<WavData::ChunkEntry> WavData::getChunkDirectory(void) const {
+  return directory_;
+}
+
+bool WavData::isRF64(void) const { return rf64_; }
+
 void WavData::write(const std::string &fn, bool writeUndefinedChunks) {
-  assert(exists("RIFF") && exists("fmt ") && exists("data") && exists("fact"));
+  // A data chunk that is unchanged since read() is copied from the source
+  // file by the kernel instead of being read and written again
+  ChunkEntry source;
+  bool sameFile = isSameFile(fn_, fn);
+  bool copyData = !sameFile && unmodifiedData(source);
+  // The source is truncated below, views into it are copied first
+  if (sameFile) {
+    loadAllChunks();
+    chunks_.forEach([](FourCC, std::shared_ptr<Chunk> &ck) {
+      for (auto f = ck->fields_.begin(); f != ck->fields_.end(); f++)
+        f->val.materialize();
+    });
+  }
   w_.open(fn, std::ios::binary);
   assert(w_.is_open());
-  // For every chunk, update the RIFF size
-  for (auto it = chunks_.begin(); it != chunks_.end(); it++) {
-    auto fields = it->second->getAllFields();
-    // For every field of every chunk, update the chunk size first
-    for (auto f = fields.begin(); f != fields.end(); f++) {
-      // If the user has updated a variable field but not its size
-      if ((*f)->nBytes == 0 && (*f)->val.size() != 0)
-        (*f)->nBytes = (*f)->val.size();
-      it->second->addToActualSize((*f)->nBytes);
+  uint64_t dataOffset = writeTo(w_, writeUndefinedChunks,
+                                copyData ? &source : nullptr);
+  w_.close();
+  if (copyData)
+    copyFileRange(fn_, source.offset, fn, dataOffset, source.size);
+}
+
+void WavData::write(std::ostream &os, bool writeUndefinedChunks) {
+  writeTo(os, writeUndefinedChunks, nullptr);
+  if (!os)
+    throw std::string("Could not write the file to the stream\n");
+}
+
+/**
+ * @brief Stream buffer over a fixed array that fails when it is full
+ */
+class ArrayBuffer : public std::streambuf {
+public:
+  ArrayBuffer(char *data, const size_t size) { setp(data, data + size); }
+
+  size_t size(void) const { return pptr() - pbase(); }
+};
+
+size_t WavData::writeBuffer(char *buffer, const size_t capacity,
+                            bool writeUndefinedChunks) {
+  ArrayBuffer sink(buffer, capacity);
+  std::ostream os(&sink);
+  writeTo(os, writeUndefinedChunks, nullptr);
+  if (!os)
+    throw std::string("The file does not fit in the buffer\n");
+  return sink.size();
+}
+
+uint64_t WavData::writeTo(std::ostream &os, bool writeUndefinedChunks,
+                          const ChunkEntry *source) {
+  assert(exists("RIFF") && exists("fmt ") && exists("data") && exists("fact"));
+  const FourCC data = toFourCC("data");
+  // Chunks that were never loaded (READ_LAZY) are copied from the source as
+  // they are, the others are loaded to be written
+  findCopies();
+  if (source)
+    copies_.erase(data);
+  for (size_t i = 0; i < directory_.size(); i++) {
+    const ChunkEntry &e = directory_[i];
+    if (e.loaded || (source && e.id == "data") ||
+        copies_.find(toFourCC(e.id.data())))
+      continue;
+    loadEntry(i);
+  }
+  out_ = &os;
+  auto order = writeOrder(writeUndefinedChunks);
+  // For every written chunk (RIFF is first), update the RIFF size
+  riffSize_ = 4;
+  std::map<std::string, uint64_t> table;
+  for (auto it = order.begin() + 1; it != order.end(); it++) {
+    const size_t *copy = copies_.find(*it);
+    uint64_t size = 0;
+    if (source && *it == data) {
+      size = source->size;
+    } else if (copy) {
+      size = directory_[*copy].size;
+    } else {
+      // For every field of every chunk, update the chunk size first
+      auto ck = *chunks_.find(*it);
+      for (auto f = ck->fields_.begin(); f != ck->fields_.end(); f++) {
+        // If the user has updated a variable field but not its size
+        if (f->nBytes == 0 && f->val.size() != 0)
+          f->nBytes = f->val.size();
+        size += f->nBytes;
+      }
     }
+    // Undefined chunks that are copied have no Chunk object
+    std::shared_ptr<Chunk> *ck = chunks_.find(*it);
+    if (ck)
+      (*ck)->setActualSize(size);
     // Then update the RIFF size
-    riffSize_ += it->second->getActualSize() + 4 + 4;
+    riffSize_ += footprint(size);
+    if (*it != data && size > MAX_CHUNK_SIZE)
+      table[fourCCString(*it)] = size;
+  }
+
+  // The data chunk is last, the JUNK chunk of the layout goes before it
+  const uint64_t dataSize =
+      source ? source->size : (*chunks_.find(data))->getActualSize();
+  const uint64_t chunksSize = riffSize_;
+  uint64_t junk = junkFootprint(chunksSize + 8 - footprint(dataSize),
+                                dataAlignment_);
+  riffSize_ = chunksSize + junk;
+
+  // Files that outgrow 32-bit sizes are promoted to RF64
+  std::string ds64;
+  if (riffSize_ > MAX_CHUNK_SIZE) {
+    unsigned int blockAlign =
+        (*chunks_.find(toFourCC("fmt ")))->get<FmtSchema::BlockAlign>();
+    uint64_t ds64Size = footprint(28 + 12 * table.size());
+    junk = junkFootprint(chunksSize + ds64Size + 8 - footprint(dataSize),
+                         dataAlignment_);
+    riffSize_ = chunksSize + ds64Size + junk;
+    ds64 = ds64Body(riffSize_, dataSize, blockAlign ? dataSize / blockAlign : 0,
+                    table);
+  }
+  writeBytes(ds64.empty() ? "RIFF" : "RF64");
+  writeBytes(toByte<unsigned int>(std::min<uint64_t>(riffSize_, MAX_CHUNK_SIZE)));
+  writeFields(**chunks_.find(toFourCC("RIFF")));
+  if (!ds64.empty()) {
+    writeBytes("ds64");
+    writeBytes(toByte<unsigned int>(ds64.size()));
+    writeBytes(ds64);
+  }
+  uint64_t dataOffset = 0;
+  for (auto it = order.begin() + 1; it != order.end(); it++) {
+    if (*it == data)
+      writeJunk(os, junk);
+    const size_t *copy = copies_.find(*it);
+    if (copy) {
+      copyEntry(directory_[*copy]);
+      continue;
+    } else if (!source || *it != data) {
+      writeChunk(*it);
+      continue;
+    }
+    // Only the header, the body is left as a hole that is filled once the
+    // stream is closed
+    writeBytes("data");
+    writeBytes(toByte<unsigned int>(
+        std::min<uint64_t>(source->size, MAX_CHUNK_SIZE)));
+    dataOffset = os.tellp();
+    os.seekp(source->size, std::ios::cur);
+    if (source->size & 1)
+      writeBytes(std::string(1, '\0'));
+  }
+  out_ = nullptr;
+  copies_.clear();
+  return dataOffset;
+}
+
+void WavData::findCopies(void) {
+  copies_.clear();
+  // The source is only kept open by lazy reads
+  if (!in_ && !map_)
+    return;
+  // A defined chunk is loaded from its last entry and an undefined one from
+  // its first entry. Chunks with a loaded entry are never copied. The write
+  // order and ds64 depend on fmt, which is always loaded.
+  const size_t none = directory_.size();
+  for (size_t i = 0; i < directory_.size(); i++) {
+    const ChunkEntry &e = directory_[i];
+    if (e.id == "JUNK" || e.id == "ds64" || e.id == "fmt ")
+      continue;
+    FourCC key = toFourCC(e.id.data());
+    size_t *copy = copies_.find(key);
+    if (e.loaded)
+      copies_[key] = none;
+    else if (!copy)
+      copies_[key] = i;
+    else if (*copy != none && exists(key))
+      *copy = i;
+  }
+  // Only chunks that would be written back with the same bytes are copied
+  uint64_t end = sourceSize();
+  copies_.eraseIf([this, none, end](FourCC key, size_t &index) {
+    if (index == none)
+      return true;
+    const ChunkEntry &e = directory_[index];
+    if (e.offset + e.size > end)
+      return true;
+    const std::shared_ptr<Chunk> *ck = chunks_.find(key);
+    if (!ck)
+      return false;
+    return (*ck)->isVariable() ? e.size < (*ck)->getSize()
+                               : e.size != (*ck)->getSize();
+  });
+}
+
+void WavData::copyEntry(const ChunkEntry &entry) {
+  writeBytes(entry.id);
+  writeBytes(
+      toByte<unsigned int>(std::min<uint64_t>(entry.size, MAX_CHUNK_SIZE)));
+  if (map_) {
+    writeBytes(map_->data() + entry.offset, entry.size);
+  } else {
+    // Large chunks are copied block by block
+    seek(entry.offset);
+    std::string block;
+    for (uint64_t left = entry.size; left != 0;) {
+      size_t n = readBytes(std::min<uint64_t>(left, COPY_BLOCK), block);
+      if (n == 0)
+        throw std::string("Could not copy the " + entry.id + " chunk\n");
+      writeBytes(block);
+      left -= n;
+    }
+  }
+  // Chunks are word aligned
+  if (entry.size & 1)
+    writeBytes(std::string(1, '\0'));
+}
+
+uint64_t WavData::sourceSize(void) {
+  if (map_)
+    return map_->size();
+  in_->clear();
+  in_->seekg(0, std::ios::end);
+  return in_->tellg();
+}
+
+bool WavData::unmodifiedData(ChunkEntry &source) const {
+  // Only files can be copied from
+  if (fn_.empty())
+    return false;
+  // The last data chunk of the file is the one that is read
+  size_t index = directory_.size();
+  for (size_t i = 0; i < directory_.size(); i++) {
+    if (directory_[i].id == "data")
+      index = i;
+  }
+  if (index == directory_.size())
+    return false;
+  const ChunkEntry &entry = directory_[index];
+  // Small chunks are faster to write from memory than to copy
+  if (entry.size < KERNEL_COPY_MIN)
+    return false;
+  // Not read yet (READ_LAZY) or not modified since it was read
+  if (entry.loaded) {
+    const size_t *loaded = entryOf_.find(toFourCC("data"));
+    if (!loaded || *loaded != index ||
+        (*chunks_.find(toFourCC("data")))->isDirty())
+      return false;
   }
+  // Truncated files are read with what is left of the data chunk
+  if (entry.offset + entry.size > fileSize(fn_))
+    return false;
+  source = entry;
+  return true;
+}
+
+std::vector<FourCC> WavData::writeOrder(bool writeUndefinedChunks) const {
   // RIFF and fmt first
-  writeChunk("RIFF");
-  writeChunk("fmt ");
+  const FourCC riff = toFourCC("RIFF"), fmt = toFourCC("fmt "),
+               fact = toFourCC("fact");
+  std::vector<FourCC> order = {riff, fmt};
   // non-PCM data must have a fact chunk
-  if (toType<int>(chunks_["fmt "]->getField("FormatTag")->val) !=
-      WAVE_FORMAT_PCM)
-    writeChunk("fact");
-  for (auto it = chunks_.begin(); it != chunks_.end(); it++) {
-    if (it->first == "RIFF" || it->first == "fmt " || it->first == "fact")
+  if ((*chunks_.find(fmt))->get<FmtSchema::FormatTag>() != WAVE_FORMAT_PCM)
+    order.push_back(fact);
+  // Then the others in the order of their IDs, with the undefined chunks
+  // that are copied without being loaded
+  auto keys = chunks_.keys();
+  auto copies = copies_.keys();
+  for (auto it = copies.begin(); it != copies.end(); it++) {
+    if (!exists(*it))
+      keys.push_back(*it);
+  }
+  std::sort(keys.begin(), keys.end());
+  const FourCC data = toFourCC("data");
+  for (auto it = keys.begin(); it != keys.end(); it++) {
+    const std::shared_ptr<Chunk> *ck = chunks_.find(*it);
+    if (*it == riff || *it == fmt || *it == fact || *it == data)
       continue;
-    else if (writeUndefinedChunks || !chunks_[it->first]->isUndefined())
-      writeChunk(it->first);
+    else if (writeUndefinedChunks || (ck && !(*ck)->isUndefined()))
+      order.push_back(*it);
   }
-  w_.close();
+  // The samples come after all the metadata, so that a file streamed from
+  // its start has every chunk before its first sample
+  order.push_back(data);
+  return order;
+}
+
+std::string WavData::serializeChunk(const Chunk &ck) const {
+  std::string body;
+  for (auto it = ck.fields_.begin(); it != ck.fields_.end(); it++) {
+    const FieldValue &val = it->val;
+    // Variable fields that were set without their size take the value's size
+    size_t nBytes = it->nBytes ? it->nBytes : val.size();
+    if (val.size() > nBytes)
+      throw std::string(
+          "Size of the field\'s value is greater than the defined size\n");
+    body.append(val.data(), val.size());
+    body.append(nBytes - val.size(), '\0');
+  }
+  return body;
+}
+
+
+uint64_t WavData::junkFootprint(const uint64_t offset,
+                                const uint32_t alignment) const {
+  // The data body starts after the JUNK chunk and the data header
+  if (junkReserve_ == 0 && (offset + 8) % alignment == 0)
+    return 0;
+  uint64_t size = footprint(junkReserve_ + (junkReserve_ & 1));
+  return size + (alignment - (offset + size + 8) % alignment) % alignment;
+}
+
+void WavData::writeJunk(std::ostream &os, const uint64_t footprint) {
+  if (footprint == 0)
+    return;
+  os.write("JUNK", ID_SIZE);
+  os.write(toByte<unsigned int>(footprint - 8).data(), CK_SIZE_BYTES);
+  // Zeros are written block by block, reserves can be large
+  static const char zeros[4096] = {};
+  for (uint64_t left = footprint - 8; left != 0;) {
+    size_t n = std::min<uint64_t>(left, sizeof(zeros));
+    os.write(zeros, n);
+    left -= n;
+  }
+}
+
+void WavData::setLayout(const uint32_t junkReserve,
+                        const uint32_t dataAlignment) {
+  if (dataAlignment == 0 || (dataAlignment & (dataAlignment - 1)))
+    throw std::string("The alignment of the data chunk must be a power of 2\n");
+  junkReserve_ = junkReserve;
+  dataAlignment_ = dataAlignment;
+}
+
+void WavData::writeHeader(std::fstream &f, const uint64_t offset,
+                          const std::string &id, const unsigned int size) {
+  f.seekp(offset);
+  f.write(id.data(), ID_SIZE);
+  f.write(toByte<unsigned int>(size).data(), CK_SIZE_BYTES);
+}
+
+uint64_t WavData::footprint(const uint64_t size) {
+  return ID_SIZE + CK_SIZE_BYTES + size + (size & 1);
+}
+
+std::string
+WavData::ds64Body(const uint64_t riffSize, const uint64_t dataSize,
+                  const uint64_t sampleCount,
+                  const std::map<std::string, uint64_t> &table) {
+  std::string body = toByte<uint64_t>(riffSize) + toByte<uint64_t>(dataSize) +
+                     toByte<uint64_t>(sampleCount) +
+                     toByte<unsigned int>(table.size());
+  for (auto it = table.begin(); it != table.end(); it++)
+    body += it->first + toByte<uint64_t>(it->second);
+  return body;
+}
+
+void WavData::patch(void) {
+  if (fn_.empty())
+    throw std::string("Nothing was read so there is no file to patch\n");
+  std::fstream f(fn_, std::ios::in | std::ios::out | std::ios::binary);
+  if (!f.is_open())
+    throw std::string("Could not open " + fn_ + " to patch it\n");
+  f.seekg(0, std::ios::end);
+  uint64_t end = f.tellg();
+
+  // Chunks given to removeChunk() become junk so that other readers skip
+  // them, whether their bodies were loaded or not. ds64 and empty undefined
+  // chunks are never kept, so they stay. A chunk added again after its
+  // removal is written as a new one.
+  for (size_t i = 0; i < directory_.size(); i++) {
+    ChunkEntry &e = directory_[i];
+    if (e.id == "JUNK" || !removed_.find(toFourCC(e.id.data())))
+      continue;
+    e.id = "JUNK";
+    e.size += e.size & 1;
+    writeHeader(f, e.offset - ID_SIZE - CK_SIZE_BYTES, e.id, e.size);
+  }
+  removed_.forEach([this](FourCC key, bool &) { entryOf_.erase(key); });
+  removed_.clear();
+
+  auto keys = chunks_.keys();
+  for (auto it = keys.begin(); it != keys.end(); it++) {
+    Chunk &ck = **chunks_.find(*it);
+    if (*it == toFourCC("RIFF"))
+      continue;
+    size_t *entry = entryOf_.find(*it);
+    bool inFile = entry != nullptr;
+    // Chunks that were not read (READ_LAZY) or not modified are unchanged
+    if (inFile && (!directory_[*entry].loaded || !ck.isDirty()))
+      continue;
+
+    std::string body = serializeChunk(ck);
+    if (!inFile) {
+      // Default chunks that were never set are not added to the file
+      if (body.find_first_not_of('\0') == std::string::npos)
+        continue;
+      ChunkEntry e;
+      e.id = ck.getChunkName();
+      e.loaded = true;
+      size_t placed = placeInJunk(f, e, body);
+      if (placed == directory_.size()) {
+        appendChunk(f, end, e, body);
+        directory_.push_back(e);
+      }
+      entryOf_[*it] = placed;
+      ck.markClean();
+      continue;
+    }
+
+    size_t index = *entry;
+    ChunkEntry &e = directory_[index];
+    // Fields that were not in the file are not added if they were not set
+    size_t used = body.find_last_not_of('\0') + 1;
+    if (body.size() > e.size)
+      body.resize(std::max<size_t>(e.size, used));
+
+    std::string old(e.size, '\0');
+    f.seekg(e.offset);
+    f.read(&old[0], e.size);
+    // The file holds the chunk as it is now
+    ck.markClean();
+    if (body == old)
+      continue;
+
+    // The chunk's own views are about to be overwritten
+    for (auto fi = ck.fields_.begin(); fi != ck.fields_.end(); fi++)
+      fi->val.materialize();
+
+    // Space of the chunk and of the junk that directly follows it
+    uint64_t start = e.offset - ID_SIZE - CK_SIZE_BYTES;
+    uint64_t available = footprint(e.size);
+    size_t next = index + 1;
+    while (next < directory_.size() && directory_[next].id == "JUNK" &&
+           directory_[next].offset == start + available + 8) {
+      available += footprint(directory_[next].size);
+      next++;
+    }
+    // The last chunk of the file can grow freely
+    bool last = next == directory_.size() && start + available >= end;
+    uint64_t needed = footprint(body.size());
+
+    // Absorbed junk is dropped from the directory
+    directory_.erase(directory_.begin() + index + 1, directory_.begin() + next);
+    shiftEntries(index, index + 1 - next);
+    if (last || needed == available || needed + 8 <= available) {
+      e.size = body.size();
+      writeHeader(f, start, e.id, e.size);
+      f.write(body.data(), body.size());
+      if (body.size() & 1)
+        f.put('\0');
+      if (last) {
+        end = start + needed;
+      } else if (needed < available) {
+        // What is left becomes a single junk chunk
+        ChunkEntry junk;
+        junk.id = "JUNK";
+        junk.offset = start + needed + 8;
+        junk.size = available - needed - 8;
+        junk.loaded = true;
+        writeHeader(f, start + needed, junk.id, junk.size);
+        directory_.insert(directory_.begin() + index + 1, junk);
+        shiftEntries(index, 1);
+      }
+    } else {
+      // Moved into junk or to the end of the file, its old place becomes
+      // junk
+      ChunkEntry moved = e;
+      e.id = "JUNK";
+      e.size = available - 8;
+      writeHeader(f, start, e.id, e.size);
+      size_t placed = placeInJunk(f, moved, body);
+      if (placed == directory_.size()) {
+        appendChunk(f, end, moved, body);
+        directory_.push_back(moved);
+      }
+      entryOf_[*it] = placed;
+    }
+  }
+
+  patchRiffSize(f, end - 8);
+  if (!f.good())
+    throw std::string("Could not patch " + fn_ + '\n');
+  f.close();
+  // A last chunk that shrunk leaves stale bytes behind it
+  if (truncate(fn_.c_str(), end) < 0)
+    throw std::string("Could not patch " + fn_ + '\n');
+}
+
+void WavData::patchRiffSize(std::fstream &f, const uint64_t riffSize) {
+  if (!rf64_ && riffSize > MAX_CHUNK_SIZE) {
+    // A JUNK chunk reserved at the start of the file becomes ds64
+    if (directory_.empty() || directory_[0].id != "JUNK" ||
+        directory_[0].size < 28)
+      throw std::string("The file outgrows RIFF and has no room for ds64\n");
+    uint64_t dataSize = 0;
+    for (auto it = directory_.begin(); it != directory_.end(); it++) {
+      if (it->id == "data")
+        dataSize = it->size;
+    }
+    unsigned int blockAlign = getChunk("fmt ")->get<FmtSchema::BlockAlign>();
+    std::string body =
+        ds64Body(riffSize, dataSize, blockAlign ? dataSize / blockAlign : 0,
+                 std::map<std::string, uint64_t>());
+    ChunkEntry &e = directory_[0];
+    // What is left of the junk stays junk if it can hold a header
+    if (e.size >= body.size() + 8) {
+      ChunkEntry junk = e;
+      junk.offset = e.offset + body.size() + 8;
+      junk.size = e.size - body.size() - 8;
+      writeHeader(f, junk.offset - 8, junk.id, junk.size);
+      e.size = body.size();
+      directory_.insert(directory_.begin() + 1, junk);
+      shiftEntries(0, 1);
+    }
+    body.resize(e.size, '\0');
+    e.id = "ds64";
+    writeHeader(f, e.offset - 8, e.id, e.size);
+    f.write(body.data(), body.size());
+    writeHeader(f, 0, "RF64", MAX_CHUNK_SIZE);
+    rf64_ = true;
+  }
+  if (rf64_) {
+    ds64Sizes_[toFourCC("RIFF")] = riffSize;
+    f.seekp(directory_[0].offset);
+    f.write(toByte<uint64_t>(riffSize).data(), 8);
+    return;
+  }
+  writeHeader(f, 0, "RIFF", riffSize);
+}
+
+void WavData::shiftEntries(const size_t index, const long delta) {
+  entryOf_.forEach([index, delta](FourCC, size_t &entry) {
+    if (entry > index)
+      entry += delta;
+  });
+}
+
+void WavData::appendChunk(std::fstream &f, uint64_t &end, ChunkEntry &entry,
+                          const std::string &body) {
+  // Chunks are word aligned
+  if (end & 1) {
+    f.seekp(end++);
+    f.put('\0');
+  }
+  entry.offset = end + ID_SIZE + CK_SIZE_BYTES;
+  entry.size = body.size();
+  writeHeader(f, end, entry.id, entry.size);
+  f.write(body.data(), body.size());
+  if (body.size() & 1)
+    f.put('\0');
+  end += footprint(entry.size);
+}
+
+size_t WavData::placeInJunk(std::fstream &f, ChunkEntry &entry,
+                            const std::string &body) {
+  // A JUNK chunk that starts the file is kept for ds64 (@ref patchRiffSize)
+  uint64_t needed = footprint(body.size());
+  size_t index = 1;
+  for (; index < directory_.size(); index++) {
+    const ChunkEntry &junk = directory_[index];
+    uint64_t available = footprint(junk.size);
+    if (junk.id == "JUNK" &&
+        (needed == available || needed + 8 <= available))
+      break;
+  }
+  if (index >= directory_.size())
+    return directory_.size();
+  ChunkEntry junk = directory_[index];
+  uint64_t start = junk.offset - ID_SIZE - CK_SIZE_BYTES;
+  uint64_t available = footprint(junk.size);
+  entry.offset = junk.offset;
+  entry.size = body.size();
+  writeHeader(f, start, entry.id, entry.size);
+  f.write(body.data(), body.size());
+  if (body.size() & 1)
+    f.put('\0');
+  directory_[index] = entry;
+  // What is left stays junk
+  if (needed < available) {
+    junk.offset = start + needed + 8;
+    junk.size = available - needed - 8;
+    writeHeader(f, start + needed, junk.id, junk.size);
+    directory_.insert(directory_.begin() + index + 1, junk);
+    shiftEntries(index, 1);
+  }
+  return index;
 }
 
 void WavData::writeBytes(const std::string &data) {
-  w_.write((data.c_str()), data.size());
+  writeBytes(data.data(), data.size());
+}
+
+void WavData::writeBytes(const char *data, const size_t nBytes) {
+  out_->write(data, nBytes);
 }
 
-void WavData::writeChunk(const std::string &name) {
-  auto chunk = chunks_[name];
+void WavData::writeChunk(const FourCC key) {
+  auto chunk = *chunks_.find(key);
   writeBytes(chunk->getChunkName());
-  writeBytes(toByte<unsigned int>(chunk->getActualSize()));
-  auto fields = chunk->getAllFields();
-  for (auto it = fields.begin(); it != fields.end(); it++) {
-    // If the string's size is not the same size, empty values are appended
-    int diff = (*it)->val.size() - (*it)->nBytes;
-    if (diff < 0) {
-      for (int i = 0; i < -diff; i++)
-        (*it)->val.push_back('\0');
-    }
+  // Bigger sizes are in ds64
+  writeBytes(toByte<unsigned int>(
+      std::min<uint64_t>(chunk->getActualSize(), MAX_CHUNK_SIZE)));
+  writeFields(*chunk);
+  // Chunks are word aligned
+  if (chunk->getActualSize() & 1)
+    writeBytes(std::string(1, '\0'));
+}
+
+void WavData::writeFields(const Chunk &ck) {
+  for (auto it = ck.fields_.begin(); it != ck.fields_.end(); it++) {
+    const FieldValue &val = it->val;
     // If the string's size is greater, it does not respect the defined size
-    else if (diff > 0)
+    if (val.size() > it->nBytes)
       throw std::string(
           "Size of the field\'s value is greater than the defined size\n");
-    writeBytes((*it)->val);
+    writeBytes(val.data(), val.size());
+    // If the string's size is not the same size, empty values are appended
+    if (val.size() < it->nBytes)
+      writeBytes(std::string(it->nBytes - val.size(), '\0'));
+  }
+}
+
+size_t WavData::readBytes(const uint64_t nBytes, std::string &data) {
+  if (map_) {
+    size_t n = std::min<size_t>(nBytes, map_->size() - pos_);
+    data.assign(map_->data() + pos_, n);
+    pos_ += n;
+    return n;
   }
+  data.resize(nBytes);
+  in_->read(&data[0], nBytes);
+  data.resize(in_->gcount());
+  return data.size();
 }
 
-void WavData::readBytes(const unsigned int nBytes, std::string &data) {
-  char *c = new char[nBytes];
-  r_.read(c, nBytes);
-  data.assign(c, nBytes);
-  delete c;
+size_t WavData::readBytes(const uint64_t nBytes, char *data) {
+  if (map_) {
+    size_t n = std::min<size_t>(nBytes, map_->size() - pos_);
+    std::copy(map_->data() + pos_, map_->data() + pos_ + n, data);
+    pos_ += n;
+    return n;
+  }
+  in_->read(data, nBytes);
+  return in_->gcount();
 }
 
-void WavData::saveUndefinedChunk(const std::string &chunkId) {
-  std::string data;
+void WavData::seek(const uint64_t offset) {
+  if (map_) {
+    pos_ = std::min<uint64_t>(offset, map_->size());
+    return;
+  }
+  // Scanning may have hit the end of the file
+  in_->clear();
+  in_->seekg(offset);
+}
+
+uint64_t WavData::tell(void) {
+  if (map_)
+    return pos_;
+  return in_->tellg();
+}
+
+void WavData::saveUndefinedChunk(const std::string &chunkId,
+                                 const uint64_t ckSize) {
+  if (ckSize == 0)
+    return; // Useless if empty
+  // A single variable field gets the whole body
   Chunk c(chunkId);
-  readBytes(CK_SIZE_BYTES, data);
   Chunk::Field f;
-  f.nBytes = toType<unsigned int>(data);
-  if (f.nBytes == 0)
-    return; // Useless if empty
   f.name = "ndef";
   f.type = F_NDEF;
-  readBytes(f.nBytes, f.val);
   c.addField(f);
   c.makeUndefined();
-  addChunk(c);
+  chunks_[toFourCC(chunkId.data())] = std::make_shared<Chunk>(c);
+  readChunk(toFourCC(chunkId.data()), ckSize);
 }
 
 void WavData::removeChunk(const std::string &name) {
   // Must have chunks that should not be removed
-  assert(name != "RIFF" && name != "fmt" && name != "fact" && name != "data");
+  assert(name != "RIFF" && name != "fmt " && name != "fact" && name != "data");
   assert(exists(name));
-  chunks_.erase(name);
+  chunks_.erase(toFourCC(name.data()));
+  removed_[toFourCC(name.data())] = true;
+}
+
+void WavData::getSamples(std::vector<float> &samples) {
+  SampleConverter converter(*this);
+  const FieldValue &data = getChunk("data")->getField("data")->val;
+  samples.resize(data.size() / converter.getSampleSize());
+  converter.decode(data.data(), samples.data(), samples.size());
+}
+
+void WavData::getSamples(std::vector<int32_t> &samples) {
+  SampleConverter converter(*this);
+  const FieldValue &data = getChunk("data")->getField("data")->val;
+  samples.resize(data.size() / converter.getSampleSize());
+  converter.decode(data.data(), samples.data(), samples.size());
+}
+
+void WavData::setSamples(const std::vector<float> &samples) {
+  SampleConverter converter(*this);
+  auto data = getChunk("data")->getField("data");
+  data->val.resize(samples.size() * converter.getSampleSize());
+  converter.encode(samples.data(), &data->val[0], samples.size());
+  data->nBytes = data->val.size();
+}
+
+void WavData::setSamples(const std::vector<int32_t> &samples) {
+  SampleConverter converter(*this);
+  auto data = getChunk("data")->getField("data");
+  data->val.resize(samples.size() * converter.getSampleSize());
+  converter.encode(samples.data(), &data->val[0], samples.size());
+  data->nBytes = data->val.size();
 }
 
 bool WavData::exists(const std::string &name) {
-  return chunks_.find(name) != chunks_.end();
+  return name.size() == ID_SIZE && exists(toFourCC(name.data()));
+}
+
+bool WavData::exists(const FourCC key) const {
+  return chunks_.find(key) != nullptr;
 }
 
 void WavData::resetData(void) {
-  for (auto it = chunks_.begin(); it != chunks_.end(); it++) {
-    if (it->first == "RIFF")
-      continue;
-    it->second->resetChunk();
-  }
+  closeSource();
+  directory_.clear();
+  entryOf_.clear();
+  removed_.clear();
+  rf64_ = false;
+  ds64Sizes_.clear();
+  chunks_.forEach([](FourCC key, std::shared_ptr<Chunk> &ck) {
+    if (key != toFourCC("RIFF"))
+      ck->resetChunk();
+  });
 }
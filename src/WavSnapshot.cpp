@@ -0,0 +1,36 @@
+#include "WavSnapshot.hpp"
+
+WavSnapshot::WavSnapshot(void) : state_(std::make_shared<const State>()) {}
+
+WavSnapshot::WavSnapshot(const std::shared_ptr<const State> &state)
+    : state_(state) {}
+
+std::shared_ptr<const Chunk>
+WavSnapshot::getChunk(const std::string &name) const {
+  if (name.size() != ID_SIZE)
+    return nullptr;
+  return getChunk(toFourCC(name.data()));
+}
+
+std::shared_ptr<const Chunk> WavSnapshot::getChunk(const FourCC key) const {
+  const std::shared_ptr<const Chunk> *ck = state_->chunks.find(key);
+  return ck ? *ck : nullptr;
+}
+
+bool WavSnapshot::exists(const std::string &name) const {
+  return name.size() == ID_SIZE && exists(toFourCC(name.data()));
+}
+
+bool WavSnapshot::exists(const FourCC key) const {
+  return state_->chunks.find(key) != nullptr;
+}
+
+std::vector<FourCC> WavSnapshot::getChunkIds(void) const {
+  return state_->chunks.keys();
+}
+
+std::vector<WavData::ChunkEntry> WavSnapshot::getChunkDirectory(void) const {
+  return state_->directory;
+}
+
+bool WavSnapshot::isRF64(void) const { return state_->rf64; }
@@ -0,0 +1,116 @@
+#include "WavSplicer.hpp"
+#include "FileCopy.hpp"
+#include "FrameReader.hpp"
+#include "WavWriter.hpp"
+#include <algorithm>
+#include <memory>
+
+WavSplicer::WavSplicer(bool writeUndefinedChunks)
+    : writeUndefinedChunks_(writeUndefinedChunks) {}
+
+void WavSplicer::dropChunk(const std::string &id) {
+  if (id == "RIFF" || id == "fmt " || id == "fact" || id == "data")
+    throw std::string("The " + id + " chunk cannot be dropped\n");
+  if (id.size() != ID_SIZE)
+    throw std::string("Invalid chunk ID " + id + '\n');
+  drop_.push_back(toFourCC(id.data()));
+}
+
+uint64_t WavSplicer::extract(const std::string &src, const uint64_t first,
+                             const uint64_t nFrames, const std::string &fn) {
+  if (isSameFile(src, fn))
+    throw std::string("Cannot extract " + fn + " onto itself\n");
+  WavData wav, dst;
+  wav.read(src, READ_LAZY);
+  FrameReader reader(src, wav);
+  const uint64_t start = std::min(first, reader.getFrameCount());
+  const uint64_t n = std::min(nFrames, reader.getFrameCount() - start);
+
+  wav.copyMetadata(dst, drop_);
+  // Samples since midnight of the first frame
+  auto directory = wav.getChunkDirectory();
+  for (auto it = directory.begin(); it != directory.end(); it++) {
+    if (it->id != "bext" || !dst.exists(toFourCC("bext")))
+      continue;
+    uint64_t time = (uint64_t)dst.get<BextSchema::TimeReferenceHigh>() << 32 |
+                    dst.get<BextSchema::TimeReferenceLow>();
+    time += start;
+    dst.set<BextSchema::TimeReferenceLow>((uint32_t)time);
+    dst.set<BextSchema::TimeReferenceHigh>((uint32_t)(time >> 32));
+    break;
+  }
+
+  // fact's SampleLength and the sizes are set by the writer
+  WavWriter writer(dst, fn, writeUndefinedChunks_);
+  writer.appendRange(src,
+                     reader.getDataOffset() + start * reader.getBlockAlign(),
+                     n * reader.getBlockAlign());
+  writer.finalize();
+  return n;
+}
+
+void WavSplicer::split(const std::string &src,
+                       const std::vector<uint64_t> &cuts,
+                       const std::vector<std::string> &fns) {
+  if (fns.size() != cuts.size() + 1)
+    throw std::string("A split needs one more file than cuts\n");
+  for (size_t i = 1; i < cuts.size(); i++) {
+    if (cuts[i] < cuts[i - 1])
+      throw std::string("The cuts of a split must be in increasing order\n");
+  }
+  uint64_t first = 0;
+  for (size_t i = 0; i < fns.size(); i++) {
+    uint64_t end = i < cuts.size() ? cuts[i] : UINT64_MAX;
+    extract(src, first, end - first, fns[i]);
+    first = end;
+  }
+}
+
+uint64_t WavSplicer::concat(const std::vector<std::string> &srcs,
+                            const std::string &fn) {
+  if (srcs.empty())
+    throw std::string("Nothing to concatenate\n");
+  // Every source is checked before anything is written
+  WavData head;
+  head.read(srcs[0], READ_LAZY);
+  std::vector<std::unique_ptr<FrameReader>> readers;
+  for (auto it = srcs.begin(); it != srcs.end(); it++) {
+    if (isSameFile(*it, fn))
+      throw std::string("Cannot concatenate " + fn + " onto itself\n");
+    WavData wav;
+    wav.read(*it, READ_LAZY);
+    if (!isCompatible(head, wav))
+      throw std::string("The format of " + *it + " does not match " +
+                        srcs[0] + '\n');
+    readers.push_back(
+        std::unique_ptr<FrameReader>(new FrameReader(*it, wav)));
+  }
+
+  WavData dst;
+  head.copyMetadata(dst, drop_);
+  WavWriter writer(dst, fn, writeUndefinedChunks_);
+  uint64_t frames = 0;
+  for (size_t i = 0; i < srcs.size(); i++) {
+    const FrameReader &reader = *readers[i];
+    writer.appendRange(srcs[i], reader.getDataOffset(),
+                       reader.getFrameCount() * reader.getBlockAlign());
+    frames += reader.getFrameCount();
+  }
+  writer.finalize();
+  return frames;
+}
+
+bool WavSplicer::isCompatible(WavData &a, WavData &b) {
+  if (a.get<FmtSchema::FormatTag>() != b.get<FmtSchema::FormatTag>() ||
+      a.get<FmtSchema::Channels>() != b.get<FmtSchema::Channels>() ||
+      a.get<FmtSchema::SamplesPerSec>() != b.get<FmtSchema::SamplesPerSec>() ||
+      a.get<FmtSchema::BlockAlign>() != b.get<FmtSchema::BlockAlign>() ||
+      a.get<FmtSchema::BitsPerSample>() != b.get<FmtSchema::BitsPerSample>())
+    return false;
+  if (a.get<FmtSchema::FormatTag>() != WAVE_FORMAT_EXTENSIBLE)
+    return true;
+  return a.get<FmtSchema::ValidBitsPerSample>() ==
+             b.get<FmtSchema::ValidBitsPerSample>() &&
+         a.get<FmtSchema::ChannelMask>() == b.get<FmtSchema::ChannelMask>() &&
+         a.get<FmtSchema::SubFormat>() == b.get<FmtSchema::SubFormat>();
+}
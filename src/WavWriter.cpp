@@ -0,0 +1,207 @@
+#include "WavWriter.hpp"
+#include <algorithm>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+// Size of a ds64 chunk without a table
+#define DS64_SIZE 28
+// Samples written at once with DIRECT_IO, a multiple of DIRECT_ALIGNMENT
+#define DIRECT_BLOCK (1 << 20)
+
+WavWriter::WavWriter(WavData &wav, const std::string &fn,
+                     bool writeUndefinedChunks, const bool direct)
+    : fn_(fn), fd_(-1), block_(nullptr, free), blockFill_(0), dataOffset_(0),
+      factOffset_(0), dataSize_(0), blockAlign_(0), finalized_(false) {
+  assert(wav.exists("RIFF") && wav.exists("fmt ") && wav.exists("fact"));
+  // The data chunk of the object is not written, it stays in its file
+  wav.loadMetadata();
+  w_.open(fn, std::ios::binary);
+  if (!w_.is_open())
+    throw std::string("Could not open " + fn + '\n');
+  blockAlign_ = wav.get<FmtSchema::BlockAlign>();
+
+  // The RIFF size is only known once every sample was appended
+  w_.write("RIFF", ID_SIZE);
+  w_.write(WavData::toByte<unsigned int>(0).data(), CK_SIZE_BYTES);
+  auto order = wav.writeOrder(writeUndefinedChunks);
+  for (auto it = order.begin(); it != order.end(); it++) {
+    if (*it == toFourCC("data"))
+      continue;
+    std::string body = wav.serializeChunk(**wav.chunks_.find(*it));
+    if (*it == toFourCC("RIFF")) {
+      w_.write(body.data(), body.size());
+      // Room for ds64 if the file outgrows RIFF
+      writeChunk("JUNK", std::string(DS64_SIZE, '\0'));
+      continue;
+    }
+    if (*it == toFourCC("fact"))
+      factOffset_ = (size_t)w_.tellp() + ID_SIZE + CK_SIZE_BYTES;
+    writeChunk(fourCCString(*it), body);
+  }
+  // The layout's JUNK chunk, O_DIRECT writes need aligned samples
+  uint32_t alignment = wav.dataAlignment_;
+  if (direct)
+    alignment = std::max<uint32_t>(alignment, DIRECT_ALIGNMENT);
+  WavData::writeJunk(w_, wav.junkFootprint(w_.tellp(), alignment));
+  writeChunk("data", std::string());
+  dataOffset_ = w_.tellp();
+  if (!direct)
+    return;
+  // The chunks before the samples stay in the stream for finalize()
+  w_.flush();
+  fd_ = openDirect(fn, O_WRONLY);
+  if (fd_ >= 0)
+    block_.reset(allocDirect(DIRECT_BLOCK).release());
+}
+
+WavWriter::~WavWriter(void) {
+  // Destructors must not throw, finalize() reports errors when called
+  try {
+    finalize();
+  } catch (...) {
+  }
+  if (fd_ >= 0)
+    close(fd_);
+}
+
+void WavWriter::writeChunk(const std::string &id, const std::string &body) {
+  w_.write(id.data(), ID_SIZE);
+  w_.write(WavData::toByte<unsigned int>(body.size()).data(), CK_SIZE_BYTES);
+  w_.write(body.data(), body.size());
+  // Chunks are word aligned
+  if (body.size() & 1)
+    w_.put('\0');
+}
+
+void WavWriter::append(const char *data, const size_t nBytes) {
+  if (finalized_)
+    throw std::string("Cannot append to a finalized file\n");
+  if (fd_ < 0) {
+    w_.write(data, nBytes);
+    dataSize_ += nBytes;
+    return;
+  }
+  for (size_t done = 0; done < nBytes;) {
+    size_t n = std::min<size_t>(nBytes - done, DIRECT_BLOCK - blockFill_);
+    std::memcpy(block_.get() + blockFill_, data + done, n);
+    blockFill_ += n;
+    dataSize_ += n;
+    done += n;
+    if (blockFill_ == DIRECT_BLOCK)
+      flushDirect();
+  }
+}
+
+void WavWriter::flushDirect(void) {
+  // The last block is padded with zeros, the file is truncated afterwards
+  const size_t mask = DIRECT_ALIGNMENT - 1;
+  size_t size = (blockFill_ + mask) & ~mask;
+  std::memset(block_.get() + blockFill_, 0, size - blockFill_);
+  uint64_t offset = dataOffset_ + dataSize_ - blockFill_;
+  for (size_t done = 0; done < size;) {
+    ssize_t r = pwrite(fd_, block_.get() + done, size - done, offset + done);
+    if (r < 0 && errno == EINTR)
+      continue;
+    if (r <= 0)
+      throw std::string("Could not write to " + fn_ + '\n');
+    done += r;
+  }
+  blockFill_ = 0;
+}
+
+void WavWriter::append(const std::string &data) {
+  append(data.data(), data.size());
+}
+
+void WavWriter::appendRange(const std::string &src, const uint64_t offset,
+                            const uint64_t nBytes) {
+  if (finalized_)
+    throw std::string("Cannot append to a finalized file\n");
+  if (fd_ < 0) {
+    // The stream is written through, then it goes past the copied bytes
+    w_.flush();
+    copyFileRange(src, offset, fn_, dataOffset_ + dataSize_, nBytes);
+    dataSize_ += nBytes;
+    w_.seekp(dataOffset_ + dataSize_);
+    return;
+  }
+  // O_DIRECT writes are aligned, the bytes are read into the block
+  int in = open(src.c_str(), O_RDONLY);
+  if (in < 0)
+    throw std::string("Could not open " + src + '\n');
+  try {
+    for (uint64_t done = 0; done < nBytes;) {
+      size_t n = std::min<uint64_t>(nBytes - done, DIRECT_BLOCK - blockFill_);
+      ssize_t r = pread(in, block_.get() + blockFill_, n, offset + done);
+      if (r < 0 && errno == EINTR)
+        continue;
+      if (r <= 0)
+        throw std::string("Could not copy " + src + " to " + fn_ + '\n');
+      blockFill_ += r;
+      dataSize_ += r;
+      done += r;
+      if (blockFill_ == DIRECT_BLOCK)
+        flushDirect();
+    }
+  } catch (...) {
+    close(in);
+    throw;
+  }
+  close(in);
+}
+
+void WavWriter::finalize(void) {
+  if (finalized_)
+    return;
+  finalized_ = true;
+  const uint64_t end = dataOffset_ + dataSize_ + (dataSize_ & 1);
+  if (fd_ >= 0) {
+    flushDirect();
+    int r = close(fd_);
+    fd_ = -1;
+    if (r < 0)
+      throw std::string("Could not write to " + fn_ + '\n');
+  } else if (dataSize_ & 1) {
+    w_.put('\0');
+  }
+  uint64_t riffSize = end - 8;
+  uint64_t sampleCount = blockAlign_ ? dataSize_ / blockAlign_ : 0;
+  if (riffSize > MAX_CHUNK_SIZE) {
+    // Promoted to RF64, the reserved JUNK chunk becomes ds64
+    w_.seekp(0);
+    w_.write("RF64", ID_SIZE);
+    w_.seekp(3 * ID_SIZE);
+    w_.write("ds64", ID_SIZE);
+    w_.seekp(4 * ID_SIZE + CK_SIZE_BYTES);
+    std::string ds64 = WavData::ds64Body(riffSize, dataSize_, sampleCount,
+                                         std::map<std::string, uint64_t>());
+    w_.write(ds64.data(), ds64.size());
+  }
+  w_.seekp(ID_SIZE);
+  w_.write(WavData::toByte<unsigned int>(
+               std::min<uint64_t>(riffSize, MAX_CHUNK_SIZE))
+               .data(),
+           CK_SIZE_BYTES);
+  w_.seekp(dataOffset_ - CK_SIZE_BYTES);
+  w_.write(WavData::toByte<unsigned int>(
+               std::min<uint64_t>(dataSize_, MAX_CHUNK_SIZE))
+               .data(),
+           CK_SIZE_BYTES);
+  if (factOffset_ && blockAlign_) {
+    w_.seekp(factOffset_);
+    w_.write(WavData::toByte<unsigned int>(
+                 std::min<uint64_t>(sampleCount, MAX_CHUNK_SIZE))
+                 .data(),
+             4);
+  }
+  w_.close();
+  if (w_.fail())
+    throw std::string("Could not finalize the file\n");
+  // Past the padding of the last direct block
+  if (block_ && truncate(fn_.c_str(), end) < 0)
+    throw std::string("Could not finalize the file\n");
+}
+
+uint64_t WavWriter::getDataSize(void) const { return dataSize_; }
@@ -0,0 +1,666 @@
+#include "ChannelMapper.hpp"
+#include "FileCopy.hpp"
+#include "FrameReader.hpp"
+#include "LoudnessMeter.hpp"
+#include "MetadataIndex.hpp"
+#include "PeakPyramid.hpp"
+#include "SampleConverter.hpp"
+#include "StreamReader.hpp"
+#include "Transcoder.hpp"
+#include "WavData.hpp"
+#include "WavSplicer.hpp"
+#include "WavWriter.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <new>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Every allocation of the process is counted
+static std::atomic<size_t> allocations(0);
+
+void *operator new(size_t n) {
+  allocations++;
+  void *p = malloc(n ? n : 1);
+  if (!p)
+    throw std::bad_alloc();
+  return p;
+}
+
+void operator delete(void *p) noexcept { free(p); }
+
+// One corpus of generated files
+struct Corpus {
+  std::string name;
+  std::vector<std::string> files;
+  uint64_t bytes;
+};
+
+// One measurement, printed as a JSON line
+struct Result {
+  std::string bench, corpus, mode;
+  size_t items;   // Files, field accesses or samples
+  uint64_t bytes; // Bytes processed
+  double seconds; // Best run
+  size_t allocs;  // Allocations of the best run
+};
+
+static double now(void) {
+  return std::chrono::duration<double>(
+             std::chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Deterministic noise so that every run writes the same corpus
+static uint32_t nextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+static void setFormat(WavData &wav, const uint16_t tag, const uint16_t channels,
+                      const uint32_t rate, const uint16_t bits) {
+  wav.set<FmtSchema::FormatTag>(tag);
+  wav.set<FmtSchema::Channels>(channels);
+  wav.set<FmtSchema::SamplesPerSec>(rate);
+  wav.set<FmtSchema::AvgBytesPerSec>(rate * channels * bits / 8);
+  wav.set<FmtSchema::BlockAlign>(channels * bits / 8);
+  wav.set<FmtSchema::BitsPerSample>(bits);
+}
+
+static void fillMetadata(WavData &wav, const size_t i, const size_t tagText) {
+  wav.set<BextSchema::Description>("Synthetic file " + std::to_string(i));
+  wav.set<BextSchema::Originator>("wav-bench");
+  wav.set<BextSchema::OriginationDate>("2024-01-01");
+  wav.set<BextSchema::OriginationTime>("12:00:00");
+  wav.set<BextSchema::LoudnessValue>(-2300);
+  wav.set<BextSchema::CodingHistory>("A=PCM,F=48000,W=24,M=stereo\r\n");
+  wav.set<CartSchema::Version>("0101");
+  wav.set<CartSchema::Title>("Title " + std::to_string(i));
+  wav.set<CartSchema::Artist>("Artist");
+  wav.set<CartSchema::TagText>(std::string(tagText, 'x'));
+}
+
+static std::string randomBytes(const size_t n, uint32_t &state) {
+  std::string s(n, '\0');
+  for (size_t i = 0; i < n; i++)
+    s[i] = nextRandom(state);
+  return s;
+}
+
+/**
+ * @brief Small files with full bext and cart chunks and 1000 frames of audio
+ */
+static Corpus makeMetadataCorpus(const std::string &dir, const size_t n) {
+  Corpus c = {"metadata", {}, 0};
+  uint32_t state = 1;
+  for (size_t i = 0; i < n; i++) {
+    WavData wav;
+    setFormat(wav, WAVE_FORMAT_PCM, 2, 48000, 24);
+    fillMetadata(wav, i, 256);
+    wav.getChunk("data")->getField("data")->val = randomBytes(6000, state);
+    std::string fn = dir + "/meta" + std::to_string(i) + ".wav";
+    wav.write(fn);
+    c.files.push_back(fn);
+    c.bytes += fileSize(fn);
+  }
+  return c;
+}
+
+/**
+ * @brief Files with many chunks that the reader does not define
+ */
+static Corpus makeUndefinedCorpus(const std::string &dir, const size_t n,
+                                  const size_t chunks) {
+  Corpus c = {"undefined", {}, 0};
+  uint32_t state = 2;
+  for (size_t i = 0; i < n; i++) {
+    WavData wav;
+    setFormat(wav, WAVE_FORMAT_PCM, 1, 44100, 16);
+    for (size_t k = 0; k < chunks; k++) {
+      char id[8];
+      snprintf(id, sizeof(id), "u%03zu", k % 1000);
+      Chunk ck(id);
+      Chunk::Field f;
+      f.name = "ndef";
+      f.nBytes = 16 + nextRandom(state) % 240;
+      f.val = randomBytes(f.nBytes, state);
+      ck.addField(f);
+      wav.addChunk(ck);
+    }
+    wav.getChunk("data")->getField("data")->val = randomBytes(2000, state);
+    std::string fn = dir + "/undef" + std::to_string(i) + ".wav";
+    wav.write(fn);
+    c.files.push_back(fn);
+    c.bytes += fileSize(fn);
+  }
+  return c;
+}
+
+/**
+ * @brief Files whose cart TagText is large
+ */
+static Corpus makeTagTextCorpus(const std::string &dir, const size_t n,
+                                const size_t tagText) {
+  Corpus c = {"tagtext", {}, 0};
+  uint32_t state = 3;
+  for (size_t i = 0; i < n; i++) {
+    WavData wav;
+    setFormat(wav, WAVE_FORMAT_PCM, 2, 48000, 16);
+    fillMetadata(wav, i, tagText);
+    wav.getChunk("data")->getField("data")->val = randomBytes(4000, state);
+    std::string fn = dir + "/tag" + std::to_string(i) + ".wav";
+    wav.write(fn);
+    c.files.push_back(fn);
+    c.bytes += fileSize(fn);
+  }
+  return c;
+}
+
+/**
+ * @brief One large 24-bit PCM file, streamed so that it is never in memory
+ */
+static Corpus makeLargeCorpus(const std::string &dir, const uint64_t mb) {
+  Corpus c = {"large", {}, 0};
+  uint32_t state = 4;
+  WavData wav;
+  setFormat(wav, WAVE_FORMAT_PCM, 2, 48000, 24);
+  fillMetadata(wav, 0, 256);
+  std::string fn = dir + "/large.wav";
+  {
+    WavWriter writer(wav, fn);
+    // Blocks are a multiple of the frame size
+    std::string block = randomBytes(6 << 20, state);
+    uint64_t total = mb << 20;
+    total -= total % 6;
+    for (uint64_t n = 0; n < total; n += block.size())
+      writer.append(block.data(), std::min<uint64_t>(block.size(), total - n));
+    writer.finalize();
+  }
+  c.files.push_back(fn);
+  c.bytes = fileSize(fn);
+  return c;
+}
+
+/**
+ * @brief Runs a benchmark several times and keeps the fastest run
+ */
+template <typename F>
+static Result measure(const std::string &bench, const std::string &corpus,
+                      const std::string &mode, const size_t items,
+                      const uint64_t bytes, const int repeat, F run) {
+  Result r = {bench, corpus, mode, items, bytes, 1e30, 0};
+  for (int i = 0; i < repeat; i++) {
+    size_t a = allocations;
+    double t = now();
+    run();
+    t = now() - t;
+    if (t < r.seconds) {
+      r.seconds = t;
+      r.allocs = allocations - a;
+    }
+  }
+  return r;
+}
+
+// Whether the compiler optimized this build, measurements of an unoptimized
+// one are meaningless
+#ifdef __OPTIMIZE__
+#define BENCH_BUILD "optimized"
+#else
+#define BENCH_BUILD "unoptimized"
+#endif
+
+// Instruction set of the kernels, as WAV_RIFF_SIMD names it
+static const char *simdName(void) {
+  switch (detectSimdLevel()) {
+  case SIMD_AVX2:
+    return "avx2";
+  case SIMD_SSE41:
+    return "sse4.1";
+  default:
+    return "scalar";
+  }
+}
+
+static void print(const Result &r) {
+  printf("{\"bench\":\"%s\",\"corpus\":\"%s\",\"mode\":\"%s\",\"items\":%zu,"
+         "\"bytes\":%llu,\"seconds\":%.6f,\"mb_per_s\":%.2f,"
+         "\"items_per_s\":%.1f,\"allocs_per_item\":%.2f,\"simd\":\"%s\","
+         "\"build\":\"%s\"}\n",
+         r.bench.c_str(), r.corpus.c_str(), r.mode.c_str(), r.items,
+         (unsigned long long)r.bytes, r.seconds,
+         r.bytes / r.seconds / (1 << 20), r.items / r.seconds,
+         r.items ? (double)r.allocs / r.items : 0.0, simdName(), BENCH_BUILD);
+  fflush(stdout);
+}
+
+static void benchRead(const Corpus &c, const int repeat) {
+  const char *names[] = {"copy", "mapped", "lazy", "mapped+lazy"};
+  const int flags[] = {READ_COPY, READ_MAPPED, READ_LAZY,
+                       READ_MAPPED | READ_LAZY};
+  for (int m = 0; m < 4; m++) {
+    // Copying large files only measures memcpy
+    if (c.name == "large" && flags[m] == READ_COPY)
+      continue;
+    // One parser reused for every file, like a scanner does
+    WavData wav;
+    print(measure("read", c.name, names[m], c.files.size(), c.bytes, repeat,
+                  [&] {
+                    for (auto it = c.files.begin(); it != c.files.end(); it++) {
+                      wav.read(*it, flags[m]);
+                      wav.getChunk("fmt ");
+                      wav.getChunk("bext");
+                    }
+                  }));
+  }
+}
+
+static void benchWrite(const Corpus &c, const std::string &dir,
+                       const int repeat) {
+  std::vector<std::unique_ptr<WavData>> wavs;
+  for (auto it = c.files.begin(); it != c.files.end(); it++) {
+    wavs.push_back(std::unique_ptr<WavData>(new WavData()));
+    wavs.back()->read(*it, READ_MAPPED);
+  }
+  std::string out = dir + "/out.wav";
+  print(measure("write", c.name, "mapped", c.files.size(), c.bytes, repeat,
+                [&] {
+                  for (auto it = wavs.begin(); it != wavs.end(); it++)
+                    (*it)->write(out);
+                }));
+  unlink(out.c_str());
+}
+
+static void benchFields(const Corpus &c, const int repeat) {
+  WavData wav;
+  wav.read(c.files[0]);
+  const size_t n = 1000000;
+  volatile long sum = 0;
+  print(measure("field", c.name, "by-name", n, 0, repeat, [&] {
+    for (size_t i = 0; i < n; i++)
+      sum += WavData::toType<short>(
+          wav.getChunk("bext")->getField("LoudnessValue")->val);
+  }));
+  auto bext = wav.getChunk("bext");
+  print(measure("field", c.name, "schema", n, 0, repeat, [&] {
+    for (size_t i = 0; i < n; i++)
+      sum += bext->get<BextSchema::LoudnessValue>();
+  }));
+}
+
+static void benchSeek(const Corpus &c, const int repeat) {
+  // Decodes 20 ms at random positions, like scrubbing
+  FrameReader reader(c.files[0]);
+  const size_t n = 10000;
+  const size_t frames = reader.frameAt(0.02);
+  std::vector<float> out(frames * reader.getSamplesPerFrame());
+  print(measure("seek", c.name, "float", n,
+                n * frames * reader.getBlockAlign(), repeat, [&] {
+                  uint32_t state = 7;
+                  for (size_t i = 0; i < n; i++)
+                    reader.read(nextRandom(state) % reader.getFrameCount(),
+                                frames, out.data());
+                }));
+}
+
+static void benchPeaks(const Corpus &c, const int repeat) {
+  // Builds the overview once per repeat, then draws 1000-pixel views of
+  // random windows
+  FrameReader reader(c.files[0]);
+  const uint64_t frames = reader.getFrameCount();
+  PeakPyramid pyramid;
+  print(measure("peaks", c.name, "build", frames,
+                frames * reader.getBlockAlign(), repeat,
+                [&] { pyramid = PeakPyramid::build(reader); }));
+  const size_t n = 10000, bins = 1000;
+  std::vector<Peak> out(bins * pyramid.getChannels());
+  print(measure("peaks", c.name, "query", n, n * bins * sizeof(Peak), repeat,
+                [&] {
+                  uint32_t state = 11;
+                  for (size_t i = 0; i < n; i++) {
+                    uint64_t first = nextRandom(state) % frames;
+                    pyramid.query(first, nextRandom(state) % frames, bins,
+                                  out.data());
+                  }
+                }));
+}
+
+static void benchLoudness(const Corpus &c, const int repeat) {
+  // One thread, then one per hardware thread splitting the channels
+  FrameReader reader(c.files[0]);
+  const uint64_t frames = reader.getFrameCount();
+  const unsigned int threads[] = {1, 0};
+  const char *names[] = {"1-thread", "all-threads"};
+  for (int t = 0; t < 2; t++)
+    print(measure("loudness", c.name, names[t], frames,
+                  frames * reader.getBlockAlign(), repeat,
+                  [&] { LoudnessMeter::measure(reader, threads[t]); }));
+}
+
+static void benchTranscode(const Corpus &c, const std::string &dir,
+                           const int repeat) {
+  // The large file is 24-bit PCM, read lazily so samples are streamed
+  WavData wav;
+  wav.read(c.files[0], READ_LAZY);
+  const SampleType types[] = {S_PCM_16, S_FLOAT_32};
+  const char *names[] = {"pcm16-dither", "float32"};
+  std::string out = dir + "/out.wav";
+  for (int t = 0; t < 2; t++) {
+    Transcoder transcoder(types[t]);
+    print(measure("transcode", c.name, names[t], 1, c.bytes, repeat,
+                  [&] { transcoder.transcode(wav, out); }));
+  }
+  unlink(out.c_str());
+}
+
+static void benchStream(const Corpus &c, const std::string &dir,
+                        const int repeat) {
+  // The large file in the streaming layout, written and read from its start
+  // in 1 MiB blocks, through the page cache and with O_DIRECT
+  const size_t block = 1 << 20;
+  FrameReader source(c.files[0]);
+  const uint64_t bytes = source.getFrameCount() * source.getBlockAlign();
+  auto samples = allocDirect(block);
+  std::string out = dir + "/out.wav";
+  const char *names[] = {"buffered", "direct"};
+  for (int d = 0; d < 2; d++) {
+    WavData wav;
+    wav.read(c.files[0], READ_LAZY);
+    wav.setLayout(0, STREAMING_ALIGNMENT);
+    const size_t frames = block / source.getBlockAlign();
+    print(measure("stream", c.name, std::string("write-") + names[d], 1,
+                  bytes, repeat, [&] {
+                    WavWriter writer(wav, out, true, d == 1);
+                    for (uint64_t f = 0; f < source.getFrameCount();) {
+                      size_t n = source.readRaw(f, frames, samples.get());
+                      writer.append(samples.get(), n * source.getBlockAlign());
+                      f += n;
+                    }
+                    writer.finalize();
+                  }));
+  }
+  for (int d = 0; d < 2; d++) {
+    // Whole pages, so that O_DIRECT reads go straight to the buffer
+    FrameReader reader(out, d == 1);
+    const size_t frames =
+        block / ((size_t)reader.getBlockAlign() * DIRECT_ALIGNMENT) *
+        DIRECT_ALIGNMENT;
+    print(measure("stream", c.name, std::string("read-") + names[d], 1, bytes,
+                  repeat, [&] {
+                    for (uint64_t f = 0; f < reader.getFrameCount();)
+                      f += reader.readRaw(f, frames, samples.get());
+                  }));
+  }
+  // Decoded and summed front to back, then with decoding read ahead by a
+  // background thread while the blocks are summed
+  FrameReader reader(out);
+  const size_t frames = STREAM_BLOCK_FRAMES;
+  std::vector<float> decoded(frames * reader.getSamplesPerFrame());
+  volatile double sum = 0;
+  auto energy = [](const float *p, const size_t n) {
+    double e = 0;
+    for (size_t i = 0; i < n; i++)
+      e += p[i] * p[i];
+    return e;
+  };
+  print(measure("stream", c.name, "decode", 1, bytes, repeat, [&] {
+    for (uint64_t f = 0; f < reader.getFrameCount();) {
+      size_t n = reader.read(f, frames, decoded.data());
+      sum += energy(decoded.data(), n * reader.getSamplesPerFrame());
+      f += n;
+    }
+  }));
+  print(measure("stream", c.name, "read-ahead", 1, bytes, repeat, [&] {
+    StreamReader stream(out);
+    StreamBlock block;
+    while (stream.next(block))
+      sum += energy(block.samples,
+                    block.nFrames * reader.getSamplesPerFrame());
+  }));
+  unlink(out.c_str());
+}
+
+static void benchSplice(const Corpus &c, const std::string &dir,
+                        const int repeat) {
+  // The large file cut into 10 segments, then joined back
+  FrameReader reader(c.files[0]);
+  std::vector<uint64_t> cuts;
+  std::vector<std::string> segments;
+  for (int i = 0; i < 10; i++) {
+    if (i)
+      cuts.push_back(reader.getFrameCount() * i / 10);
+    segments.push_back(dir + "/segment" + std::to_string(i) + ".wav");
+  }
+  const uint64_t bytes = reader.getFrameCount() * reader.getBlockAlign();
+  WavSplicer splicer;
+  print(measure("splice", c.name, "split", segments.size(), bytes, repeat,
+                [&] { splicer.split(c.files[0], cuts, segments); }));
+  std::string out = dir + "/out.wav";
+  print(measure("splice", c.name, "concat", segments.size(), bytes, repeat,
+                [&] { splicer.concat(segments, out); }));
+  for (auto it = segments.begin(); it != segments.end(); it++)
+    unlink(it->c_str());
+  unlink(out.c_str());
+}
+
+static void benchIndex(const Corpus &c, const std::string &dir,
+                       const int repeat) {
+  // Builds an index of the corpus, updates it when nothing changed, then
+  // opens it and looks up every file, which reads none of them
+  const std::vector<std::string> fields = {"fmt.SamplesPerSec",
+                                           "bext.Originator"};
+  const std::string fn = dir + "/index.bin";
+  print(measure("index", c.name, "build", c.files.size(), c.bytes, repeat,
+                [&] {
+                  MetadataIndex index(fields);
+                  index.update(c.files);
+                  index.save(fn);
+                }));
+  MetadataIndex index(fields);
+  index.load(fn);
+  print(measure("index", c.name, "update", c.files.size(), c.bytes, repeat,
+                [&] { index.update(c.files); }));
+  print(measure("index", c.name, "load+lookup", c.files.size(), c.bytes,
+                repeat, [&] {
+                  MetadataIndex mapped(fields, 1);
+                  if (!mapped.load(fn))
+                    throw std::string("Could not load " + fn + '\n');
+                  IndexEntry entry;
+                  for (auto it = c.files.begin(); it != c.files.end(); it++)
+                    mapped.find(*it, entry);
+                }));
+  unlink(fn.c_str());
+}
+
+static void benchSamples(const int repeat) {
+  // Decodes and encodes blocks of one second of stereo audio
+  const size_t frames = 48000, n = 2 * frames, blocks = 64;
+  const SampleType types[] = {S_PCM_16, S_PCM_24, S_FLOAT_32, S_ALAW};
+  const char *names[] = {"pcm16", "pcm24", "float32", "alaw"};
+  uint32_t state = 5;
+  std::vector<float> f(n);
+  std::vector<int32_t> i32(n);
+  for (int t = 0; t < 4; t++) {
+    SampleConverter conv(types[t]);
+    uint64_t bytes = (uint64_t)n * conv.getSampleSize() * blocks;
+    std::string raw = randomBytes(n * conv.getSampleSize(), state);
+    // Float input must be in range
+    if (types[t] == S_FLOAT_32) {
+      std::vector<float> in(n);
+      for (size_t k = 0; k < n; k++)
+        in[k] = (nextRandom(state) / 4294967296.0f) * 2 - 1;
+      conv.encode(in.data(), &raw[0], n);
+    }
+    print(measure("decode", "samples", std::string(names[t]) + "-float",
+                  n * blocks, bytes, repeat, [&] {
+                    for (size_t b = 0; b < blocks; b++)
+                      conv.decode(raw.data(), f.data(), n);
+                  }));
+    print(measure("decode", "samples", std::string(names[t]) + "-int",
+                  n * blocks, bytes, repeat, [&] {
+                    for (size_t b = 0; b < blocks; b++)
+                      conv.decode(raw.data(), i32.data(), n);
+                  }));
+    print(measure("encode", "samples", std::string(names[t]) + "-float",
+                  n * blocks, bytes, repeat, [&] {
+                    for (size_t b = 0; b < blocks; b++)
+                      conv.encode(f.data(), &raw[0], n);
+                  }));
+    print(measure("encode", "samples", std::string(names[t]) + "-int",
+                  n * blocks, bytes, repeat, [&] {
+                    for (size_t b = 0; b < blocks; b++)
+                      conv.encode(i32.data(), &raw[0], n);
+                  }));
+  }
+}
+
+static void benchChannels(const int repeat) {
+  // Splits blocks of one second of 24-bit 5.1 and 16-channel audio, with the
+  // scalar kernels for comparison
+  const size_t frames = 48000, blocks = 16;
+  const unsigned int counts[] = {6, 16};
+  uint32_t state = 9;
+  for (int k = 0; k < 2; k++) {
+    const unsigned int ch = counts[k];
+    const std::string name = std::to_string(ch) + "ch-";
+    std::string raw = randomBytes(frames * ch * 3, state);
+    std::vector<float> planes(frames * ch);
+    std::vector<float *> dst(ch);
+    for (unsigned int c = 0; c < ch; c++)
+      dst[c] = planes.data() + c * frames;
+    const uint64_t bytes = (uint64_t)raw.size() * blocks;
+    ChannelMapper scalar(S_PCM_24, ch, SIMD_SCALAR), mapper(S_PCM_24, ch);
+    print(measure("channels", "samples", name + "deinterleave-scalar",
+                  frames * blocks, bytes, repeat, [&] {
+                    for (size_t b = 0; b < blocks; b++)
+                      scalar.deinterleave(raw.data(), dst.data(), frames);
+                  }));
+    print(measure("channels", "samples", name + "deinterleave",
+                  frames * blocks, bytes, repeat, [&] {
+                    for (size_t b = 0; b < blocks; b++)
+                      mapper.deinterleave(raw.data(), dst.data(), frames);
+                  }));
+    print(measure("channels", "samples", name + "interleave", frames * blocks,
+                  bytes, repeat, [&] {
+                    for (size_t b = 0; b < blocks; b++)
+                      mapper.interleave(dst.data(), &raw[0], frames);
+                  }));
+    const std::vector<unsigned int> one(1, 1);
+    print(measure("channels", "samples", name + "extract-1", frames * blocks,
+                  bytes, repeat, [&] {
+                    for (size_t b = 0; b < blocks; b++)
+                      mapper.extract(raw.data(), one, dst.data(), frames);
+                  }));
+    // Every channel in both outputs
+    std::vector<float> matrix(2 * ch, 0.5f);
+    print(measure("channels", "samples", name + "mixdown-2", frames * blocks,
+                  bytes, repeat, [&] {
+                    for (size_t b = 0; b < blocks; b++)
+                      mapper.mixdown(raw.data(), matrix, dst.data(), frames);
+                  }));
+  }
+}
+
+static int usage(void) {
+  std::cerr << "Usage : wav-bench [--dir DIR] [--keep] [--files N] "
+               "[--large-mb MB] [--repeat N] [--only read|write|field|seek|"
+               "peaks|loudness|transcode|stream|splice|index|samples|"
+               "channels]\n";
+  return -1;
+}
+
+int main(int argc, char **argv) {
+  std::string dir, only;
+  bool keep = false;
+  size_t nFiles = 2000;
+  uint64_t largeMb = 1024;
+  int repeat = 3;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "--dir") && i + 1 < argc)
+      dir = argv[++i];
+    else if (!strcmp(argv[i], "--keep"))
+      keep = true;
+    else if (!strcmp(argv[i], "--files") && i + 1 < argc)
+      nFiles = atoi(argv[++i]);
+    else if (!strcmp(argv[i], "--large-mb") && i + 1 < argc)
+      largeMb = atoll(argv[++i]);
+    else if (!strcmp(argv[i], "--repeat") && i + 1 < argc)
+      repeat = std::max(1, atoi(argv[++i]));
+    else if (!strcmp(argv[i], "--only") && i + 1 < argc)
+      only = argv[++i];
+    else
+      return usage();
+  }
+#ifndef __OPTIMIZE__
+  std::cerr << "Warning: wav-bench was built without optimization, configure "
+               "with -DCMAKE_BUILD_TYPE=Release\n";
+#endif
+  if (dir.empty()) {
+    char tmpl[] = "/tmp/wav-bench-XXXXXX";
+    if (!mkdtemp(tmpl)) {
+      std::cerr << "Could not create a temporary directory\n";
+      return -1;
+    }
+    dir = tmpl;
+  }
+
+  try {
+    std::vector<Corpus> corpora;
+    if (only.empty() || only == "read" || only == "write" || only == "field" ||
+        only == "seek" || only == "peaks" || only == "loudness" ||
+        only == "transcode" || only == "stream" || only == "splice" ||
+        only == "index") {
+      std::cerr << "Generating corpora in " << dir << '\n';
+      corpora.push_back(makeMetadataCorpus(dir, nFiles));
+      corpora.push_back(makeUndefinedCorpus(dir, nFiles / 10, 256));
+      corpora.push_back(makeTagTextCorpus(dir, nFiles / 40, 1 << 20));
+      if (largeMb)
+        corpora.push_back(makeLargeCorpus(dir, largeMb));
+    }
+    // Files are read from the page cache, after they were written
+    for (auto it = corpora.begin(); it != corpora.end(); it++) {
+      if (only.empty() || only == "read")
+        benchRead(*it, repeat);
+      if (only.empty() || only == "write")
+        benchWrite(*it, dir, repeat);
+    }
+    if ((only.empty() || only == "field") && !corpora.empty())
+      benchFields(corpora[0], repeat);
+    if ((only.empty() || only == "seek") && largeMb)
+      benchSeek(corpora.back(), repeat);
+    if ((only.empty() || only == "peaks") && largeMb)
+      benchPeaks(corpora.back(), repeat);
+    if ((only.empty() || only == "loudness") && largeMb)
+      benchLoudness(corpora.back(), repeat);
+    if ((only.empty() || only == "transcode") && largeMb)
+      benchTranscode(corpora.back(), dir, repeat);
+    if ((only.empty() || only == "stream") && largeMb)
+      benchStream(corpora.back(), dir, repeat);
+    if ((only.empty() || only == "splice") && largeMb)
+      benchSplice(corpora.back(), dir, repeat);
+    if ((only.empty() || only == "index") && !corpora.empty())
+      benchIndex(corpora[0], dir, repeat);
+    if (only.empty() || only == "samples")
+      benchSamples(repeat);
+    if (only.empty() || only == "channels")
+      benchChannels(repeat);
+
+    if (!keep) {
+      for (auto it = corpora.begin(); it != corpora.end(); it++) {
+        for (auto f = it->files.begin(); f != it->files.end(); f++)
+          unlink(f->c_str());
+      }
+      rmdir(dir.c_str());
+    }
+  } catch (const std::string &e) {
+    std::cerr << e;
+    return -1;
+  }
+  return 0;
+}
@@ -39,8 +39,13 @@ int main(int argc, char **argv) {
   // Writing all defined chunks and dropping the undefined ones
   wav->write(argv[2], DROP_UNDEFINED_CHUNKS);
 
-  // // Reading what we changed so far
-  wav->read(argv[2]);
+  // // Reading what we changed so far, without copying the audio
+  wav->read(argv[2], READ_MAPPED);
+
+  // Changing a value in the written file without rewriting the audio, the
+  // typed accessors find a field of a known chunk by its position
+  wav->set<BextSchema::LoudnessValue>(23);
+  wav->patch();
 
   delete wav;
   return 0;
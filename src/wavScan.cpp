@@ -0,0 +1,49 @@
+#include "BatchScanner.hpp"
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+
+// Extracted when no field is given
+static const char *defaultFields[] = {
+    "fmt.FormatTag", "fmt.Channels", "fmt.SamplesPerSec", "fmt.BitsPerSample",
+    "bext.Description", "bext.Originator", "bext.OriginationDate"};
+
+static int usage(void) {
+  std::cerr << "Usage : wav-scan [-j THREADS] [--json] [-f CHUNK.FIELD]... "
+               "PATH...\n";
+  return -1;
+}
+
+int main(int argc, char **argv) {
+  unsigned int nThreads = 0;
+  ScanFormat format = SCAN_CSV;
+  std::vector<std::string> fields, paths;
+  for (int i = 1; i < argc; i++) {
+    if (!strcmp(argv[i], "-j") && i + 1 < argc) {
+      nThreads = atoi(argv[++i]);
+    } else if (!strcmp(argv[i], "-f") && i + 1 < argc) {
+      fields.push_back(argv[++i]);
+    } else if (!strcmp(argv[i], "--json")) {
+      format = SCAN_JSON;
+    } else if (argv[i][0] == '-') {
+      return usage();
+    } else {
+      paths.push_back(argv[i]);
+    }
+  }
+  if (paths.empty())
+    return usage();
+  if (fields.empty())
+    fields.assign(defaultFields, defaultFields + sizeof(defaultFields) /
+                                                     sizeof(*defaultFields));
+
+  try {
+    BatchScanner scanner(fields, nThreads);
+    size_t n = scanner.scan(paths, std::cout, format);
+    std::cerr << n << " files, " << scanner.getErrorCount() << " errors\n";
+    return scanner.getErrorCount() ? 1 : 0;
+  } catch (const std::string &e) {
+    std::cerr << e;
+    return -1;
+  }
+}